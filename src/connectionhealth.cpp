@@ -5,7 +5,6 @@
 #include "connectionhealth.h"
 
 #include <QApplication>
-#include <QDateTime>
 #include <QRandomGenerator>
 #include <chrono>
 
@@ -70,7 +69,7 @@ ConnectionHealth::ConnectionHealth() : m_dnsPingSender(QHostAddress()) {
 
   connect(&m_dnsPingTimer, &QTimer::timeout, this, [this]() {
     m_dnsPingSequence++;
-    m_dnsPingTimestamp = QDateTime::currentMSecsSinceEpoch();
+    m_dnsPingTimestamp = PingSender::monotonicTime();
     m_dnsPingSender.sendPing(QHostAddress(PING_WELL_KNOWN_ANYCAST_DNS),
                              m_dnsPingSequence);
   });
@@ -130,7 +129,7 @@ void ConnectionHealth::startIdle() {
   if (m_dnsPingSender.isValid()) {
     m_dnsPingTimer.start(PING_INTERVAL_IDLE);
     // Send an initial ping right away.
-    m_dnsPingTimestamp = QDateTime::currentMSecsSinceEpoch();
+    m_dnsPingTimestamp = PingSender::monotonicTime();
     m_dnsPingSender.sendPing(QHostAddress(PING_WELL_KNOWN_ANYCAST_DNS),
                              m_dnsPingSequence);
   }
@@ -204,11 +203,12 @@ void ConnectionHealth::pingSentAndReceived(qint64 msec) {
   emit pingReceived();
 }
 
-void ConnectionHealth::dnsPingReceived(quint16 sequence) {
+void ConnectionHealth::dnsPingReceived(quint16 sequence, qint64 timestamp) {
   if (sequence != m_dnsPingSequence) {
     return;
   }
-  quint64 latency = QDateTime::currentMSecsSinceEpoch() - m_dnsPingTimestamp;
+  quint64 latency =
+      PingSender::toMsec(std::max<qint64>(timestamp - m_dnsPingTimestamp, 0));
   logger.debug() << "Received DNS ping:" << latency << "msec";
   updateDnsPingLatency(latency);
 }
@@ -61,7 +61,7 @@ class ConnectionHealth final : public QObject {
   void startIdle();
 
   void pingSentAndReceived(qint64 msec);
-  void dnsPingReceived(quint16 sequence);
+  void dnsPingReceived(quint16 sequence, qint64 timestamp);
   void updateDnsPingLatency(quint64 latency);
 
   void setStability(ConnectionStability stability);
@@ -85,7 +85,7 @@ class ConnectionHealth final : public QObject {
   DnsPingSender m_dnsPingSender;
   QTimer m_dnsPingTimer;
   quint16 m_dnsPingSequence = 0;
-  quint64 m_dnsPingTimestamp = 0;
+  qint64 m_dnsPingTimestamp = 0;
   quint64 m_dnsPingLatency = 0;
   bool m_dnsPingInitialized = false;
 
@@ -7,7 +7,9 @@
 #include <QFileInfo>
 #include <QJsonObject>
 #include <QJsonValue>
+#include <QMetaEnum>
 #include <QNetworkInformation>
+#include <QRandomGenerator>
 
 #include "constants.h"
 #include "controller_p.h"
@@ -57,9 +59,38 @@ Logger logger("Controller");
 
 // X connection retries.
 constexpr const int CONNECTION_MAX_RETRY = 9;
+// Servers raced against the selected one, when the daemon supports it.
+constexpr const int HANDSHAKE_RACE_CANDIDATES = 2;
 using namespace std::chrono_literals;
 constexpr const auto CONFIRMING_TIMOUT = 10s;
 constexpr const auto HANDSHAKE_TIMEOUT = 15s;
+// Long enough for a retransmitted handshake initiation (REKEY_TIMEOUT is
+// 5 seconds), and for an obfuscator to start and connect.
+constexpr const auto TRANSPORT_PROBE_TIMEOUT = 10s;
+
+// The transports probed through the candidate servers when the first
+// connection attempt fails.
+constexpr const SettingsHolder::ObfuscationPolicy PROBED_TRANSPORTS[] = {
+    SettingsHolder::ObfuscationPolicy::NoObfuscation,
+    SettingsHolder::ObfuscationPolicy::Port53,
+    SettingsHolder::ObfuscationPolicy::LWO,
+    SettingsHolder::ObfuscationPolicy::UdpOverTcp,
+};
+
+// The key of the hash that identifies the networks in networkTransports,
+// generated once per installation.
+QByteArray networkTransportsSecret() {
+  SettingsHolder* settingsHolder = SettingsHolder::instance();
+  QByteArray secret = settingsHolder->networkTransportsSecret();
+  if (secret.isEmpty()) {
+    QRandomGenerator* generator = QRandomGenerator::system();
+    for (int i = 0; i < 32; ++i) {
+      secret.append(static_cast<char>(generator->bounded(256)));
+    }
+    settingsHolder->setNetworkTransportsSecret(secret);
+  }
+  return secret;
+}
 
 Controller::Reason stateToReason(Controller::State state) {
   if (state == Controller::StateSwitching ||
@@ -272,7 +303,11 @@ void Controller::deleteOSTunnelConfig() {
 }
 
 void Controller::startHandshakeTimer() {
-  m_handshakeTimer.start(HANDSHAKE_TIMEOUT);
+  // m_transportProbes always has the selected server when probing, so the
+  // shorter deadline only applies if other transports are probed with it.
+  m_handshakeTimer.start(m_transportProbes.count() > 1
+                             ? TRANSPORT_PROBE_TIMEOUT
+                             : HANDSHAKE_TIMEOUT);
 }
 
 void Controller::handshakeTimeout() {
@@ -286,16 +321,32 @@ void Controller::handshakeTimeout() {
   MozillaVPN* vpn = MozillaVPN::instance();
   Q_ASSERT(!m_activationQueue.isEmpty());
 
-  // Block the offending server and try again.
-  InterfaceConfig& hop = m_activationQueue.first();
-  vpn->serverLatency()->setCooldown(
-      hop.m_serverPublicKey, Constants::SERVER_UNRESPONSIVE_COOLDOWN_SEC);
+  // If the daemon can race the servers of the city, the first retry probes
+  // the other transports through them.
+  bool probeTransports = (m_connectionRetry == 0) &&
+                         m_impl->handshakeRacingSupported() &&
+                         !m_serverData.multihop();
+
+  // Block the offending server and try again. The raced candidates are
+  // spared: when none of them answers either, the local network is more
+  // likely at fault than all of those servers. For the same reason, no server
+  // is blocked before probing the transports, which needs them all.
+  if (!probeTransports) {
+    InterfaceConfig& hop = m_activationQueue.first();
+    vpn->serverLatency()->setCooldown(
+        hop.m_serverPublicKey, Constants::SERVER_UNRESPONSIVE_COOLDOWN_SEC);
+  }
 
   if (m_nextStep == Quit || m_nextStep == Disconnect || m_nextStep == Update) {
     deactivate();
     return;
   }
 
+  // The transport remembered for this network doesn't work anymore.
+  if (m_connectionRetry == 0) {
+    rememberTransport(obfuscationPolicy, obfuscationPolicy);
+  }
+
   // Try again, again if there are sufficient retries left.
   ++m_connectionRetry;
   emit connectionRetryChanged();
@@ -319,6 +370,17 @@ void Controller::handshakeTimeout() {
       default:
         break;
     }
+
+    // The other transports are probed at the same time, with a shorter
+    // deadline.
+    if (probeTransports) {
+      logger.info() << "Connection Attempt: probing the transports.";
+      m_probingTransports = true;
+      activateInternal(port53Policy, RandomizeServerSelection, m_initiator);
+      m_probingTransports = false;
+      return;
+    }
+
     if (port53Policy != obfuscationPolicy) {
       logger.info() << "Connection Attempt: opportunistically trying port 53.";
       activateInternal(port53Policy, RandomizeServerSelection, m_initiator);
@@ -411,12 +473,18 @@ auto Controller::setupConfigs(
   Server::ObfuscationMethod obfuscationMethod =
       m_serverData.obfuscationPolicyToObfuscationMethod(obfuscationPolicy);
 
-  Server exitServer =
-      serverSelectionPolicy == DoNotRandomizeServerSelection &&
-              !m_serverData.exitServerPublicKey().isEmpty()
-          ? MozillaVPN::instance()->serverCountryModel()->server(
-                m_serverData.exitServerPublicKey())
-          : Server::weightChooser(m_serverData.exitServers());
+  Server exitServer;
+  if (serverSelectionPolicy == DoNotRandomizeServerSelection &&
+      !m_serverData.exitServerPublicKey().isEmpty()) {
+    exitServer = MozillaVPN::instance()->serverCountryModel()->server(
+        m_serverData.exitServerPublicKey());
+  } else if (m_serverData.multihop()) {
+    exitServer = chooseServer(m_serverData.exitServers());
+  } else {
+    // The obfuscation policy may not be the configured one, see
+    // activateInternal().
+    exitServer = chooseServer(m_serverData.exitServers(obfuscationMethod));
+  }
   if (!exitServer.initialized()) {
     logger.error() << "Empty exit server list in state" << m_state;
     serverUnavailable();
@@ -490,6 +558,21 @@ auto Controller::setupConfigs(
       default:
         break;
     }
+
+    // Race a few other servers of the city against the selected one, so that
+    // an unresponsive server doesn't cost a whole handshake timeout. After a
+    // failure, they probe the other transports instead.
+    if (serverSelectionPolicy == RandomizeServerSelection &&
+        m_impl->handshakeRacingSupported()) {
+      if (m_probingTransports) {
+        exitConfig.m_candidates =
+            probeCandidates(exitServer, obfuscationPolicy);
+      } else if (obfuscationMethod ==
+                 Server::ObfuscationMethod::NoObfuscation) {
+        exitConfig.m_candidates =
+            raceCandidates(exitServer, exitConfig.m_serverPort == 53);
+      }
+    }
   }
   // For controllers that support multiple hops, create a queue of connections.
   // The entry server should start first, followed by the exit server.
@@ -502,7 +585,7 @@ auto Controller::setupConfigs(
                 !m_serverData.entryServerPublicKey().isEmpty()
             ? MozillaVPN::instance()->serverCountryModel()->server(
                   m_serverData.entryServerPublicKey())
-            : Server::weightChooser(m_serverData.entryServers());
+            : chooseServer(m_serverData.entryServers());
 
     if (!entryServer.initialized()) {
       logger.error() << "Empty entry server list in state" << m_state;
@@ -524,10 +607,10 @@ auto Controller::setupConfigs(
     entryConfig.m_hopType = InterfaceConfig::MultiHopEntry;
     entryConfig.m_obfuscationMethod = obfuscationMethod;
     entryConfig.m_allowedIPAddressRanges.append(
-        IPAddress(exitServer.ipv4AddrIn()));
-    if (!exitServer.ipv6AddrIn().isEmpty()) {
-      entryConfig.m_allowedIPAddressRanges.append(
-          IPAddress(exitServer.ipv6AddrIn()));
+        IPAddress(exitServer.ipv4AddrInAddress()));
+    QHostAddress exitIpv6AddrIn = exitServer.ipv6AddrInAddress();
+    if (!exitIpv6AddrIn.isNull()) {
+      entryConfig.m_allowedIPAddressRanges.append(IPAddress(exitIpv6AddrIn));
     }
     // always pulls city names from exitConfig, so put entry city in exitConfig
     exitConfig.m_entryCity =
@@ -568,7 +651,7 @@ auto Controller::setupConfigs(
                 !m_serverData.entryServerPublicKey().isEmpty()
             ? MozillaVPN::instance()->serverCountryModel()->server(
                   m_serverData.entryServerPublicKey())
-            : Server::weightChooser(m_serverData.entryServers());
+            : chooseServer(m_serverData.entryServers());
 
     if (!entryServer.initialized()) {
       logger.error() << "Empty entry server list in state" << m_state;
@@ -611,6 +694,21 @@ void Controller::activateInternal(
 
   m_handshakeTimer.stop();
   m_activationQueue.clear();
+  m_transportProbes.clear();
+
+  // Go straight to the transport that worked the last time on this network,
+  // if the location has servers for it.
+  if ((m_connectionRetry == 0) && !m_serverData.multihop()) {
+    SettingsHolder::ObfuscationPolicy remembered =
+        rememberedTransport(obfuscationPolicy);
+    if (!m_serverData
+             .exitServers(
+                 m_serverData.obfuscationPolicyToObfuscationMethod(remembered))
+             .isEmpty()) {
+      obfuscationPolicy = remembered;
+    }
+  }
+  m_activationPolicy = obfuscationPolicy;
 
   QList<InterfaceConfig> serverConfigs =
       setupConfigs(obfuscationPolicy, serverSelectionPolicy);
@@ -641,6 +739,143 @@ void Controller::activateInternal(
   activateNext();
 }
 
+// static
+Server Controller::chooseServer(const QList<Server>& servers) {
+  ServerLatency* serverLatency = MozillaVPN::instance()->serverLatency();
+  QList<qint64> latencies;
+  latencies.reserve(servers.count());
+  for (const Server& server : servers) {
+    latencies.append(serverLatency->getLatency(server.publicKey()));
+  }
+  return Server::latencyChooser(servers, latencies);
+}
+
+QList<InterfaceConfig::Candidate> Controller::raceCandidates(
+    const Server& server, bool forcePort53) const {
+  // The candidates share the gateways of the selected server, so that the
+  // rest of the configuration works with any of them.
+  QList<Server> servers;
+  for (const Server& other : m_serverData.exitServers()) {
+    if ((other.publicKey() != server.publicKey()) &&
+        (other.ipv4Gateway() == server.ipv4Gateway()) &&
+        (other.ipv6Gateway() == server.ipv6Gateway())) {
+      servers.append(other);
+    }
+  }
+
+  QList<InterfaceConfig::Candidate> candidates;
+  while (!servers.isEmpty() &&
+         (candidates.count() < HANDSHAKE_RACE_CANDIDATES)) {
+    Server candidate = chooseServer(servers);
+    servers.removeIf([&](const Server& other) {
+      return other.publicKey() == candidate.publicKey();
+    });
+
+    InterfaceConfig::Candidate config;
+    config.m_serverPublicKey = candidate.publicKey();
+    config.m_serverIpv4AddrIn = candidate.ipv4AddrIn();
+    config.m_serverIpv6AddrIn = candidate.ipv6AddrIn();
+    config.m_serverPort = forcePort53 ? 53 : candidate.choosePort();
+    candidates.append(config);
+  }
+  return candidates;
+}
+
+QList<InterfaceConfig::Candidate> Controller::probeCandidates(
+    const Server& server,
+    SettingsHolder::ObfuscationPolicy obfuscationPolicy) {
+  m_transportProbes.insert(server.publicKey(), obfuscationPolicy);
+
+  // Each transport is probed through a different server, as WireGuard can't
+  // have the same server twice.
+  QStringList usedServers(server.publicKey());
+  QList<InterfaceConfig::Candidate> candidates;
+  for (SettingsHolder::ObfuscationPolicy policy : PROBED_TRANSPORTS) {
+    if (policy == obfuscationPolicy) {
+      continue;
+    }
+
+    Server::ObfuscationMethod method =
+        m_serverData.obfuscationPolicyToObfuscationMethod(policy);
+    QList<Server> servers;
+    for (const Server& other : m_serverData.exitServers(method)) {
+      if (!usedServers.contains(other.publicKey()) &&
+          (other.ipv4Gateway() == server.ipv4Gateway()) &&
+          (other.ipv6Gateway() == server.ipv6Gateway())) {
+        servers.append(other);
+      }
+    }
+    if (servers.isEmpty()) {
+      logger.debug() << "No server left to probe" << policy;
+      continue;
+    }
+
+    Server candidate = chooseServer(servers);
+    usedServers.append(candidate.publicKey());
+
+    InterfaceConfig::Candidate config;
+    config.m_serverPublicKey = candidate.publicKey();
+    config.m_serverIpv4AddrIn = candidate.ipv4AddrIn();
+    config.m_serverIpv6AddrIn = candidate.ipv6AddrIn();
+    config.m_serverPort = candidate.choosePort();
+    config.m_obfuscationMethod = method;
+    switch (policy) {
+      case SettingsHolder::ObfuscationPolicy::Port53:
+        config.m_serverPort = 53;
+        break;
+      case SettingsHolder::ObfuscationPolicy::LWO:
+        config.m_lwoVersion = candidate.supportsLwoV2() ? 2 : 1;
+        break;
+      case SettingsHolder::ObfuscationPolicy::UdpOverTcp:
+        config.m_serverPort = candidate.chooseTcpPort();
+        break;
+      default:
+        break;
+    }
+    candidates.append(config);
+    m_transportProbes.insert(candidate.publicKey(), policy);
+  }
+  return candidates;
+}
+
+// static
+SettingsHolder::ObfuscationPolicy Controller::rememberedTransport(
+    SettingsHolder::ObfuscationPolicy obfuscationPolicy) {
+  QString key = ControllerPrivate::networkTransportKey(
+      networkTransportsSecret(),
+      MozillaVPN::instance()->networkWatcher()->networkId(), obfuscationPolicy);
+  std::optional<int> policy = ControllerPrivate::rememberedTransport(
+      SettingsHolder::instance()->networkTransports(), key);
+  if (!policy.has_value()) {
+    return obfuscationPolicy;
+  }
+
+  QMetaEnum meta = QMetaEnum::fromType<SettingsHolder::ObfuscationPolicy>();
+  if (!meta.valueToKey(policy.value())) {
+    return obfuscationPolicy;
+  }
+  logger.info() << "Using the transport that worked on this network:"
+                << meta.valueToKey(policy.value());
+  return static_cast<SettingsHolder::ObfuscationPolicy>(policy.value());
+}
+
+// static
+void Controller::rememberTransport(
+    SettingsHolder::ObfuscationPolicy configured,
+    SettingsHolder::ObfuscationPolicy working) {
+  QString key = ControllerPrivate::networkTransportKey(
+      networkTransportsSecret(),
+      MozillaVPN::instance()->networkWatcher()->networkId(), configured);
+
+  SettingsHolder* settingsHolder = SettingsHolder::instance();
+  QStringList entries = settingsHolder->networkTransports();
+  QStringList updated =
+      ControllerPrivate::rememberTransport(entries, key, configured, working);
+  if (updated != entries) {
+    settingsHolder->setNetworkTransports(updated);
+  }
+}
+
 // static
 QList<IPAddress> Controller::getAllowedIPAddressRanges(
     const Server& exitServer) {
@@ -655,11 +890,13 @@ QList<IPAddress> Controller::getAllowedIPAddressRanges(
   list.append(IPAddress("::0/0"));
 
   // Allow access to the internal gateway addresses.
-  logger.debug() << "Allow the IPv4 gateway:" << exitServer.ipv4Gateway();
-  list.append(IPAddress(QHostAddress(exitServer.ipv4Gateway()), 32));
-  if (!exitServer.ipv6Gateway().isEmpty()) {
-    logger.debug() << "Allow the IPv6 gateway:" << exitServer.ipv6Gateway();
-    list.append(IPAddress(QHostAddress(exitServer.ipv6Gateway()), 128));
+  QHostAddress ipv4Gateway = exitServer.ipv4GatewayAddress();
+  logger.debug() << "Allow the IPv4 gateway:" << ipv4Gateway.toString();
+  list.append(IPAddress(ipv4Gateway, 32));
+  QHostAddress ipv6Gateway = exitServer.ipv6GatewayAddress();
+  if (!ipv6Gateway.isNull()) {
+    logger.debug() << "Allow the IPv6 gateway:" << ipv6Gateway.toString();
+    list.append(IPAddress(ipv6Gateway, 128));
   }
 
   // Ensure that the Mullvad proxy services are always allowed.
@@ -788,10 +1025,26 @@ void Controller::connected(const QString& pubkey) {
     }
     // Continue anyways if the VPN service was activated externally.
     logger.info() << "Unexpected handshake: external VPN activation.";
-  } else if (m_activationQueue.first().m_serverPublicKey != pubkey) {
+  } else if (!m_activationQueue.first().hasPeer(pubkey)) {
     logger.warning() << "Unexpected handshake: public key mismatch.";
     return;
   } else {
+    // One of the candidates may have won the handshake race. They are only
+    // raced on single-hop connections, where the entry and exit servers are
+    // the same.
+    if (m_activationQueue.first().m_serverPublicKey != pubkey) {
+      logger.info() << "Handshake race won by" << logger.keys(pubkey);
+      m_serverData.setEntryServerPublicKey(pubkey);
+      m_serverData.setExitServerPublicKey(pubkey);
+    }
+
+    // Remember the transport that worked, if it's not the configured one.
+    if (!m_serverData.multihop()) {
+      rememberTransport(static_cast<SettingsHolder::ObfuscationPolicy>(
+                            SettingsHolder::instance()->obfuscationPolicy()),
+                        m_transportProbes.value(pubkey, m_activationPolicy));
+    }
+
     // Start the next connection if there is more work to do.
     m_activationQueue.removeFirst();
     if (!m_activationQueue.isEmpty()) {
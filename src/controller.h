@@ -298,6 +298,16 @@ class Controller : public QObject, public LogSerializer {
   void serverDataChanged();
   auto setupConfigs(SettingsHolder::ObfuscationPolicy obfuscationPolicy,
                     ServerSelectionPolicy serverSelectionPolicy);
+  static Server chooseServer(const QList<Server>& servers);
+  QList<InterfaceConfig::Candidate> raceCandidates(const Server& server,
+                                                   bool forcePort53) const;
+  QList<InterfaceConfig::Candidate> probeCandidates(
+      const Server& server,
+      SettingsHolder::ObfuscationPolicy obfuscationPolicy);
+  static SettingsHolder::ObfuscationPolicy rememberedTransport(
+      SettingsHolder::ObfuscationPolicy obfuscationPolicy);
+  static void rememberTransport(SettingsHolder::ObfuscationPolicy configured,
+                                SettingsHolder::ObfuscationPolicy working);
   void maybeSendUpdatedConfig(const ServerData& serverData);
   QString useLocalSocketPath() const;
 
@@ -314,6 +324,13 @@ class Controller : public QObject, public LogSerializer {
   QList<InterfaceConfig> m_activationQueue;
   int m_connectionRetry = 0;
 
+  // The obfuscation policy of the current activation, and the ones probed
+  // through the candidate servers, by public key.
+  SettingsHolder::ObfuscationPolicy m_activationPolicy =
+      SettingsHolder::ObfuscationPolicy::NoObfuscation;
+  QMap<QString, SettingsHolder::ObfuscationPolicy> m_transportProbes;
+  bool m_probingTransports = false;
+
   QScopedPointer<ControllerImpl> m_impl;
   bool m_portalDetected = false;
   bool m_isDeviceConnected = true;
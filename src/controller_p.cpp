@@ -5,6 +5,7 @@
 #include "controller_p.h"
 
 #include <QHostAddress>
+#include <QMessageAuthenticationCode>
 
 #include "dnshelper.h"
 #include "ipaddress.h"
@@ -17,10 +18,11 @@ namespace ControllerPrivate {
 QList<IPAddress> getExtensionProxyAddressRanges(
     const Server& exitServer, std::optional<const dnsData> dnsServer) {
   QList<IPAddress> ranges = {
-      IPAddress(QHostAddress(exitServer.ipv4Gateway()), 32),
+      IPAddress(exitServer.ipv4GatewayAddress(), 32),
       IPAddress(QHostAddress{MULLVAD_PROXY_RANGE}, MULLVAD_PROXY_RANGE_LENGTH)};
-  if (!exitServer.ipv6Gateway().isEmpty()) {
-    ranges.append(IPAddress(QHostAddress(exitServer.ipv6Gateway()), 128));
+  QHostAddress ipv6Gateway = exitServer.ipv6GatewayAddress();
+  if (!ipv6Gateway.isNull()) {
+    ranges.append(IPAddress(ipv6Gateway, 128));
   }
 
   const dnsData dns = [&dnsServer, &exitServer]() {
@@ -50,4 +52,51 @@ QList<IPAddress> getExtensionProxyAddressRanges(
   return ranges;
 }
 
+QString networkTransportKey(const QByteArray& secret, const QString& networkId,
+                            int configured) {
+  if (secret.isEmpty() || networkId.isEmpty()) {
+    return QString();
+  }
+  QByteArray hash = QMessageAuthenticationCode::hash(
+      networkId.toUtf8(), secret, QCryptographicHash::Sha256);
+  return QString("%1:%2:")
+      .arg(QString::fromLatin1(hash.toHex().left(16)))
+      .arg(configured);
+}
+
+std::optional<int> rememberedTransport(const QStringList& entries,
+                                       const QString& key) {
+  if (key.isEmpty()) {
+    return std::nullopt;
+  }
+  for (const QString& entry : entries) {
+    if (!entry.startsWith(key)) {
+      continue;
+    }
+    bool ok = false;
+    int policy = entry.mid(key.length()).toInt(&ok);
+    if (ok) {
+      return policy;
+    }
+  }
+  return std::nullopt;
+}
+
+QStringList rememberTransport(const QStringList& entries, const QString& key,
+                              int configured, int working) {
+  if (key.isEmpty()) {
+    return entries;
+  }
+  QStringList updated = entries;
+  updated.removeIf(
+      [&](const QString& entry) { return entry.startsWith(key); });
+  if (working != configured) {
+    updated.prepend(key + QString::number(working));
+    while (updated.count() > NETWORK_TRANSPORTS_MAX) {
+      updated.removeLast();
+    }
+  }
+  return updated;
+}
+
 }  // namespace ControllerPrivate
@@ -6,6 +6,8 @@
 
 #include <QHostAddress>
 #include <QList>
+#include <QStringList>
+#include <optional>
 
 #include "dnshelper.h"
 
@@ -30,4 +32,24 @@ QList<IPAddress> getExtensionProxyAddressRanges(
     const Server& exitServer,
     std::optional<const dnsData> dnsServer = std::nullopt);
 
+// Networks for which the working transport is remembered.
+constexpr const int NETWORK_TRANSPORTS_MAX = 32;
+
+// Identifies a network and the configured obfuscation policy in the
+// networkTransports setting. The network is hashed with a secret key, as a
+// BSSID could be recovered from a plain hash by brute force. Empty if the
+// network is unknown.
+QString networkTransportKey(const QByteArray& secret, const QString& networkId,
+                            int configured);
+
+// The obfuscation policy remembered under the given key, if any.
+std::optional<int> rememberedTransport(const QStringList& entries,
+                                       const QString& key);
+
+// Remembers that the working policy connects under the given key, or
+// forgets the key if it is the configured policy. The most recent entry
+// comes first and at most NETWORK_TRANSPORTS_MAX entries are kept.
+QStringList rememberTransport(const QStringList& entries, const QString& key,
+                              int configured, int working);
+
 }  // namespace ControllerPrivate
@@ -78,6 +78,10 @@ class ControllerImpl : public QObject {
   // Whether the controller supports split tunneling
   virtual bool splitTunnelSupported() const { return false; }
 
+  // Whether the controller can race the candidate servers of an
+  // InterfaceConfig, and keep the first to complete a handshake
+  virtual bool handshakeRacingSupported() const { return false; }
+
   virtual bool silentServerSwitchingSupported() const { return true; }
 
   virtual bool shouldSuppressNextNotification() { return false; }
@@ -11,6 +11,7 @@
 #include <QJsonValue>
 #include <QMetaEnum>
 #include <QTimer>
+#include <algorithm>
 
 #include "controller.h"
 #include "dnsutils.h"
@@ -81,6 +82,9 @@ bool Daemon::activate(const InterfaceConfig& config) {
     if (supportServerSwitching(config)) {
       logger.debug() << "Already connected. Server switching supported.";
 
+      // Drop the candidates of a race that is still going on.
+      stopRace(m_connections.value(config.m_hopType).m_candidates);
+
       if (!switchServer(config)) {
         return false;
       }
@@ -93,14 +97,16 @@ bool Daemon::activate(const InterfaceConfig& config) {
         return false;
       }
 
+      QList<InterfaceConfig> candidates = startRace(config);
       bool status = run(Switch, config);
       logger.debug() << "Connection status:" << status;
       if (status) {
-        m_connections[config.m_hopType] = ConnectionState(config);
+        m_connections[config.m_hopType] = ConnectionState(config, candidates);
         m_handshakeTimer.start(HANDSHAKE_POLL_MSEC);
         emit_failure_guard.dismiss();
         return true;
       }
+      stopRace(candidates);
       return false;
     }
 
@@ -148,7 +154,6 @@ bool Daemon::activate(const InterfaceConfig& config) {
   // endpoint so WireGuard talks to it instead of the real server.
   // For multi-hop configure obfuscator only on the entry node.
   std::unique_ptr<Obfuscator> obfuscator;
-  InterfaceConfig peerConfig = config;
   if (config.m_obfuscationMethod != Server::ObfuscationMethod::NoObfuscation &&
       config.m_hopType != InterfaceConfig::MultiHopExit) {
     obfuscator = createObfuscator(config);
@@ -157,27 +162,9 @@ bool Daemon::activate(const InterfaceConfig& config) {
                      << config.m_obfuscationMethod;
       return false;
     }
-#if defined(MZ_WINDOWS)
-    // Add exclusion route for exit server to prevent loopbacks
-    {
-      QList<IPAddress> obfuscatorServer;
-      if (!config.m_serverIpv4AddrIn.isEmpty()) {
-        obfuscatorServer.append(IPAddress(config.m_serverIpv4AddrIn));
-      }
-      if (!config.m_serverIpv6AddrIn.isEmpty()) {
-        obfuscatorServer.append(IPAddress(config.m_serverIpv6AddrIn));
-      }
-      wgutils()->excludeLocalNetworks(obfuscatorServer);
-    }
-#endif
-    peerConfig.m_serverIpv4AddrIn = "127.0.0.1";
-    // The obfuscator only binds 127.0.0.1, so clear the IPv6 endpoint to keep
-    // WireGuard from selecting an [::1]
-    peerConfig.m_serverIpv6AddrIn = QString();
-    peerConfig.m_serverPort = obfuscator->localPort();
   }
   // Add the peer to this interface.
-  if (!wgutils()->updatePeer(peerConfig)) {
+  if (!wgutils()->updatePeer(obfuscatedPeer(config, obfuscator.get()))) {
     logger.error() << "Peer creation failed.";
     return false;
   }
@@ -187,6 +174,9 @@ bool Daemon::activate(const InterfaceConfig& config) {
     m_obfuscator = std::move(obfuscator);
   }
 
+  QList<InterfaceConfig> candidates = startRace(config);
+  auto stop_race_guard = qScopeGuard([&] { stopRace(candidates); });
+
   if (!maybeUpdateResolvers(config)) {
     return false;
   }
@@ -203,14 +193,110 @@ bool Daemon::activate(const InterfaceConfig& config) {
   bool status = run(Up, config);
   logger.debug() << "Connection status:" << status;
   if (status) {
-    m_connections[config.m_hopType] = ConnectionState(config);
+    m_connections[config.m_hopType] = ConnectionState(config, candidates);
     m_handshakeTimer.start(HANDSHAKE_POLL_MSEC);
+    stop_race_guard.dismiss();
     emit_failure_guard.dismiss();
     return true;
   }
   return false;
 }
 
+// Configures the candidates of the config as peers that don't take any
+// traffic, each with its own obfuscator if needed, and returns the ones that
+// are racing against the selected server.
+QList<InterfaceConfig> Daemon::startRace(const InterfaceConfig& config) {
+  QList<InterfaceConfig> candidates;
+
+  // The peers of a multi-hop connection depend on each other.
+  if (config.m_hopType != InterfaceConfig::SingleHop) {
+    return candidates;
+  }
+
+  for (const InterfaceConfig::Candidate& candidate : config.m_candidates) {
+    if (candidate.m_serverPublicKey == config.m_serverPublicKey) {
+      continue;
+    }
+
+    InterfaceConfig candidateConfig = config;
+    candidateConfig.m_serverPublicKey = candidate.m_serverPublicKey;
+    candidateConfig.m_serverIpv4AddrIn = candidate.m_serverIpv4AddrIn;
+    candidateConfig.m_serverIpv6AddrIn = candidate.m_serverIpv6AddrIn;
+    candidateConfig.m_serverPort = candidate.m_serverPort;
+    candidateConfig.m_obfuscationMethod = candidate.m_obfuscationMethod;
+    candidateConfig.m_lwoVersion = candidate.m_lwoVersion;
+    candidateConfig.m_allowedIPAddressRanges.clear();
+    candidateConfig.m_candidates.clear();
+
+    std::unique_ptr<Obfuscator> obfuscator;
+    if (candidate.m_obfuscationMethod !=
+        Server::ObfuscationMethod::NoObfuscation) {
+      obfuscator = createObfuscator(candidateConfig);
+      if (!obfuscator->start()) {
+        logger.warning() << "Failed to start obfuscator for"
+                         << logger.keys(candidate.m_serverPublicKey);
+        continue;
+      }
+    }
+
+    if (!wgutils()->updatePeer(
+            obfuscatedPeer(candidateConfig, obfuscator.get()))) {
+      logger.warning() << "Candidate peer creation failed for"
+                       << logger.keys(candidate.m_serverPublicKey);
+      continue;
+    }
+
+    logger.debug() << "Racing" << logger.keys(candidate.m_serverPublicKey)
+                   << candidate.m_obfuscationMethod;
+    if (obfuscator) {
+      m_raceObfuscators[candidate.m_serverPublicKey] = std::move(obfuscator);
+    }
+    candidates.append(candidateConfig);
+  }
+
+  return candidates;
+}
+
+void Daemon::stopRace(const QList<InterfaceConfig>& candidates,
+                      const QString& winner) {
+  for (const InterfaceConfig& candidate : candidates) {
+    if (candidate.m_serverPublicKey != winner) {
+      wgutils()->deletePeer(candidate);
+      m_raceObfuscators.erase(candidate.m_serverPublicKey);
+    }
+  }
+}
+
+// Returns the peer to configure so that WireGuard reaches the server through
+// its obfuscator, if any, and keeps the real server out of the tunnel.
+InterfaceConfig Daemon::obfuscatedPeer(const InterfaceConfig& config,
+                                       const Obfuscator* obfuscator) {
+  InterfaceConfig peerConfig = config;
+  if (!obfuscator) {
+    return peerConfig;
+  }
+
+#if defined(MZ_WINDOWS)
+  // Add exclusion route for exit server to prevent loopbacks
+  {
+    QList<IPAddress> obfuscatorServer;
+    if (!config.m_serverIpv4AddrIn.isEmpty()) {
+      obfuscatorServer.append(IPAddress(config.m_serverIpv4AddrIn));
+    }
+    if (!config.m_serverIpv6AddrIn.isEmpty()) {
+      obfuscatorServer.append(IPAddress(config.m_serverIpv6AddrIn));
+    }
+    wgutils()->excludeLocalNetworks(obfuscatorServer);
+  }
+#endif
+  peerConfig.m_serverIpv4AddrIn = "127.0.0.1";
+  // The obfuscator only binds 127.0.0.1, so clear the IPv6 endpoint to keep
+  // WireGuard from selecting an [::1]
+  peerConfig.m_serverIpv6AddrIn = QString();
+  peerConfig.m_serverPort = obfuscator->localPort();
+  return peerConfig;
+}
+
 bool Daemon::maybeUpdateResolvers(const InterfaceConfig& config) {
   if ((config.m_hopType == InterfaceConfig::MultiHopExit) ||
       (config.m_hopType == InterfaceConfig::SingleHop)) {
@@ -414,6 +500,24 @@ bool Daemon::parseConfig(const QJsonObject& obj, InterfaceConfig& config) {
     config.m_lwoVersion = lwoVersion;
   }
 
+  if (obj.contains("candidates")) {
+    QJsonValue value = obj.value("candidates");
+    if (!value.isArray()) {
+      logger.error() << "candidates is not an array";
+      return false;
+    }
+
+    QJsonArray array = value.toArray();
+    for (const QJsonValue& i : array) {
+      InterfaceConfig::Candidate candidate;
+      if (!candidate.fromJson(i.toObject())) {
+        logger.error() << "candidates must contain valid servers";
+        return false;
+      }
+      config.m_candidates.append(candidate);
+    }
+  }
+
   return true;
 }
 
@@ -448,6 +552,7 @@ bool Daemon::deactivate(bool emitSignals) {
       wgutils()->deleteRoutePrefix(ip);
     }
     wgutils()->deletePeer(config);
+    stopRace(state.m_candidates);
   }
   m_connections.clear();
 
@@ -505,7 +610,6 @@ bool Daemon::switchServer(const InterfaceConfig& config) {
 
   // Stand up a new obfuscator for the new endpoint (entry hop only)
   std::unique_ptr<Obfuscator> obfuscator;
-  InterfaceConfig peerConfig = config;
   if (config.m_obfuscationMethod != Server::ObfuscationMethod::NoObfuscation &&
       config.m_hopType != InterfaceConfig::MultiHopExit) {
     obfuscator = createObfuscator(config);
@@ -514,28 +618,10 @@ bool Daemon::switchServer(const InterfaceConfig& config) {
                      << config.m_obfuscationMethod;
       return false;
     }
-#if defined(MZ_WINDOWS)
-    // Add exclusion route for exit server to prevent loopbacks
-    {
-      QList<IPAddress> obfuscatorServer;
-      if (!config.m_serverIpv4AddrIn.isEmpty()) {
-        obfuscatorServer.append(IPAddress(config.m_serverIpv4AddrIn));
-      }
-      if (!config.m_serverIpv6AddrIn.isEmpty()) {
-        obfuscatorServer.append(IPAddress(config.m_serverIpv6AddrIn));
-      }
-      wgutils()->excludeLocalNetworks(obfuscatorServer);
-    }
-#endif
-    peerConfig.m_serverIpv4AddrIn = "127.0.0.1";
-    // The obfuscator only binds 127.0.0.1, so clear the IPv6 endpoint to keep
-    // WireGuard from selecting an [::1]
-    peerConfig.m_serverIpv6AddrIn = QString();
-    peerConfig.m_serverPort = obfuscator->localPort();
   }
 
   // Activate the new peer and its routes.
-  if (!wgutils()->updatePeer(peerConfig)) {
+  if (!wgutils()->updatePeer(obfuscatedPeer(config, obfuscator.get()))) {
     logger.error()
         << "Server switch failed to update the peer wireguard config";
     return false;
@@ -623,18 +709,71 @@ void Daemon::checkHandshake() {
     }
     logger.debug() << "awaiting" << logger.keys(config.m_serverPublicKey);
 
-    // Check if the handshake has completed.
+    // Check if the handshake has completed, either with the selected server
+    // or with one of the candidates racing against it. The first one wins,
+    // and the selected server wins a tie.
+    auto racing = [&](const QString& pubkey) {
+      return (pubkey == config.m_serverPublicKey) ||
+             std::any_of(connection.m_candidates.cbegin(),
+                         connection.m_candidates.cend(),
+                         [&](const InterfaceConfig& candidate) {
+                           return candidate.m_serverPublicKey == pubkey;
+                         });
+    };
+
+    QString winner;
+    qint64 handshake = 0;
     for (const WireguardUtils::PeerStatus& status : peers) {
-      if (config.m_serverPublicKey != status.m_pubkey) {
+      if ((status.m_handshake == 0) || !racing(status.m_pubkey)) {
         continue;
       }
-      if (status.m_handshake != 0) {
-        connection.m_date.setMSecsSinceEpoch(status.m_handshake);
-        emit connected(status.m_pubkey);
+      if ((handshake == 0) || (status.m_handshake < handshake) ||
+          ((status.m_handshake == handshake) &&
+           (status.m_pubkey == config.m_serverPublicKey))) {
+        winner = status.m_pubkey;
+        handshake = status.m_handshake;
+      }
+    }
+
+    if (!winner.isEmpty() && (winner != config.m_serverPublicKey)) {
+      // Route the traffic through the winning candidate. WireGuard moves the
+      // allowed IPs from the selected server, which can then be dropped.
+      auto it = std::find_if(connection.m_candidates.cbegin(),
+                             connection.m_candidates.cend(),
+                             [&](const InterfaceConfig& candidate) {
+                               return candidate.m_serverPublicKey == winner;
+                             });
+      Q_ASSERT(it != connection.m_candidates.cend());
+      InterfaceConfig winnerConfig = *it;
+      winnerConfig.m_allowedIPAddressRanges = config.m_allowedIPAddressRanges;
+
+      std::unique_ptr<Obfuscator> obfuscator;
+      auto raceObfuscator = m_raceObfuscators.find(winner);
+      if (raceObfuscator != m_raceObfuscators.end()) {
+        obfuscator = std::move(raceObfuscator->second);
+        m_raceObfuscators.erase(raceObfuscator);
+      }
+
+      if (wgutils()->updatePeer(
+              obfuscatedPeer(winnerConfig, obfuscator.get()))) {
+        logger.debug() << "Race won by" << logger.keys(winner);
+        wgutils()->deletePeer(config);
+        connection.m_config = winnerConfig;
+        m_obfuscator = std::move(obfuscator);
+      } else {
+        logger.warning() << "Failed to promote" << logger.keys(winner);
+        wgutils()->deletePeer(*it);
+        connection.m_candidates.erase(it);
+        winner.clear();
       }
     }
 
-    if (!connection.m_date.isValid()) {
+    if (!winner.isEmpty()) {
+      stopRace(connection.m_candidates, winner);
+      connection.m_candidates.clear();
+      connection.m_date.setMSecsSinceEpoch(handshake);
+      emit connected(winner);
+    } else {
       pendingHandshakes++;
     }
   }
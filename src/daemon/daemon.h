@@ -7,6 +7,7 @@
 
 #include <QDateTime>
 #include <QTimer>
+#include <map>
 #include <memory>
 
 #include "daemon/daemonerrors.h"
@@ -60,6 +61,11 @@ class Daemon : public QObject {
  private:
   bool maybeUpdateResolvers(const InterfaceConfig& config);
   std::unique_ptr<Obfuscator> createObfuscator(const InterfaceConfig& config);
+  QList<InterfaceConfig> startRace(const InterfaceConfig& config);
+  void stopRace(const QList<InterfaceConfig>& candidates,
+                const QString& winner = QString());
+  InterfaceConfig obfuscatedPeer(const InterfaceConfig& config,
+                                 const Obfuscator* obfuscator);
 
  protected:
   virtual bool run(Op op, const InterfaceConfig& config) {
@@ -82,13 +88,21 @@ class Daemon : public QObject {
   class ConnectionState {
    public:
     ConnectionState() {};
-    ConnectionState(const InterfaceConfig& config) { m_config = config; }
+    ConnectionState(const InterfaceConfig& config,
+                    const QList<InterfaceConfig>& candidates = {}) {
+      m_config = config;
+      m_candidates = candidates;
+    }
     QDateTime m_date;
     InterfaceConfig m_config;
+    // The peers racing against m_config until one completes a handshake.
+    QList<InterfaceConfig> m_candidates;
   };
   QMap<InterfaceConfig::HopType, ConnectionState> m_connections;
   QTimer m_handshakeTimer;
   std::unique_ptr<Obfuscator> m_obfuscator;
+  // The obfuscators of the candidates racing for the handshake.
+  std::map<QString, std::unique_ptr<Obfuscator>> m_raceObfuscators;
 };
 
 #endif  // DAEMON_H
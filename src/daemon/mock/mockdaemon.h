@@ -24,7 +24,7 @@ class MockDaemon final : public Daemon {
   QString socketPath() const { return m_server.fullServerName(); }
 
   QStringList getFeatures() const override {
-    return QStringList("splitTunnel");
+    return QStringList({"splitTunnel", "handshakeRacing"});
   }
 
  protected:
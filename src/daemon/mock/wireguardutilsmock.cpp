@@ -5,6 +5,7 @@
 #include "wireguardutilsmock.h"
 
 #include <QDateTime>
+#include <limits>
 
 #include "leakdetector.h"
 #include "logger.h"
@@ -19,6 +20,18 @@ WireguardUtilsMock::WireguardUtilsMock(QObject* parent)
     : WireguardUtils(parent) {
   MZ_COUNT_CTOR(WireguardUtilsMock);
   logger.debug() << "WireguardUtilsMock created.";
+
+  // A comma-separated list of server public keys that never complete a
+  // handshake, to simulate unresponsive servers.
+  m_unresponsivePeers = qEnvironmentVariable("MZ_MOCK_UNRESPONSIVE_PEERS")
+                            .split(',', Qt::SkipEmptyParts);
+
+  // A comma-separated list of server ports that complete a handshake, to
+  // simulate networks that block the others.
+  for (const QString& port : qEnvironmentVariable("MZ_MOCK_HANDSHAKE_PORTS")
+                                 .split(',', Qt::SkipEmptyParts)) {
+    m_handshakePorts.append(port.toInt());
+  }
 }
 
 WireguardUtilsMock::~WireguardUtilsMock() {
@@ -34,6 +47,13 @@ bool WireguardUtilsMock::addInterface(const InterfaceConfig& config) {
 bool WireguardUtilsMock::deleteInterface() { return true; }
 
 bool WireguardUtilsMock::updatePeer(const InterfaceConfig& config) {
+  if (!m_handshakePorts.isEmpty() &&
+      !m_handshakePorts.contains(config.m_serverPort)) {
+    m_handshakes[config.m_serverPublicKey] =
+        std::numeric_limits<qint64>::max();
+    return true;
+  }
+
   qint64 now = QDateTime::currentMSecsSinceEpoch();
   m_handshakes[config.m_serverPublicKey] = now + MOCK_HANDSHAKE_DELAY_MSEC;
   return true;
@@ -49,7 +69,7 @@ QList<WireguardUtils::PeerStatus> WireguardUtilsMock::getPeerStatus() {
   for (const QString& pubkey : m_handshakes.keys()) {
     PeerStatus status(pubkey);
     qint64 hsTime = m_handshakes[pubkey];
-    if (now > hsTime) {
+    if ((now > hsTime) && !m_unresponsivePeers.contains(pubkey)) {
       status.m_handshake = hsTime;
       status.m_rxBytes = (now - hsTime) * 7;
       status.m_txBytes = (now - hsTime) * 3;
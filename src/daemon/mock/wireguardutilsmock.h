@@ -7,6 +7,7 @@
 
 #include <QMap>
 #include <QObject>
+#include <QStringList>
 
 #include "daemon/wireguardutils.h"
 
@@ -36,6 +37,8 @@ class WireguardUtilsMock final : public WireguardUtils {
  private:
   // Keep a list of peers and when we added them.
   QMap<QString, qint64> m_handshakes;
+  QStringList m_unresponsivePeers;
+  QList<int> m_handshakePorts;
 };
 
 #endif  // WIREGUARDUTILSMOCK_H
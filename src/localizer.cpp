@@ -19,6 +19,7 @@
 #include "i18nstrings.h"
 #include "leakdetector.h"
 #include "logger.h"
+#include "models/servercountry.h"
 #include "resourceloader.h"
 #include "settingsholder.h"
 
@@ -411,6 +412,10 @@ bool Localizer::loadLanguage(const QString& requestedLocalCode) {
     return false;
   }
 
+  // The server names are translated by the new translators from now on.
+  ServerCountry::clearLocalizedNames();
+  ServerCity::clearLocalizedNames();
+
   m_locale = locale;
   emit localeChanged();
 
@@ -656,7 +661,7 @@ QString Localizer::getTranslatedCityName(const QString& cityName) {
   // Malmö -> ServersMalm, São Paulo, SP -> ServersSoPaulo, Berlin, BE ->
   // ServersBerlin
 
-  QRegularExpression acceptedChars("[^a-zA-Z ]");
+  static const QRegularExpression acceptedChars("[^a-zA-Z ]");
   QString parsedCityName =
       cityName
           .split(u',')[0]              // Remove state suffix
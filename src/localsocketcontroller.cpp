@@ -233,6 +233,7 @@ void LocalSocketController::parseCommand(const QByteArray& command) {
       }
     }
     m_splitTunnelSupported = features.contains("splitTunnel");
+    m_handshakeRacingSupported = features.contains("handshakeRacing");
 
     if (m_daemonState == eInitializing) {
       m_daemonState = eReady;
@@ -37,6 +37,10 @@ class LocalSocketController : public ControllerImpl {
 
   bool splitTunnelSupported() const override { return m_splitTunnelSupported; }
 
+  bool handshakeRacingSupported() const override {
+    return m_handshakeRacingSupported;
+  }
+
  private:
   // For messages that are expected to generate a synchronous response, this
   // defines the default time that we will wait before assuming an error in
@@ -86,6 +90,7 @@ class LocalSocketController : public ControllerImpl {
   uint32_t m_initializingInterval = 0;
 
   bool m_splitTunnelSupported = false;
+  bool m_handshakeRacingSupported = false;
 
   // When a message to the daemon expects an immediate response, these
   // are used to trigger a timeout error if the response never arrives.
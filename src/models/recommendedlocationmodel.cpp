@@ -55,7 +55,15 @@ void RecommendedLocationModel::initialize() {
 void RecommendedLocationModel::refreshModel() {
   logger.debug() << "Model refresh";
 
-  QList<QPointer<ServerCity>> cities = recommendedLocations(DEFAULT_ENTRIES);
+  ServerCountryModel* scm = MozillaVPN::instance()->serverCountryModel();
+  QList<ServerCountryModel::CityHandle> cities;
+  for (const QPointer<ServerCity>& city :
+       recommendedLocations(DEFAULT_ENTRIES)) {
+    if (!city.isNull()) {
+      cities.append(scm->cityHandle(*city));
+    }
+  }
+
   if (m_recommendedCities.length() != cities.length()) {
     beginResetModel();
     m_recommendedCities.swap(cities);
@@ -89,36 +97,13 @@ QList<QPointer<ServerCity>> RecommendedLocationModel::recommendedLocations(
     latencyScale = 100.0;
   }
 
-  QVector<QPointer<ServerCity>> cityResults;
-  QVector<double> rankResults;
-  cityResults.reserve(maxResults + 1);
-  rankResults.reserve(maxResults + 1);
-
-  for (const ServerCity& city :
-       MozillaVPN::instance()->serverCountryModel()->cities()) {
-    double cityRanking = city.connectionScore() * 256.0;
-
-    // For tiebreaking, use the geographic distance and latency.
-    double distance = MozillaVPN::instance()->location()->distance(
-        city.latitude(), city.longitude());
-    cityRanking -= city.latency() / latencyScale;
-    cityRanking -= distance;
-
-    // Insert into the result list
-    qsizetype i;
-    for (i = 0; i < rankResults.count(); i++) {
-      if (rankResults[i] < cityRanking) {
-        break;
-      }
-    }
-    if (i < static_cast<qsizetype>(maxResults)) {
-      rankResults.insert(i, cityRanking);
-      cityResults.insert(i, QPointer((ServerCity*)&city));
-    }
-    if (rankResults.count() > static_cast<qsizetype>(maxResults)) {
-      rankResults.resize(maxResults);
-      cityResults.resize(maxResults);
-    }
+  Location* location = MozillaVPN::instance()->location();
+  QList<QPointer<ServerCity>> cityResults;
+  for (ServerCity* city : instance()->m_recommender.recommend(
+           MozillaVPN::instance()->serverCountryModel()->cities(),
+           location->latitude(), location->longitude(), latencyScale,
+           maxResults)) {
+    cityResults.append(QPointer(city));
   }
 
   return cityResults;
@@ -145,13 +130,15 @@ QVariant RecommendedLocationModel::data(const QModelIndex& index,
   if (!index.isValid() || index.row() >= m_recommendedCities.length()) {
     return QVariant();
   }
-  QPointer<ServerCity> city = m_recommendedCities.at(index.row());
+  // The city is gone if the server list changed since the last refresh.
+  ServerCity* city = MozillaVPN::instance()->serverCountryModel()->city(
+      m_recommendedCities.at(index.row()));
   switch (role) {
     case CityRole:
-      if (city.isNull()) {
+      if (!city) {
         return QVariant();
       }
-      return QVariant::fromValue(city.data());
+      return QVariant::fromValue(city);
 
     default:
       return QVariant();
@@ -10,7 +10,9 @@
 #include <QSet>
 #include <QTimer>
 
+#include "models/cityrecommender.h"
 #include "models/servercity.h"
+#include "models/servercountrymodel.h"
 
 class RecommendedLocationModel final : public QAbstractListModel {
   Q_OBJECT
@@ -51,8 +53,10 @@ class RecommendedLocationModel final : public QAbstractListModel {
   void refreshModel();
 
  private:
-  QList<QPointer<ServerCity>> m_recommendedCities;
+  QList<ServerCountryModel::CityHandle> m_recommendedCities;
   QTimer m_timer;
+
+  CityRecommender m_recommender;
 };
 
 #endif  // RECOMMENDEDLOCATIONMODEL_H
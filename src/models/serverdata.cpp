@@ -271,9 +271,9 @@ QList<Server> ServerData::getServerList(
   QList<Server> results;
   qint64 now = QDateTime::currentSecsSinceEpoch();
 
-  for (const QString& pubkey : city.servers()) {
-    const Server& server = scm->server(pubkey);
-    if (server.initialized() && (serverLatency->getCooldown(pubkey) <= now) &&
+  for (int id : city.serverIds()) {
+    const Server& server = scm->server(id);
+    if (server.initialized() && (serverLatency->getCooldown(id) <= now) &&
         server.supportObfuscationMethod(obfuscationMethod)) {
       results.append(server);
     }
@@ -289,6 +289,11 @@ const QList<Server> ServerData::exitServers() const {
       multihop() ? Server::NoObfuscation : m_obfuscationMethod);
 }
 
+const QList<Server> ServerData::exitServers(
+    Server::ObfuscationMethod obfuscationMethod) const {
+  return getServerList(m_exitCountryCode, m_exitCityName, obfuscationMethod);
+}
+
 const QList<Server> ServerData::entryServers() const {
   if (!multihop()) {
     return exitServers();
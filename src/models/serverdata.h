@@ -71,6 +71,8 @@ class ServerData final : public QObject {
   bool hasServerData() const { return !m_exitCountryCode.isEmpty(); }
 
   const QList<Server> exitServers() const;
+  const QList<Server> exitServers(
+      Server::ObfuscationMethod obfuscationMethod) const;
   const QList<Server> entryServers() const;
 
   const QString& exitCountryCode() const { return m_exitCountryCode; }
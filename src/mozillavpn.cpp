@@ -111,6 +111,7 @@
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
 #include <QScreen>
+#include <QStandardPaths>
 #include <QTimer>
 #include <QUrl>
 #include <QUrlQuery>
@@ -121,6 +122,40 @@ Logger logger("MozillaVPN");
 MozillaVPN* s_instance = nullptr;
 bool s_mockFreeTrial = false;
 QString s_updateVersion;
+
+QString serverSnapshotFileName() {
+#ifdef MZ_WASM
+  return QString();
+#else
+#  ifdef UNIT_TEST
+  QDir dir(QStandardPaths::writableLocation(QStandardPaths::TempLocation));
+#  else
+  QDir dir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+#  endif
+  if (!dir.exists() && !dir.mkpath(".")) {
+    return QString();
+  }
+  return dir.filePath("servers.snapshot");
+#endif
+}
+
+// Load the server list from the settings. Parsing the JSON is skipped if we
+// have a snapshot of the parsed list, and otherwise a snapshot is written for
+// the next launch.
+bool loadServerList(ServerCountryModel* model) {
+  QByteArray serverData = SettingsHolder::instance()->servers();
+  QString fileName = serverSnapshotFileName();
+  if (!fileName.isEmpty() && model->fromSnapshot(fileName, serverData)) {
+    return true;
+  }
+  if (!model->fromJson(serverData)) {
+    return false;
+  }
+  if (!fileName.isEmpty()) {
+    model->writeSnapshot(fileName);
+  }
+  return true;
+}
 }  // namespace
 
 // static
@@ -390,7 +425,7 @@ void MozillaVPN::initialize() {
     return;
   }
 
-  if (!m_private->m_serverCountryModel.fromJson(settingsHolder->servers())) {
+  if (!loadServerList(&m_private->m_serverCountryModel)) {
     logger.error() << "No server list found";
     SettingsManager::instance()->reset();
     return;
@@ -444,7 +479,7 @@ bool MozillaVPN::loadModels() {
   m_private->m_serverData.initialize();
 
   if (!m_private->m_deviceModel.fromSettings(&m_private->m_keys) ||
-      !m_private->m_serverCountryModel.fromJson(settingsHolder->servers()) ||
+      !loadServerList(&m_private->m_serverCountryModel) ||
       !m_private->m_user.fromSettings() ||
       !m_private->m_serverData.fromSettings() || !modelsInitialized()) {
     return false;
@@ -720,15 +755,20 @@ bool MozillaVPN::setServerList(const QByteArray& serverData) {
   }
 
   SettingsHolder::instance()->setServers(serverData);
+
+  QString fileName = serverSnapshotFileName();
+  if (!fileName.isEmpty()) {
+    m_private->m_serverCountryModel.writeSnapshot(fileName);
+  }
   return true;
 }
 
-void MozillaVPN::serversFetched(const QByteArray& serverData) {
+bool MozillaVPN::serversFetched(const QByteArray& serverData) {
   logger.debug() << "Server fetched!";
 
   if (!setServerList(serverData)) {
     // This is OK. The check is done elsewhere.
-    return;
+    return false;
   }
 
   // The serverData could be unset or invalid with the new server list.
@@ -742,6 +782,7 @@ void MozillaVPN::serversFetched(const QByteArray& serverData) {
     m_private->m_serverData.update(city->country(), city->name());
     Q_ASSERT(m_private->m_serverData.hasServerData());
   }
+  return true;
 }
 
 void MozillaVPN::deviceRemovalCompleted(const QString& publicKey) {
@@ -187,7 +187,8 @@ class MozillaVPN final : public QObject {
   void removeDevice(const QString& publicKey, const QString& source);
   void deviceRemovalCompleted(const QString& publicKey);
 
-  void serversFetched(const QByteArray& serverData);
+  // Returns false if the server list is invalid.
+  bool serversFetched(const QByteArray& serverData);
 
   void accountChecked(const QByteArray& json);
 
@@ -284,8 +284,9 @@ qint64 NetworkRequest::discardData() {
 }
 
 bool NetworkRequest::isRedirect() const {
+  // 304 Not Modified has no location to follow.
   int status = statusCode();
-  return status >= 300 && status < 400;
+  return status >= 300 && status < 400 && status != 304;
 }
 
 void NetworkRequest::handleHeaderReceived() {
@@ -386,6 +387,16 @@ int NetworkRequest::statusCode() const {
 
 void NetworkRequest::disableTimeout() { m_timer.stop(); }
 
+void NetworkRequest::setCacheValidators(const QByteArray& etag,
+                                        const QByteArray& lastModified) {
+  if (!etag.isEmpty()) {
+    m_request.setRawHeader("If-None-Match", etag);
+  }
+  if (!lastModified.isEmpty()) {
+    m_request.setRawHeader("If-Modified-Since", lastModified);
+  }
+}
+
 QByteArray NetworkRequest::rawHeader(const QByteArray& headerName) const {
   if (!m_reply) {
     logger.error() << "INTERNAL ERROR! NetworkRequest::rawHeader called before "
@@ -58,6 +58,11 @@ class NetworkRequest final : public QObject {
 
   void disableTimeout();
 
+  // Only fetch the resource if it changed since the response that returned
+  // these validators. Otherwise, the reply is a 304 with an empty body.
+  void setCacheValidators(const QByteArray& etag,
+                          const QByteArray& lastModified);
+
   int statusCode() const;
 
   QByteArray rawHeader(const QByteArray& headerName) const;
@@ -76,6 +76,8 @@ void NetworkWatcher::initialize() {
 
   connect(m_impl, &NetworkWatcherImpl::unsecuredNetwork, this,
           &NetworkWatcher::unsecuredNetwork);
+  connect(m_impl, &NetworkWatcherImpl::networkChanged, this,
+          [this](const QString& bssid) { m_bssid = bssid; });
   connect(m_impl, &NetworkWatcherImpl::networkChanged, this,
           &NetworkWatcher::networkChange);
 
@@ -181,6 +183,18 @@ QNetworkInformation::Reachability NetworkWatcher::getReachability() {
   return QNetworkInformation::Reachability::Unknown;
 }
 
+QString NetworkWatcher::networkId() const {
+  // The kind of network alone would lump every cellular or wired network
+  // together, so only the BSSID counts as an identifier.
+  QNetworkInformation* info = QNetworkInformation::instance();
+  if (!info || m_bssid.isEmpty() ||
+      info->transportMedium() != QNetworkInformation::TransportMedium::WiFi) {
+    return QString();
+  }
+
+  return QString("WiFi/%1").arg(m_bssid);
+}
+
 void NetworkWatcher::simulateDisconnection(bool simulatedDisconnection) {
   m_simulatedDisconnection = simulatedDisconnection;
 }
@@ -32,6 +32,10 @@ class NetworkWatcher final : public QObject {
 
   QNetworkInformation::Reachability getReachability();
 
+  // Identifies the WiFi network the device is on by the BSSID of its access
+  // point. Empty if the platform does not tell the BSSID.
+  QString networkId() const;
+
  signals:
   void networkChange();
 
@@ -53,6 +57,9 @@ class NetworkWatcher final : public QObject {
 
   // Used to simulate network disconnection in the Inspector
   bool m_simulatedDisconnection = false;
+
+  // The last BSSID reported by the platform, if any.
+  QString m_bssid;
 };
 
 #endif  // NETWORKWATCHER_H
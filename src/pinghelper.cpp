@@ -4,7 +4,6 @@
 
 #include "pinghelper.h"
 
-#include <QDateTime>
 #include <cmath>
 
 #include "dnspingsender.h"
@@ -95,7 +94,7 @@ void PingHelper::nextPing() {
   // request, and serves as an index into the circular buffer. Overflows of
   // the sequence number acceptable.
   int index = m_sequence % PING_STATS_WINDOW;
-  m_pingData[index].timestamp = QDateTime::currentMSecsSinceEpoch();
+  m_pingData[index].timestamp = PingSender::monotonicTime();
   m_pingData[index].latency = -1;
   m_pingData[index].sequence = m_sequence;
   m_pingSender->sendPing(m_gateway, m_sequence);
@@ -103,11 +102,12 @@ void PingHelper::nextPing() {
   m_sequence++;
 }
 
-void PingHelper::pingReceived(quint16 sequence) {
+void PingHelper::pingReceived(quint16 sequence, qint64 timestamp) {
   int index = sequence % PING_STATS_WINDOW;
   if (m_pingData[index].sequence == sequence) {
     qint64 sendTime = m_pingData[index].timestamp;
-    m_pingData[index].latency = QDateTime::currentMSecsSinceEpoch() - sendTime;
+    m_pingData[index].latency =
+        PingSender::toMsec(std::max<qint64>(timestamp - sendTime, 0));
     emit pingSentAndReceived(m_pingData[index].latency);
 #ifdef MZ_DEBUG
     logger.debug() << "Ping answer received seq:" << sequence
@@ -179,7 +179,9 @@ double PingHelper::loss() const {
   int recvCount = 0;
   // Don't count pings that are possibly still in flight as losses.
   qint64 sendBefore =
-      QDateTime::currentMSecsSinceEpoch() - (PING_TIMEOUT.count());
+      PingSender::monotonicTime() -
+      std::chrono::duration_cast<std::chrono::microseconds>(PING_TIMEOUT)
+          .count();
 
   for (const PingSendData& data : m_pingData) {
     if (data.latency >= 0) {
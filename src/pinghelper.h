@@ -36,7 +36,7 @@ class PingHelper final : public QObject {
  private:
   void nextPing();
 
-  void pingReceived(quint16 sequence);
+  void pingReceived(quint16 sequence, qint64 timestamp);
 
  private:
   QHostAddress m_gateway;
@@ -50,6 +50,7 @@ class PingHelper final : public QObject {
       latency = -1;
       sequence = 0;
     }
+    // Monotonic send time in microseconds, see PingSender::monotonicTime().
     qint64 timestamp;
     qint64 latency;
     quint16 sequence;
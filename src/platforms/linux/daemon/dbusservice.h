@@ -33,6 +33,9 @@ class DBusService final : public Daemon, protected QDBusContext {
   virtual bool activate(const InterfaceConfig& config) override;
   virtual bool deactivate(bool emitSignals = true) override;
 
+  // Peers without allowed IPs still handshake, thanks to their keepalive.
+  QStringList getFeatures() const override { return {"handshakeRacing"}; }
+
  public slots:
   QString status();
   QString version();
@@ -254,9 +254,13 @@ bool WireguardUtilsLinux::updatePeer(const InterfaceConfig& config) {
     return false;
   }
 
-  // Configure the allowed addresses for this peer.
-  if ((config.m_hopType == InterfaceConfig::SingleHop) ||
-      (config.m_hopType == InterfaceConfig::MultiHopExit)) {
+  // Configure the allowed addresses for this peer. A peer without any only
+  // takes part in handshakes, see Daemon::startRace().
+  if (config.m_allowedIPAddressRanges.isEmpty()) {
+    logger.debug() << "Peer" << logger.keys(config.m_serverPublicKey)
+                   << "has no allowed IPs";
+  } else if ((config.m_hopType == InterfaceConfig::SingleHop) ||
+             (config.m_hopType == InterfaceConfig::MultiHopExit)) {
     if (!config.m_deviceIpv4Address.isNull()) {
       addPeerPrefix(peer, IPAddress("0.0.0.0/0"));
     }
@@ -330,7 +334,11 @@ bool WireguardUtilsLinux::deletePeer(const InterfaceConfig& config) {
   // Clear firewall settings for this server.
   const QString endpointAddr = m_peerEndpoints.take(config.m_serverPublicKey);
 
-  if (!endpointAddr.isEmpty() && !m_firewall.clearInbound(endpointAddr)) {
+  // Obfuscated peers share the 127.0.0.1 endpoint, so keep the mark for as
+  // long as another peer still uses it.
+  if (!endpointAddr.isEmpty() &&
+      !m_peerEndpoints.values().contains(endpointAddr) &&
+      !m_firewall.clearInbound(endpointAddr)) {
     return false;
   }
 
@@ -432,6 +440,28 @@ QStringList WireguardUtilsLinux::currentInterfaces() {
 
 bool WireguardUtilsLinux::setPeerEndpoint(struct sockaddr* sa,
                                           const QString& address, int port) {
+  // Server addresses are IP literals, which don't need the resolver.
+  QHostAddress literal;
+  if (literal.setAddress(address) && literal.scopeId().isEmpty()) {
+    if (literal.protocol() == QAbstractSocket::IPv4Protocol) {
+      struct sockaddr_in* sin = reinterpret_cast<struct sockaddr_in*>(sa);
+      memset(sin, 0, sizeof(*sin));
+      sin->sin_family = AF_INET;
+      sin->sin_port = htons(port);
+      sin->sin_addr.s_addr = htonl(literal.toIPv4Address());
+      return true;
+    }
+    if (literal.protocol() == QAbstractSocket::IPv6Protocol) {
+      struct sockaddr_in6* sin6 = reinterpret_cast<struct sockaddr_in6*>(sa);
+      memset(sin6, 0, sizeof(*sin6));
+      sin6->sin6_family = AF_INET6;
+      sin6->sin6_port = htons(port);
+      Q_IPV6ADDR ipv6 = literal.toIPv6Address();
+      memcpy(&sin6->sin6_addr, ipv6.c, sizeof(sin6->sin6_addr));
+      return true;
+    }
+  }
+
   QString portString = QString::number(port);
 
   struct addrinfo hints;
@@ -5,6 +5,7 @@
 #include "linuxcontroller.h"
 
 #include <QDBusPendingCallWatcher>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonValue>
@@ -72,6 +73,10 @@ void LinuxController::initializeCompleted(QDBusPendingCallWatcher* call) {
   QJsonValue statusValue = obj.value("connected");
   Q_ASSERT(statusValue.isBool());
 
+  // Older daemons don't report their features.
+  m_handshakeRacingSupported =
+      obj.value("features").toArray().contains("handshakeRacing");
+
   emit initialized(true, statusValue.toBool(), QDateTime::currentDateTime());
 }
 
@@ -38,6 +38,10 @@ class LinuxController final : public ControllerImpl {
 
   bool splitTunnelSupported() const override;
 
+  bool handshakeRacingSupported() const override {
+    return m_handshakeRacingSupported;
+  }
+
  private slots:
   void checkStatusCompleted(QDBusPendingCallWatcher* call);
   void initializeCompleted(QDBusPendingCallWatcher* call);
@@ -48,6 +52,8 @@ class LinuxController final : public ControllerImpl {
  private:
   DBusClient* m_dbus = nullptr;
   QDBusServiceWatcher* m_serviceWatcher = nullptr;
+
+  bool m_handshakeRacingSupported = false;
 };
 
 #endif  // LINUXCONTROLLER_H
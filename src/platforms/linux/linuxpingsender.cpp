@@ -12,6 +12,8 @@
 #include <netinet/ip.h>
 #include <netinet/ip_icmp.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <QSocketNotifier>
@@ -22,7 +24,77 @@
 
 namespace {
 Logger logger("LinuxPingSender");
+
+// Maximum number of packets to submit or drain with a single system call.
+constexpr int PING_BATCH_SIZE = 32;
+
+// Echo replies only carry the headers we sent, plus the IP header for raw
+// sockets, so a small buffer per datagram is plenty.
+constexpr size_t PING_RECV_BUFSIZE = 512;
+
+union PingPacket {
+  struct icmphdr v4;
+  struct icmp6_hdr v6;
+};
+
+// Ancillary data buffer for the kernel receive timestamp.
+union PingControl {
+  char buf[CMSG_SPACE(sizeof(struct timespec))];
+  struct cmsghdr align;
+};
+
+// Ask the kernel to timestamp packets as they arrive, so that the time spent
+// waiting for the event loop isn't counted as latency.
+void enableTimestamps(int socket) {
+  int enable = 1;
+  if (setsockopt(socket, SOL_SOCKET, SO_TIMESTAMPNS, &enable,
+                 sizeof(enable)) != 0) {
+    logger.warning() << "Failed to enable timestamps:" << strerror(errno);
+  }
+}
+
+// Build the echo request for a single ping. Returns the length of the
+// destination address, or zero if the address family is not supported.
+socklen_t preparePing(const QHostAddress& dest, quint16 ident, quint16 sequence,
+                      struct sockaddr_storage* addr, PingPacket* packet) {
+  memset(addr, 0, sizeof(struct sockaddr_storage));
+  memset(packet, 0, sizeof(PingPacket));
+
+  if (dest.protocol() == QAbstractSocket::IPv6Protocol) {
+    struct sockaddr_in6* sin6 = reinterpret_cast<struct sockaddr_in6*>(addr);
+    sin6->sin6_family = AF_INET6;
+    Q_IPV6ADDR qaddr = dest.toIPv6Address();
+    memcpy(&sin6->sin6_addr, &qaddr, sizeof(sin6->sin6_addr));
+
+    packet->v6.icmp6_type = ICMP6_ECHO_REQUEST;
+    packet->v6.icmp6_id = htons(ident);
+    packet->v6.icmp6_seq = htons(sequence);
+    return sizeof(struct sockaddr_in6);
+  }
+
+  if (dest.protocol() == QAbstractSocket::IPv4Protocol) {
+    struct sockaddr_in* sin = reinterpret_cast<struct sockaddr_in*>(addr);
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = qToBigEndian<quint32>(dest.toIPv4Address());
+
+    packet->v4.type = ICMP_ECHO;
+    packet->v4.un.echo.id = htons(ident);
+    packet->v4.un.echo.sequence = htons(sequence);
+    packet->v4.checksum =
+        PingSender::inetChecksum(&packet->v4, sizeof(packet->v4));
+    return sizeof(struct sockaddr_in);
+  }
+
+  return 0;
+}
+
+size_t packetLength(const struct sockaddr_storage* addr) {
+  if (addr->ss_family == AF_INET6) {
+    return sizeof(struct icmp6_hdr);
+  }
+  return sizeof(struct icmphdr);
 }
+}  // namespace
 
 int LinuxPingSender::createSocket() {
   // Try creating an ICMP socket. This would be the ideal choice, but it can
@@ -119,6 +191,7 @@ LinuxPingSender::LinuxPingSender(const QHostAddress& source, QObject* parent)
       return;
     }
 
+    enableTimestamps(m_socket);
     m_notifier = new QSocketNotifier(m_socket, QSocketNotifier::Read, this);
     connect(m_notifier, &QSocketNotifier::activated, this,
             &LinuxPingSender::icmp6SocketReady);
@@ -147,6 +220,7 @@ LinuxPingSender::LinuxPingSender(const QHostAddress& source, QObject* parent)
     return;
   }
 
+  enableTimestamps(m_socket);
   m_notifier = new QSocketNotifier(m_socket, QSocketNotifier::Read, this);
   if (m_ident) {
     connect(m_notifier, &QSocketNotifier::activated, this,
@@ -165,109 +239,168 @@ LinuxPingSender::~LinuxPingSender() {
 }
 
 void LinuxPingSender::sendPing(const QHostAddress& dest, quint16 sequence) {
-  if (dest.protocol() == QAbstractSocket::IPv6Protocol) {
-    struct sockaddr_in6 addr{};
-    addr.sin6_family = AF_INET6;
-    Q_IPV6ADDR qaddr = dest.toIPv6Address();
-    memcpy(&addr.sin6_addr, &qaddr, sizeof(addr.sin6_addr));
-
-    struct icmp6_hdr packet{};
-    packet.icmp6_type = ICMP6_ECHO_REQUEST;
-    packet.icmp6_id = htons(m_ident);
-    packet.icmp6_seq = htons(sequence);
-
-    int rc = sendto(m_socket, &packet, sizeof(packet), 0,
-                    (struct sockaddr*)&addr, sizeof(addr));
-    if (rc < 0) {
-      logger.error() << "failed to send:" << strerror(errno);
-    }
+  struct sockaddr_storage addr;
+  PingPacket packet;
+  socklen_t addrlen = preparePing(dest, m_ident, sequence, &addr, &packet);
+  if (addrlen == 0) {
+    logger.error() << "unsupported destination address";
     return;
   }
 
-  quint32 ipv4dest = dest.toIPv4Address();
-  struct sockaddr_in addr;
-  memset(&addr, 0, sizeof(addr));
-  addr.sin_family = AF_INET;
-  addr.sin_addr.s_addr = qToBigEndian<quint32>(ipv4dest);
-
-  struct icmphdr packet;
-  memset(&packet, 0, sizeof(packet));
-  packet.type = ICMP_ECHO;
-  packet.un.echo.id = htons(m_ident);
-  packet.un.echo.sequence = htons(sequence);
-  packet.checksum = inetChecksum(&packet, sizeof(packet));
-
-  int rc = sendto(m_socket, &packet, sizeof(packet), 0, (struct sockaddr*)&addr,
-                  sizeof(addr));
+  int rc = sendto(m_socket, &packet, packetLength(&addr), 0,
+                  (struct sockaddr*)&addr, addrlen);
   if (rc < 0) {
     logger.error() << "failed to send:" << strerror(errno);
   }
 }
 
-void LinuxPingSender::icmpSocketReady() {
-  socklen_t slen = 0;
-  unsigned char data[2048];
-  int rc = recvfrom(m_socket, data, sizeof(data), MSG_DONTWAIT, NULL, &slen);
-  if (rc <= 0) {
-    logger.error() << "recvfrom failed:" << strerror(errno);
-    return;
-  }
+void LinuxPingSender::sendPings(const QList<PingRequest>& requests) {
+  struct sockaddr_storage addrs[PING_BATCH_SIZE];
+  PingPacket packets[PING_BATCH_SIZE];
+  struct iovec iovs[PING_BATCH_SIZE];
+  struct mmsghdr msgs[PING_BATCH_SIZE];
+
+  qsizetype offset = 0;
+  while (offset < requests.count()) {
+    // Fill up the next batch of messages.
+    unsigned int count = 0;
+    while ((count < PING_BATCH_SIZE) && (offset < requests.count())) {
+      const PingRequest& request = requests.at(offset++);
+      socklen_t addrlen = preparePing(request.destination, m_ident,
+                                      request.sequence, &addrs[count],
+                                      &packets[count]);
+      if (addrlen == 0) {
+        logger.error() << "unsupported destination address";
+        continue;
+      }
+
+      iovs[count].iov_base = &packets[count];
+      iovs[count].iov_len = packetLength(&addrs[count]);
+      memset(&msgs[count], 0, sizeof(struct mmsghdr));
+      msgs[count].msg_hdr.msg_name = &addrs[count];
+      msgs[count].msg_hdr.msg_namelen = addrlen;
+      msgs[count].msg_hdr.msg_iov = &iovs[count];
+      msgs[count].msg_hdr.msg_iovlen = 1;
+      count++;
+    }
 
-  struct icmphdr packet;
-  if (rc >= (int)sizeof(packet)) {
-    memcpy(&packet, data, sizeof(packet));
-    if (packet.type == ICMP_ECHOREPLY) {
-      emit recvPing(htons(packet.un.echo.sequence));
+    // Submit the batch. The kernel stops at the first message that fails, so
+    // log and skip over it before submitting the remainder.
+    unsigned int sent = 0;
+    while (sent < count) {
+      int rc = sendmmsg(m_socket, &msgs[sent], count - sent, 0);
+      if (rc < 0) {
+        logger.error() << "failed to send:" << strerror(errno);
+        sent++;
+        continue;
+      }
+      sent += rc;
     }
   }
 }
 
-void LinuxPingSender::icmp6SocketReady() {
-  unsigned char data[2048];
-  int rc = recvfrom(m_socket, data, sizeof(data), MSG_DONTWAIT, NULL, NULL);
+// Read up to PING_BATCH_SIZE datagrams from the socket with a single system
+// call, and invoke the callback for each one of them along with the time it
+// was received.
+void LinuxPingSender::recvBatch(
+    const std::function<void(const unsigned char*, int, qint64)>& callback) {
+  unsigned char data[PING_BATCH_SIZE][PING_RECV_BUFSIZE];
+  PingControl control[PING_BATCH_SIZE];
+  struct iovec iovs[PING_BATCH_SIZE];
+  struct mmsghdr msgs[PING_BATCH_SIZE];
+
+  memset(msgs, 0, sizeof(msgs));
+  for (int i = 0; i < PING_BATCH_SIZE; i++) {
+    iovs[i].iov_base = data[i];
+    iovs[i].iov_len = sizeof(data[i]);
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_control = control[i].buf;
+    msgs[i].msg_hdr.msg_controllen = sizeof(control[i].buf);
+  }
+
+  int rc = recvmmsg(m_socket, msgs, PING_BATCH_SIZE, MSG_DONTWAIT, nullptr);
   if (rc <= 0) {
-    logger.error() << "recvfrom failed:" << strerror(errno);
+    if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+      logger.error() << "recvmmsg failed:" << strerror(errno);
+    }
     return;
   }
 
-  struct icmp6_hdr packet;
-  if (rc >= (int)sizeof(packet)) {
-    memcpy(&packet, data, sizeof(packet));
-    if (packet.icmp6_type == ICMP6_ECHO_REPLY &&
-        (m_ident == 0 || ntohs(packet.icmp6_id) == m_ident)) {
-      emit recvPing(ntohs(packet.icmp6_seq));
+  // Kernel timestamps come from the realtime clock. Convert them into the
+  // monotonic clock by working out how long ago each packet arrived.
+  struct timespec realNow;
+  clock_gettime(CLOCK_REALTIME, &realNow);
+  qint64 monoNow = monotonicTime();
+
+  for (int i = 0; i < rc; i++) {
+    qint64 timestamp = monoNow;
+    struct msghdr* hdr = &msgs[i].msg_hdr;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+      if ((cmsg->cmsg_level != SOL_SOCKET) ||
+          (cmsg->cmsg_type != SCM_TIMESTAMPNS)) {
+        continue;
+      }
+      struct timespec ts;
+      memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+      qint64 age = (realNow.tv_sec - ts.tv_sec) * 1000000 +
+                   (realNow.tv_nsec - ts.tv_nsec) / 1000;
+      if (age >= 0) {
+        timestamp = monoNow - age;
+      }
     }
+    callback(data[i], static_cast<int>(msgs[i].msg_len), timestamp);
   }
 }
 
-void LinuxPingSender::rawSocketReady() {
-  socklen_t slen = 0;
-  unsigned char data[2048];
-  int rc = recvfrom(m_socket, data, sizeof(data), MSG_DONTWAIT, NULL, &slen);
-  if (rc <= 0) {
-    logger.error() << "recvfrom failed:" << strerror(errno);
-    return;
-  }
+void LinuxPingSender::icmpSocketReady() {
+  recvBatch([this](const unsigned char* data, int length, qint64 timestamp) {
+    struct icmphdr packet;
+    if (length >= (int)sizeof(packet)) {
+      memcpy(&packet, data, sizeof(packet));
+      if (packet.type == ICMP_ECHOREPLY) {
+        emit recvPing(htons(packet.un.echo.sequence), timestamp);
+      }
+    }
+  });
+}
 
-  // Check the IP header
-  const struct iphdr* ip = (struct iphdr*)data;
-  int iphdrlen = ip->ihl * 4;
-  if (rc < iphdrlen || iphdrlen < (int)sizeof(struct iphdr)) {
-    logger.error() << "malformed IP packet:" << strerror(errno);
-    return;
-  }
+void LinuxPingSender::icmp6SocketReady() {
+  recvBatch([this](const unsigned char* data, int length, qint64 timestamp) {
+    struct icmp6_hdr packet;
+    if (length >= (int)sizeof(packet)) {
+      memcpy(&packet, data, sizeof(packet));
+      if (packet.icmp6_type == ICMP6_ECHO_REPLY &&
+          (m_ident == 0 || ntohs(packet.icmp6_id) == m_ident)) {
+        emit recvPing(ntohs(packet.icmp6_seq), timestamp);
+      }
+    }
+  });
+}
 
-  // Check the ICMP packet
-  struct icmphdr packet;
-  if (inetChecksum(data + iphdrlen, rc - iphdrlen) != 0) {
-    logger.warning() << "invalid checksum";
-    return;
-  }
-  if (rc >= (iphdrlen + (int)sizeof(packet))) {
-    memcpy(&packet, data + iphdrlen, sizeof(packet));
-    quint16 id = htons(m_ident);
-    if ((packet.type == ICMP_ECHOREPLY) && (packet.un.echo.id == id)) {
-      emit recvPing(htons(packet.un.echo.sequence));
+void LinuxPingSender::rawSocketReady() {
+  recvBatch([this](const unsigned char* data, int length, qint64 timestamp) {
+    // Check the IP header
+    const struct iphdr* ip = (const struct iphdr*)data;
+    int iphdrlen = ip->ihl * 4;
+    if (length < iphdrlen || iphdrlen < (int)sizeof(struct iphdr)) {
+      logger.error() << "malformed IP packet";
+      return;
     }
-  }
+
+    // Check the ICMP packet
+    struct icmphdr packet;
+    if (inetChecksum(data + iphdrlen, length - iphdrlen) != 0) {
+      logger.warning() << "invalid checksum";
+      return;
+    }
+    if (length >= (iphdrlen + (int)sizeof(packet))) {
+      memcpy(&packet, data + iphdrlen, sizeof(packet));
+      quint16 id = htons(m_ident);
+      if ((packet.type == ICMP_ECHOREPLY) && (packet.un.echo.id == id)) {
+        emit recvPing(htons(packet.un.echo.sequence), timestamp);
+      }
+    }
+  });
 }
@@ -6,6 +6,7 @@
 #define LINUXPINGSENDER_H
 
 #include <QObject>
+#include <functional>
 
 #include "pingsender.h"
 
@@ -22,10 +23,14 @@ class LinuxPingSender final : public PingSender {
   bool isValid() override { return (m_socket >= 0); };
 
   void sendPing(const QHostAddress& dest, quint16 sequence) override;
+  void sendPings(const QList<PingRequest>& requests) override;
+  int maxInFlight() const override { return 256; }
 
  private:
   int createSocket();
   int createSocket6();
+  void recvBatch(
+      const std::function<void(const unsigned char*, int, qint64)>& callback);
 
  private slots:
   void rawSocketReady();
@@ -184,7 +184,7 @@ void MacOSPingSender::socketReady() {
   struct icmp* icmp = (struct icmp*)(((char*)packet) + hlen);
 
   if (icmp->icmp_type == ICMP_ECHOREPLY && icmp->icmp_id == identifier()) {
-    emit recvPing(htons(icmp->icmp_seq));
+    emit recvPing(htons(icmp->icmp_seq), monotonicTime());
   }
 }
 
@@ -206,6 +206,6 @@ void MacOSPingSender::icmp6SocketReady() {
   memcpy(&icmp6, packet, sizeof(icmp6));
 
   if (icmp6.icmp6_type == ICMP6_ECHO_REPLY && icmp6.icmp6_id == identifier()) {
-    emit recvPing(htons(icmp6.icmp6_seq));
+    emit recvPing(htons(icmp6.icmp6_seq), monotonicTime());
   }
 }
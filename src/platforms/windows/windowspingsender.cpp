@@ -285,7 +285,7 @@ void WindowsPingSender::pingEventReady() {
   assert(m_private->m_replyBuffer.reply.Data ==
          static_cast<PVOID>(&m_private->m_replyBuffer.payload));
 
-  emit recvPing(m_private->m_replyBuffer.payload);
+  emit recvPing(m_private->m_replyBuffer.payload, monotonicTime());
 }
 
 void WindowsPingSender::pingEvent6Ready() {
@@ -309,5 +309,5 @@ void WindowsPingSender::pingEvent6Ready() {
     return;
   }
 
-  emit recvPing(m_private->m_replyBuffer6.payload);
+  emit recvPing(m_private->m_replyBuffer6.payload, monotonicTime());
 }
@@ -5,7 +5,11 @@
 #include "serverlatency.h"
 
 #include <QApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
 #include <QDateTime>
+#include <QtMath>
+#include <algorithm>
 #ifndef MZ_WASM
 #  include <QNetworkInterface>
 #endif
@@ -14,7 +18,6 @@
 #include "feature/features.h"
 #include "leakdetector.h"
 #include "logger.h"
-#include "mfbt/checkedint.h"
 #include "models/location.h"
 #include "models/servercountrymodel.h"
 #include "mozillavpn.h"
@@ -22,7 +25,10 @@
 #include "settingsholder.h"
 #include "tcppingsender.h"
 
-constexpr const int SERVER_LATENCY_MAX_PARALLEL = 8;
+// Lower limit for the number of pings in flight. The actual window adapts to
+// packet loss, up to the limit of the ping sender, see
+// PingSender::maxInFlight().
+constexpr const int SERVER_LATENCY_MIN_PARALLEL = 4;
 
 constexpr const int SERVER_LATENCY_MAX_RETRIES = 2;
 
@@ -32,6 +38,11 @@ constexpr int SCORE_SERVER_REDUNDANCY_THRESHOLD = 3;
 // Latency threshold for excellent connections, set intentionally very low.
 constexpr int SCORE_EXCELLENT_LATENCY_THRESHOLD = 30;
 
+// Locations that lose this many probes, or whose latency fluctuates by this
+// much, are considered unreliable.
+constexpr double SCORE_PACKET_LOSS_THRESHOLD = 0.1;
+constexpr int SCORE_JITTER_THRESHOLD = 50;
+
 namespace {
 Logger logger("ServerLatency");
 
@@ -55,22 +66,46 @@ bool hasIPv4Connectivity() {
   return false;
 #endif
 }
+// Resolution of the ping timeouts.
+constexpr const std::chrono::microseconds SERVER_LATENCY_TICK = 10ms;
+// Bounds on the ping timeout, which is otherwise derived from the observed
+// round trip times.
+constexpr const std::chrono::milliseconds SERVER_LATENCY_MIN_TIMEOUT = 500ms;
 constexpr const std::chrono::milliseconds SERVER_LATENCY_TIMEOUT = 5s;
 constexpr const auto SERVER_LATENCY_INITIAL = 1s;
 constexpr const auto SERVER_LATENCY_REFRESH = 30min;
 // Delay the progressChanged() signal to rate-limit how often score changes.
 constexpr const auto SERVER_LATENCY_PROGRESS_DELAY = 500ms;
+// How long changes to the cooldowns may wait before they are saved.
+constexpr const auto SERVER_LATENCY_SETTINGS_DELAY = 5s;
+// Cached latency measurements older than this are discarded at startup.
+constexpr const auto SERVER_LATENCY_CACHE_MAX_AGE = 24h;
+// Bump this whenever the format of the latency cache changes.
+constexpr const quint8 SERVER_LATENCY_CACHE_VERSION = 3;
 }  // namespace
 
-ServerLatency::ServerLatency() { MZ_COUNT_CTOR(ServerLatency); }
+ServerLatency::ServerLatency()
+    : m_pingReplies(SERVER_LATENCY_TICK.count()),
+      m_scheduler(SERVER_LATENCY_MIN_PARALLEL, SERVER_LATENCY_MIN_PARALLEL,
+                  SERVER_LATENCY_MIN_TIMEOUT.count(),
+                  SERVER_LATENCY_TIMEOUT.count()) {
+  MZ_COUNT_CTOR(ServerLatency);
+}
 
 ServerLatency::~ServerLatency() { MZ_COUNT_DTOR(ServerLatency); }
 
 void ServerLatency::initialize() {
   MozillaVPN* vpn = MozillaVPN::instance();
 
+  // Restore the measurements from the previous session, so that we can
+  // provide connection scores before the first refresh completes.
+  readSettings();
+
   connect(vpn->serverCountryModel(), &ServerCountryModel::changed, this,
-          &ServerLatency::start);
+          &ServerLatency::serverListChanged);
+
+  connect(vpn->location(), &Location::changed, this,
+          &ServerLatency::locationChanged);
 
   connect(vpn->controller(), &Controller::stateChanged, this,
           &ServerLatency::stateChanged);
@@ -82,8 +117,12 @@ void ServerLatency::initialize() {
   connect(&m_refreshTimer, &QTimer::timeout, this, &ServerLatency::start);
 
   m_progressDelayTimer.setSingleShot(true);
-  connect(&m_progressDelayTimer, &QTimer::timeout, this,
-          [this]() { emit progressChanged(); });
+  connect(&m_progressDelayTimer, &QTimer::timeout, this, [this]() {
+    if (m_scoresDirty) {
+      updateAllConnectionScores();
+    }
+    emit progressChanged();
+  });
 
   if (Feature::serverConnectionScore.supported) {
     m_refreshTimer.start(SERVER_LATENCY_INITIAL);
@@ -93,6 +132,15 @@ void ServerLatency::initialize() {
   connect(&m_cooldownTimer, &QTimer::timeout, this,
           &ServerLatency::clearCooldowns);
 
+  m_settingsTimer.setSingleShot(true);
+  connect(&m_settingsTimer, &QTimer::timeout, this,
+          &ServerLatency::writeSettings);
+  connect(qApp, &QCoreApplication::aboutToQuit, this, [this]() {
+    if (m_settingsTimer.isActive()) {
+      writeSettings();
+    }
+  });
+
   connect(qApp, &QApplication::applicationStateChanged, this,
           &ServerLatency::applicationStateChanged);
 
@@ -129,7 +177,6 @@ void ServerLatency::start() {
     return;
   }
 
-  m_sequence = 0;
   m_wantRefresh = false;
   m_hasIPv4Connectivity = hasIPv4Connectivity();
   QHostAddress sourceAddr = m_hasIPv4Connectivity
@@ -143,40 +190,53 @@ void ServerLatency::start() {
     delete m_pingSender;
     m_pingSender = new TcpPingSender(sourceAddr, 80, this);
   }
+  m_scheduler.reset(m_pingSender->maxInFlight());
 
-  connect(m_pingSender, SIGNAL(recvPing(quint16)), this,
-          SLOT(recvPing(quint16)), Qt::QueuedConnection);
+  connect(m_pingSender, &PingSender::recvPing, this, &ServerLatency::recvPing,
+          Qt::QueuedConnection);
   connect(m_pingSender, SIGNAL(criticalPingError()), this,
           SLOT(criticalPingError()));
 
+  // Only servers that are new, stale or failing need to be measured again,
+  // everything else keeps the measurements we already have.
+  qint64 staleBefore =
+      QDateTime::currentSecsSinceEpoch() -
+      std::chrono::duration_cast<std::chrono::seconds>(SERVER_LATENCY_REFRESH)
+          .count();
+  ServerCountryModel* scm = vpn->serverCountryModel();
+  resizeServerData();
+  QBitArray listed(m_statistics.count());
+  qsizetype numServers = 0;
+
   // Generate a list of servers to ping. If possible, sort them by geographic
   // distance to try and get data for the quickest servers first.
-  for (const ServerCountry& country : vpn->serverCountryModel()->countries()) {
+  for (const ServerCountry& country : scm->countries()) {
     for (const QString& cityName : country.cities()) {
-      const ServerCity& city =
-          vpn->serverCountryModel()->findCity(country.code(), cityName);
+      const ServerCity& city = scm->findCity(country.code(), cityName);
       double distance =
           vpn->location()->distance(city.latitude(), city.longitude());
       Q_ASSERT(city.initialized());
 
-      // Search for where in the list to insert this city's servers.
-      auto i = m_pingSendQueue.begin();
-      while (i != m_pingSendQueue.end()) {
-        if (i->distance >= distance) {
-          break;
+      // Add the servers to the queue, which takes care of the ordering.
+      for (int id : city.serverIds()) {
+        listed.setBit(id);
+        numServers++;
+        if (!needsProbe(id, staleBefore)) {
+          continue;
         }
-        i++;
-      }
-
-      // Insert the servers into the list.
-      for (const QString& pubkey : city.servers()) {
-        ServerPingRecord rec = {
-            pubkey, city.country(), city.name(), 0, 0, distance, 0};
-        i = m_pingSendQueue.insert(i, rec);
+        m_pingSendQueue.append({id, 0, 0}, distance);
       }
     }
   }
 
+  // Forget about servers that have been removed from the list. An empty list
+  // most likely hasn't been loaded yet, so keep what we have until it is.
+  if (numServers > 0) {
+    removeStatistics(listed);
+  }
+
+  logger.debug() << "Probing" << m_pingSendQueue.count() << "of" << numServers
+                 << "servers";
   m_pingSendTotal = m_pingSendQueue.count();
 
   m_progressDelayTimer.stop();
@@ -187,57 +247,55 @@ void ServerLatency::start() {
 }
 
 void ServerLatency::maybeSendPings() {
-  quint64 now = QDateTime::currentMSecsSinceEpoch();
+  qint64 now = PingSender::monotonicTime();
   ServerCountryModel* scm = MozillaVPN::instance()->serverCountryModel();
   if (m_pingSender == nullptr) {
     return;
   }
 
-  // Scan through the reply list, looking for timeouts.
-  while (!m_pingReplyList.isEmpty()) {
-    const ServerPingRecord& record = m_pingReplyList.first();
-    if ((record.timestamp + SERVER_LATENCY_TIMEOUT.count()) > now) {
-      break;
-    }
-    logger.debug() << "Server" << logger.keys(record.publicKey) << "timeout"
-                   << record.retries;
+  // Collect the pings to send, so they can be handed to the ping sender as
+  // a single batch. Timestamps are in microseconds, but the scheduler works
+  // in milliseconds.
+  QList<PingSender::PingRequest> batch;
+  qint64 timeout = m_scheduler.timeout() * 1000;
+  auto enqueuePing = [&](ServerPingRecord& record) {
+    record.timestamp = now;
+    quint16 sequence = m_pingReplies.insert(record, now + timeout);
 
-    // Send a retry.
-    if (record.retries < SERVER_LATENCY_MAX_RETRIES) {
-      ServerPingRecord retry = record;
-      retry.retries++;
-      retry.sequence = m_sequence++;
-      retry.timestamp = now;
-      m_pingReplyList.append(retry);
+    const Server& server = scm->server(record.serverId);
+    batch.append({m_hasIPv4Connectivity ? server.ipv4AddrInAddress()
+                                        : server.ipv6AddrInAddress(),
+                  sequence});
+  };
 
-      const Server& server = scm->server(retry.publicKey);
-      m_pingSender->sendPing(
-          QHostAddress(m_hasIPv4Connectivity ? server.ipv4AddrIn()
-                                             : server.ipv6AddrIn()),
-          retry.sequence);
-    }
+  // Retry any pings that have timed out.
+  for (ServerPingRecord& record : m_pingReplies.expire(now)) {
+    logger.debug() << "Server" << logger.keys(scm->publicKey(record.serverId))
+                   << "timeout" << record.retries;
+    m_scheduler.pingTimeout(record.timestamp / 1000, now / 1000);
+    addLoss(record.serverId);
 
     // TODO: Mark the server unavailable?
-    m_pingReplyList.removeFirst();
+    if (record.retries < SERVER_LATENCY_MAX_RETRIES) {
+      record.retries++;
+      enqueuePing(record);
+    }
   }
 
   // Generate new pings until we reach our max number of parallel pings.
-  while (m_pingReplyList.count() < SERVER_LATENCY_MAX_PARALLEL) {
+  while ((m_pingReplies.count() < m_scheduler.window()) &&
+         !m_pingReplies.isFull()) {
     if (m_pingSendQueue.isEmpty()) {
       break;
     }
 
     ServerPingRecord record = m_pingSendQueue.takeFirst();
-    record.sequence = m_sequence++;
-    record.timestamp = now;
     record.retries = 0;
-    m_pingReplyList.append(record);
+    enqueuePing(record);
+  }
 
-    const Server& server = scm->server(record.publicKey);
-    m_pingSender->sendPing(
-        QHostAddress(m_hasIPv4Connectivity ? server.ipv4AddrIn()
-                                           : server.ipv6AddrIn()),
-        record.sequence);
+  if (!batch.isEmpty()) {
+    m_pingSender->sendPings(batch);
   }
 
   m_lastUpdateTime = QDateTime::currentDateTime();
@@ -245,32 +303,35 @@ void ServerLatency::maybeSendPings() {
     m_progressDelayTimer.start(SERVER_LATENCY_PROGRESS_DELAY);
   }
 
-  if (m_pingReplyList.isEmpty()) {
-    // If the ping reply list is empty, then we have nothing left to do.
+  if (m_pingReplies.isEmpty()) {
+    // If there are no pings in flight, then we have nothing left to do.
     stop();
   } else {
-    // Otherwise, the list should be sorted by transmit time. Schedule a timer
-    // to cleanup anything that experiences a timeout.
-    const ServerPingRecord& record = m_pingReplyList.first();
-
-    CheckedInt<int> value(SERVER_LATENCY_TIMEOUT.count());
-    value -= static_cast<int>(now - record.timestamp);
-
-    m_pingTimeout.start(value.value());
+    // Otherwise, schedule a timer to cleanup anything that experiences a
+    // timeout.
+    qint64 remaining = m_pingReplies.nextDeadline() - now;
+    m_pingTimeout.start(
+        static_cast<int>(std::max<qint64>(remaining + 999, 0) / 1000));
   }
 }
 
 void ServerLatency::stop() {
   m_pingTimeout.stop();
   m_pingSendQueue.clear();
-  m_pingReplyList.clear();
+  m_pingReplies.clear();
   m_pingSendTotal = 0;
 
   if (m_pingSender) {
     m_pingSender->deleteLater();
     m_pingSender = nullptr;
+    writeSettings();
+  } else if (m_settingsTimer.isActive()) {
+    writeSettings();
   }
 
+  if (m_scoresDirty) {
+    updateAllConnectionScores();
+  }
   emit progressChanged();
   m_progressDelayTimer.stop();
   if (!m_refreshTimer.isActive()) {
@@ -288,12 +349,117 @@ void ServerLatency::refresh() {
 }
 
 void ServerLatency::clear() {
-  m_latency.clear();
+  m_statistics.fill(PingStatistics());
+  m_latencyUpdated.fill(0);
   m_sumLatencyMsec = 0;
+  m_numLatencyServers = 0;
 
   emit progressChanged();
 }
 
+bool ServerLatency::needsProbe(int serverId, qint64 staleBefore) const {
+  if ((serverId < 0) || (serverId >= m_statistics.count())) {
+    return true;
+  }
+  const PingStatistics& stats = m_statistics.at(serverId);
+  if ((stats.latency() == 0) ||
+      (stats.packetLoss() >= SCORE_PACKET_LOSS_THRESHOLD)) {
+    return true;
+  }
+  return m_latencyUpdated.at(serverId) < staleBefore;
+}
+
+void ServerLatency::removeStatistics(const QBitArray& keep) {
+  for (qsizetype id = 0; id < m_statistics.count(); id++) {
+    if ((id < keep.size()) && keep.testBit(id)) {
+      continue;
+    }
+    PingStatistics& stats = m_statistics[id];
+    qint64 latency = stats.latency();
+    if (latency > 0) {
+      m_sumLatencyMsec -= latency;
+      m_numLatencyServers--;
+    }
+    stats = PingStatistics();
+    m_latencyUpdated[id] = 0;
+  }
+}
+
+int ServerLatency::serverId(const QString& pubkey) {
+  ServerCountryModel* scm = MozillaVPN::instance()->serverCountryModel();
+  int id = scm->addServerId(pubkey);
+  resizeServerData();
+  return id;
+}
+
+int ServerLatency::findServerId(const QString& pubkey) const {
+  ServerCountryModel* scm = MozillaVPN::instance()->serverCountryModel();
+  int id = scm->serverId(pubkey);
+  return (id < m_statistics.count()) ? id : -1;
+}
+
+void ServerLatency::resizeServerData() {
+  // IDs are never reused, so the arrays only need to grow to cover the
+  // servers that have been added since.
+  ServerCountryModel* scm = MozillaVPN::instance()->serverCountryModel();
+  qsizetype count = scm->serverIdCount();
+  if (m_statistics.count() < count) {
+    m_statistics.resize(count);
+    m_latencyUpdated.resize(count, 0);
+    m_cooldown.resize(count, 0);
+  }
+}
+
+QList<int> ServerLatency::cityServerIds(const ServerCity& city) const {
+  // Cities that are not part of the model have no IDs yet, and servers that
+  // were just added may not be covered by the arrays.
+  ServerCountryModel* scm = MozillaVPN::instance()->serverCountryModel();
+  if ((city.serverIds().count() == city.servers().count()) &&
+      (m_statistics.count() >= scm->serverIdCount())) {
+    return city.serverIds();
+  }
+
+  QList<int> ids;
+  for (const QString& pubkey : city.servers()) {
+    int id = findServerId(pubkey);
+    if (id >= 0) {
+      ids.append(id);
+    }
+  }
+  return ids;
+}
+
+void ServerLatency::serverListChanged() {
+  // The cities may have moved to other slots, or have been updated in place.
+  m_multiHopRows.clear();
+
+  // Expire any cooldowns restored from the cache, and refresh the scores
+  // with the measurements we already have before starting a new sweep.
+  resizeServerData();
+  clearCooldowns();
+  updateAllConnectionScores();
+  start();
+}
+
+void ServerLatency::locationChanged() {
+  QByteArray identity = networkIdentity();
+  if (identity.isEmpty() || (identity == m_networkIdentity)) {
+    return;
+  }
+
+  bool networkChanged = !m_networkIdentity.isEmpty();
+  m_networkIdentity = identity;
+  if (!networkChanged) {
+    return;
+  }
+
+  // Latency measured from another network is meaningless here.
+  logger.debug() << "Network changed, discarding cached latency";
+  clear();
+  updateAllConnectionScores();
+  start();
+}
+
 void ServerLatency::stateChanged() {
   Controller::State state = MozillaVPN::instance()->controller()->state();
   if (state != Controller::StateOff) {
@@ -325,24 +491,22 @@ void ServerLatency::applicationStateChanged() {
 #endif
 }
 
-void ServerLatency::recvPing(quint16 sequence) {
-  qint64 now(QDateTime::currentMSecsSinceEpoch());
-
-  for (auto i = m_pingReplyList.begin(); i != m_pingReplyList.end(); i++) {
-    const ServerPingRecord& record = *i;
-    if (record.sequence != sequence) {
-      continue;
-    }
-
-    qint64 latency(now - record.timestamp);
-    if (latency <= std::numeric_limits<uint>::max()) {
-      setLatency(record.publicKey, latency);
-    }
-
-    m_pingReplyList.erase(i);
-    maybeSendPings();
+void ServerLatency::recvPing(quint16 sequence, qint64 timestamp) {
+  ServerPingRecord record;
+  if (!m_pingReplies.take(sequence, &record)) {
     return;
   }
+
+  qint64 rtt = timestamp - record.timestamp;
+  if (rtt >= 0) {
+    addSample(record.serverId, rtt);
+    m_scheduler.pingReceived(PingSender::toMsec(rtt));
+  }
+
+  // Replies tend to arrive in bursts, so defer sending more pings until
+  // the event loop is idle. This lets us refill the window with a single
+  // batch rather than a ping per reply.
+  m_pingTimeout.start(0);
 }
 
 void ServerLatency::criticalPingError() {
@@ -350,40 +514,101 @@ void ServerLatency::criticalPingError() {
 }
 
 qint64 ServerLatency::avgLatency() const {
-  if (m_latency.isEmpty()) {
+  if (m_numLatencyServers == 0) {
     return 0;
   }
-  return (m_sumLatencyMsec + m_latency.count() - 1) / m_latency.count();
+  return (m_sumLatencyMsec + m_numLatencyServers - 1) / m_numLatencyServers;
+}
+
+PingStatistics ServerLatency::getStatistics(const QString& pubkey) const {
+  int id = findServerId(pubkey);
+  return (id >= 0) ? m_statistics.at(id) : PingStatistics();
 }
 
 void ServerLatency::setLatency(const QString& pubkey, qint64 msec) {
-  m_sumLatencyMsec -= m_latency[pubkey];
-  m_sumLatencyMsec += msec;
-  m_latency[pubkey] = msec;
+  addSample(serverId(pubkey), msec * 1000);
+}
+
+void ServerLatency::setTimeout(const QString& pubkey) {
+  addLoss(serverId(pubkey));
+}
 
-  updateConnectionScore(pubkey);
+void ServerLatency::addSample(int serverId, qint64 usec) {
+  PingStatistics& stats = m_statistics[serverId];
+  qint64 previous = stats.latency();
+  stats.addSample(usec);
+  if (previous == 0) {
+    m_numLatencyServers++;
+  }
+  m_sumLatencyMsec += stats.latency() - previous;
+  m_latencyUpdated[serverId] = QDateTime::currentSecsSinceEpoch();
+
+  scheduleScoreUpdate();
 }
 
-void ServerLatency::updateConnectionScore(const QString& pubkey) {
+void ServerLatency::addLoss(int serverId) {
+  m_statistics[serverId].addLoss();
+
+  scheduleScoreUpdate();
+}
+
+ServerLatency::CityStatistics ServerLatency::cityStatistics(
+    const ServerCity& city) const {
+  CityStatistics totals;
+  for (int id : cityServerIds(city)) {
+    const PingStatistics& stats = m_statistics.at(id);
+    if (stats.probes() == 0) {
+      continue;
+    }
+    totals.sumPacketLoss += stats.packetLoss();
+    totals.numLossSamples++;
+    if (stats.latency() > 0) {
+      totals.sumLatencyMsec += stats.latency();
+      totals.sumJitterMsec += stats.jitter();
+      totals.numLatencySamples++;
+    }
+  }
+  return totals;
+}
+
+void ServerLatency::scheduleScoreUpdate() {
+  // Scores are relative to the average latency over all servers, so every
+  // city has to be scored again when a measurement changes. Rather than doing
+  // that for every reply, mark them dirty and rescore everything at once on
+  // the next progress update, in a single scan over the servers.
+  m_scoresDirty = true;
+  if (!m_progressDelayTimer.isActive()) {
+    m_progressDelayTimer.start(SERVER_LATENCY_PROGRESS_DELAY);
+  }
+}
+
+void ServerLatency::updateAllConnectionScores() {
+  m_scoresDirty = false;
+  resizeServerData();
   ServerCountryModel* scm = MozillaVPN::instance()->serverCountryModel();
-  const Server& server = scm->server(pubkey);
-  ServerCity& city = scm->findCity(server.countryCode(), server.cityName());
+  for (const ServerCountry& country : scm->countries()) {
+    for (const QString& cityName : country.cities()) {
+      updateCityScore(scm->findCity(country.code(), cityName));
+    }
+  }
+}
 
-  // Update the average latency for this city.
-  int numLatencySamples = 0;
+void ServerLatency::updateCityScore(ServerCity& city) {
+  // Update the average latency, jitter and packet loss for this city.
+  const CityStatistics stats = cityStatistics(city);
   qint64 avgLatencyMsec = 0;
-  for (const QString& pubkey : city.servers()) {
-    qint64 rtt = m_latency.value(pubkey);
-    if (rtt > 0) {
-      avgLatencyMsec += rtt;
-      numLatencySamples++;
-    }
+  qint64 avgJitterMsec = 0;
+  double avgPacketLoss = 0.0;
+  if (stats.numLatencySamples > 0) {
+    avgLatencyMsec = (stats.sumLatencyMsec + stats.numLatencySamples - 1) /
+                     stats.numLatencySamples;
+    avgJitterMsec = stats.sumJitterMsec / stats.numLatencySamples;
   }
-  if (numLatencySamples > 0) {
-    avgLatencyMsec += (numLatencySamples - 1);
-    avgLatencyMsec /= numLatencySamples;
+  if (stats.numLossSamples > 0) {
+    avgPacketLoss = std::clamp(stats.sumPacketLoss / stats.numLossSamples,
+                               0.0, 1.0);
   }
-  city.setLatency(avgLatencyMsec);
+  city.setLatency(avgLatencyMsec, avgJitterMsec, avgPacketLoss);
 
   // Calculate the base score based on the user's current location.
   QString userCountry = MozillaVPN::instance()->location()->countryCode();
@@ -402,9 +627,18 @@ void ServerLatency::updateConnectionScore(const QString& pubkey) {
     }
   }
 
+  // Take a point away if the location is unreliable.
+  if ((avgPacketLoss >= SCORE_PACKET_LOSS_THRESHOLD) ||
+      (avgJitterMsec >= SCORE_JITTER_THRESHOLD)) {
+    score--;
+  }
+
   if (score > ServerLatency::Excellent) {
     score = ServerLatency::Excellent;
   }
+  if (score < ServerLatency::Poor) {
+    score = ServerLatency::Poor;
+  }
   city.setConnectionScore(score);
 }
 
@@ -413,19 +647,23 @@ double ServerLatency::progress() const {
     return 1.0;  // Operation is complete.
   }
 
-  double remaining = m_pingReplyList.count() + m_pingSendQueue.count();
+  double remaining = m_pingReplies.count() + m_pingSendQueue.count();
   return 1.0 - (remaining / m_pingSendTotal);
 }
 
+qint64 ServerLatency::getCooldown(const QString& pubkey) const {
+  return getCooldown(findServerId(pubkey));
+}
+
 void ServerLatency::setCooldown(const QString& publicKey, qint64 timeout) {
-  if (timeout <= 0) {
-    m_cooldown.remove(publicKey);
-  } else {
-    m_cooldown[publicKey] = QDateTime::currentSecsSinceEpoch() + timeout;
-  }
+  int id = serverId(publicKey);
+  m_cooldown[id] =
+      (timeout <= 0) ? 0 : QDateTime::currentSecsSinceEpoch() + timeout;
+  scheduleSettingsWrite();
+  invalidateMultiHopScores();
 
   // Update the connection score.
-  updateConnectionScore(publicKey);
+  scheduleScoreUpdate();
 
   // (Re)schedule the cooldown timer if this would be the next expiration.
   int next = m_cooldownTimer.remainingTime();
@@ -437,28 +675,31 @@ void ServerLatency::setCooldown(const QString& publicKey, qint64 timeout) {
 void ServerLatency::setCityCooldown(const QString& countryCode,
                                     const QString& cityCode, qint64 timeout) {
   ServerCountryModel* scm = MozillaVPN::instance()->serverCountryModel();
+  resizeServerData();
   logger.debug() << "Set cooldown for all servers for:"
                  << logger.sensitive(countryCode) << logger.sensitive(cityCode);
 
   // Enumerate all the servers in this city and set their cooldown.
   qint64 expire = QDateTime::currentSecsSinceEpoch() + timeout;
   QString cityName;
-  for (auto city : scm->cities()) {
-    if (city.country() != countryCode) {
+  for (const ServerCity* city : scm->cities()) {
+    if (city->country() != countryCode) {
       continue;
     }
-    if (city.code() != cityCode) {
+    if (city->code() != cityCode) {
       continue;
     }
-    cityName = city.name();
-    for (const QString& pubkey : city.servers()) {
-      m_cooldown[pubkey] = expire;
+    cityName = city->name();
+    for (int id : city->serverIds()) {
+      m_cooldown[id] = expire;
     }
   }
   if (cityName.isEmpty()) {
     logger.debug() << "no such city";
     return;
   }
+  scheduleSettingsWrite();
+  invalidateMultiHopScores();
 
   // With all servers on cooldown, the city score should be unavailable.
   ServerCity& city = scm->findCity(countryCode, cityName);
@@ -472,25 +713,27 @@ void ServerLatency::setCityCooldown(const QString& countryCode,
 }
 
 void ServerLatency::clearAllCooldowns() {
-  if (m_cooldown.isEmpty()) {
+  if (std::all_of(m_cooldown.cbegin(), m_cooldown.cend(),
+                  [](qint64 expiration) { return expiration == 0; })) {
     return;
   }
 
-  const QList<QString> pubkeys = m_cooldown.keys();
-  m_cooldown.clear();
+  m_cooldown.fill(0);
   m_cooldownTimer.stop();
+  scheduleSettingsWrite();
+  invalidateMultiHopScores();
 
   // Recompute the connection score for every server that was on cooldown.
-  for (const QString& pubkey : pubkeys) {
-    updateConnectionScore(pubkey);
-  }
+  scheduleScoreUpdate();
 }
 
 void ServerLatency::clearCooldowns() {
   qint64 now = QDateTime::currentSecsSinceEpoch();
   qint64 next = 0;
-  for (const QString& pubkey : m_cooldown.keys()) {
-    qint64 expiration = m_cooldown.value(pubkey);
+  for (qint64& expiration : m_cooldown) {
+    if (expiration == 0) {
+      continue;
+    }
     if (expiration > now) {
       if ((next == 0) || (expiration < next)) {
         next = expiration;
@@ -498,8 +741,9 @@ void ServerLatency::clearCooldowns() {
       continue;
     }
 
-    m_cooldown.remove(pubkey);
-    updateConnectionScore(pubkey);
+    expiration = 0;
+    scheduleScoreUpdate();
+    invalidateMultiHopScores();
   }
 
   // (Re)schedule the cooldown timer if there are more cooldowns to expire.
@@ -514,7 +758,8 @@ int ServerLatency::baseCityScore(const ServerCity* city,
   int score = Poor;
   int activeServerCount = 0;
   for (const QString& pubkey : city->servers()) {
-    if (getCooldown(pubkey) <= now) {
+    // Servers without an ID have never been probed, nor put on cooldown.
+    if (getCooldown(findServerId(pubkey)) <= now) {
       activeServerCount++;
     }
   }
@@ -547,32 +792,199 @@ int ServerLatency::multiHopScore(const QString& exitCountry,
                                  const QString& entryCityName) const {
   const ServerCountryModel* scm = MozillaVPN::instance()->serverCountryModel();
   const ServerCity& exitCity = scm->findCity(exitCountry, exitCityName);
-  logger.debug() << "multihop score" << exitCountry << exitCityName << "to"
-                 << entryCountry << entryCityName;
   if (!exitCity.initialized()) {
     logger.debug() << "multihop no exit data";
     return ServerLatency::NoData;
   }
 
-  int score = baseCityScore(&exitCity, entryCountry);
-  if (score <= ServerLatency::Unavailable) {
-    logger.debug() << "multihop unavailable";
-    return score;
-  }
-
-  // Increase the score if the distance between servers is less than 1/8th of
-  // the earth's circumference.
   const ServerCity& entryCity = scm->findCity(entryCountry, entryCityName);
   if (!entryCity.initialized()) {
+    // Without an entry, an unavailable exit is still reported as such.
+    int score = baseCityScore(&exitCity, entryCountry);
+    if (score <= ServerLatency::Unavailable) {
+      return score;
+    }
     logger.debug() << "mutlihop no entry data";
     return ServerLatency::NoData;
   }
-  if ((Location::distance(&exitCity, &entryCity) < (M_PI / 4))) {
-    score++;
+
+  int exitSlot = scm->cityHandle(exitCity).slot;
+  int entrySlot = scm->cityHandle(entryCity).slot;
+  Q_ASSERT((exitSlot >= 0) && (entrySlot >= 0));
+  return multiHopScores(entrySlot)[exitSlot];
+}
+
+const qint8* ServerLatency::multiHopScores(int entrySlot) const {
+  const ServerCountryModel* scm = MozillaVPN::instance()->serverCountryModel();
+  qsizetype slots = scm->citySlotCount();
+  if (m_multiHopRows.size() != slots) {
+    m_multiHopScores.resize(slots * slots);
+    m_multiHopRows = QBitArray(slots);
+    m_cityVectors.resize(slots * 3);
+    for (int slot = 0; slot < slots; slot++) {
+      const ServerCity* city = scm->citySlot(slot);
+      double latitude = qDegreesToRadians(city->latitude());
+      double longitude = qDegreesToRadians(city->longitude());
+      m_cityVectors[slot * 3] = qCos(latitude) * qCos(longitude);
+      m_cityVectors[slot * 3 + 1] = qCos(latitude) * qSin(longitude);
+      m_cityVectors[slot * 3 + 2] = qSin(latitude);
+    }
   }
 
-  if (score > ServerLatency::Excellent) {
-    score = ServerLatency::Excellent;
+  qint8* row = m_multiHopScores.data() + entrySlot * slots;
+  if (m_multiHopRows.testBit(entrySlot)) {
+    return row;
   }
-  return score;
+
+  const ServerCity* entryCity = scm->citySlot(entrySlot);
+  const double* entry = m_cityVectors.constData() + entrySlot * 3;
+  for (int slot = 0; slot < slots; slot++) {
+    const ServerCity* exitCity = scm->citySlot(slot);
+    if (!exitCity->initialized()) {
+      row[slot] = ServerLatency::NoData;
+      continue;
+    }
+
+    int score = baseCityScore(exitCity, entryCity->country());
+    if (score > ServerLatency::Unavailable) {
+      // Increase the score if the distance between servers is less than
+      // 1/8th of the earth's circumference, that is if the angle between
+      // them has a cosine greater than cos(pi/4). Unknown positions count as
+      // close, as they did with Location::distance().
+      const double* exit = m_cityVectors.constData() + slot * 3;
+      double cosine =
+          entry[0] * exit[0] + entry[1] * exit[1] + entry[2] * exit[2];
+      if (!(cosine <= M_SQRT1_2)) {
+        score++;
+      }
+      score = std::min(score, static_cast<int>(ServerLatency::Excellent));
+    }
+    row[slot] = static_cast<qint8>(score);
+  }
+
+  m_multiHopRows.setBit(entrySlot);
+  return row;
+}
+
+void ServerLatency::invalidateMultiHopScores() const {
+  m_multiHopRows.fill(false);
+}
+
+void ServerLatency::readSettings() {
+  QByteArray data = SettingsHolder::instance()->serverLatencyCache();
+  if (data.isEmpty()) {
+    return;
+  }
+
+  QDataStream stream(data);
+  quint8 version = 0;
+  stream >> version;
+  if (version != SERVER_LATENCY_CACHE_VERSION) {
+    logger.debug() << "Ignoring latency cache version" << version;
+    return;
+  }
+
+  QByteArray networkIdentity;
+  qint64 savedAt = 0;
+  quint32 count = 0;
+  stream >> networkIdentity >> savedAt >> count;
+
+  qint64 now = QDateTime::currentSecsSinceEpoch();
+  qint64 maxAge =
+      std::chrono::duration_cast<std::chrono::seconds>(
+          SERVER_LATENCY_CACHE_MAX_AGE)
+          .count();
+  for (quint32 i = 0; i < count; i++) {
+    QByteArray pubkey;
+    PingStatistics stats;
+    qint64 updated = 0;
+    qint64 cooldown = 0;
+    stream >> pubkey >> stats >> updated >> cooldown;
+    if (stream.status() != QDataStream::Ok) {
+      logger.warning() << "Truncated latency cache";
+      break;
+    }
+
+    bool hasCooldown = cooldown > now;
+    bool hasLatency = (stats.latency() > 0) && ((now - updated) < maxAge);
+    if (!hasCooldown && !hasLatency) {
+      continue;
+    }
+
+    int id = serverId(QString::fromUtf8(pubkey));
+    if (hasCooldown) {
+      m_cooldown[id] = cooldown;
+    }
+    if (hasLatency) {
+      m_statistics[id] = stats;
+      m_latencyUpdated[id] = updated;
+      m_sumLatencyMsec += stats.latency();
+      m_numLatencyServers++;
+    }
+  }
+
+  m_networkIdentity = networkIdentity;
+  if (m_numLatencyServers > 0) {
+    m_lastUpdateTime = QDateTime::fromSecsSinceEpoch(savedAt);
+  }
+  logger.debug() << "Restored latency for" << m_numLatencyServers << "servers";
+}
+
+void ServerLatency::scheduleSettingsWrite() {
+  // The whole cache is written at once, so a burst of cooldowns is saved
+  // together rather than once per server.
+  if (!m_settingsTimer.isActive()) {
+    m_settingsTimer.start(SERVER_LATENCY_SETTINGS_DELAY);
+  }
+}
+
+void ServerLatency::writeSettings() {
+  m_settingsTimer.stop();
+
+  QList<int> ids;
+  for (qsizetype id = 0; id < m_statistics.count(); id++) {
+    if ((m_statistics.at(id).probes() > 0) || (m_cooldown.at(id) != 0)) {
+      ids.append(static_cast<int>(id));
+    }
+  }
+
+  ServerCountryModel* scm = MozillaVPN::instance()->serverCountryModel();
+  QByteArray data;
+  QDataStream stream(&data, QIODevice::WriteOnly);
+  stream << SERVER_LATENCY_CACHE_VERSION << m_networkIdentity
+         << QDateTime::currentSecsSinceEpoch()
+         << static_cast<quint32>(ids.count());
+  for (int id : ids) {
+    stream << scm->publicKey(id).toUtf8() << m_statistics.at(id)
+           << m_latencyUpdated.at(id) << m_cooldown.at(id);
+  }
+
+  SettingsHolder::instance()->setServerLatencyCache(data);
+}
+
+// static
+QByteArray ServerLatency::networkIdentity() {
+  const Location* location = MozillaVPN::instance()->location();
+  if (!location->initialized()) {
+    return QByteArray();
+  }
+
+  // Identify the network by country and the prefix of our public address.
+  // Only a hash is kept, we don't need to store the address itself.
+  QHostAddress address = location->ipAddress();
+  QString prefix;
+  if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+    prefix = QHostAddress(address.toIPv4Address() & 0xffffff00).toString();
+  } else {
+    Q_IPV6ADDR ipv6 = address.toIPv6Address();
+    for (int i = 6; i < 16; i++) {
+      ipv6[i] = 0;
+    }
+    prefix = QHostAddress(ipv6).toString();
+  }
+
+  QCryptographicHash hash(QCryptographicHash::Sha256);
+  hash.addData(location->countryCode().toUtf8());
+  hash.addData(prefix.toUtf8());
+  return hash.result().left(8);
 }
@@ -5,11 +5,17 @@
 #ifndef SERVERLATENCY_H
 #define SERVERLATENCY_H
 
+#include <QBitArray>
+#include <QByteArray>
 #include <QDateTime>
 #include <QObject>
 #include <QTimer>
 
+#include "models/distancequeue.h"
+#include "pingscheduler.h"
 #include "pingsender.h"
+#include "pingstatistics.h"
+#include "pingtracker.h"
 #include "task.h"
 
 class ServerCity;
@@ -55,12 +61,19 @@ class ServerLatency final : public QObject {
 
   qint64 avgLatency() const;
   qint64 getLatency(const QString& pubkey) const {
-    return m_latency.value(pubkey);
+    return getStatistics(pubkey).latency();
   };
+  PingStatistics getStatistics(const QString& pubkey) const;
+  // Record a latency measurement, or a probe that was never answered.
   void setLatency(const QString& pubkey, qint64 msec);
-
-  qint64 getCooldown(const QString& pubkey) const {
-    return m_cooldown.value(pubkey);
+  void setTimeout(const QString& pubkey);
+
+  qint64 getCooldown(const QString& pubkey) const;
+  // The same, by the ID the ServerCountryModel assigned to the server.
+  qint64 getCooldown(int serverId) const {
+    return ((serverId >= 0) && (serverId < m_cooldown.count()))
+               ? m_cooldown.at(serverId)
+               : 0;
   }
   void setCooldown(const QString& pubkey, qint64 timeout);
   void setCityCooldown(const QString& countryCode, const QString& cityCode,
@@ -83,44 +96,97 @@ class ServerLatency final : public QObject {
   void progressChanged();
 
  private:
-  void updateConnectionScore(const QString& pubkey);
+  void scheduleScoreUpdate();
+  void updateCityScore(ServerCity& city);
+  void updateAllConnectionScores();
   void clearCooldowns();
   void maybeSendPings();
   void clear();
+  void addSample(int serverId, qint64 usec);
+  void addLoss(int serverId);
+  bool needsProbe(int serverId, qint64 staleBefore) const;
+  // Discard the measurements of any server whose bit is not set.
+  void removeStatistics(const QBitArray& keep);
+
+  // Translate a public key to a server ID. The first variant assigns one to
+  // servers the model doesn't know about yet, the second returns -1.
+  int serverId(const QString& pubkey);
+  int findServerId(const QString& pubkey) const;
+  void resizeServerData();
+  QList<int> cityServerIds(const ServerCity& city) const;
+
+  const qint8* multiHopScores(int entrySlot) const;
+  void invalidateMultiHopScores() const;
+
+  void readSettings();
+  void scheduleSettingsWrite();
+  void writeSettings();
+  static QByteArray networkIdentity();
 
  private:
   struct ServerPingRecord {
-    QString publicKey;
-    QString countryCode;
-    QString cityName;
-    quint64 timestamp;
-    quint16 sequence;
-    double distance;
+    int serverId;
+    // Monotonic send time in microseconds, see PingSender::monotonicTime().
+    qint64 timestamp;
     int retries;
   };
-  quint16 m_sequence = 0;
   PingSender* m_pingSender = nullptr;
-  QList<ServerPingRecord> m_pingSendQueue;
-  QList<ServerPingRecord> m_pingReplyList;
+  DistanceQueue<ServerPingRecord> m_pingSendQueue;
+  PingTracker<ServerPingRecord> m_pingReplies;
   qsizetype m_pingSendTotal = 0;
-
-  QHash<QString, qint64> m_latency;
-  QHash<QString, qint64> m_cooldown;
+  PingScheduler m_scheduler;
+
+  // The measurements and cooldown of each server, in parallel arrays indexed
+  // by the IDs that ServerCountryModel assigns. Public keys are only used at
+  // the API boundary and in the cache, so scoring and sweeps are linear scans.
+  QList<PingStatistics> m_statistics;
+  QList<qint64> m_latencyUpdated;
+  QList<qint64> m_cooldown;
+
+  // Totals of the statistics for the servers in a city.
+  struct CityStatistics {
+    qint64 sumLatencyMsec = 0;
+    qint64 sumJitterMsec = 0;
+    int numLatencySamples = 0;
+    double sumPacketLoss = 0.0;
+    int numLossSamples = 0;
+  };
+  CityStatistics cityStatistics(const ServerCity& city) const;
+  bool m_scoresDirty = false;
+
+  // The multi-hop score of every exit city through each entry city, as
+  // a matrix indexed by the storage slots of the cities in the
+  // ServerCountryModel, one row per entry city. The rows are filled when
+  // they are first needed, and cleared when a cooldown or the server list
+  // changes. The positions of the cities are kept as unit vectors, three
+  // coordinates per slot.
+  mutable QList<qint8> m_multiHopScores;
+  mutable QBitArray m_multiHopRows;
+  mutable QList<double> m_cityVectors;
+  QByteArray m_networkIdentity;
   qint64 m_sumLatencyMsec = 0;
+  qsizetype m_numLatencyServers = 0;
   QDateTime m_lastUpdateTime;
 
   QTimer m_pingTimeout;
   QTimer m_refreshTimer;
   QTimer m_progressDelayTimer;
   QTimer m_cooldownTimer;
+  QTimer m_settingsTimer;
   bool m_wantRefresh = false;
   bool m_hasIPv4Connectivity = true;
 
  private slots:
+  void serverListChanged();
+  void locationChanged();
   void stateChanged();
   void applicationStateChanged();
-  void recvPing(quint16 sequence);
+  void recvPing(quint16 sequence, qint64 timestamp);
   void criticalPingError();
+
+#ifdef UNIT_TEST
+  friend class TestServerLatency;
+#endif
 };
 
 #endif  // SERVERLATENCY_H
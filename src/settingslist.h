@@ -335,6 +335,29 @@ SETTING_INT(lastObfuscationPolicy,                      // getter
             false  // sensitive (do not log)
 )
 
+// The obfuscation policy that worked on each network, when the configured one
+// didn't. See Controller::rememberTransport().
+SETTING_STRINGLIST(networkTransports,        // getter
+                   setNetworkTransports,     // setter
+                   removeNetworkTransports,  // remover
+                   hasNetworkTransports,     // has
+                   "networkTransports",      // key
+                   QStringList(),            // default value
+                   true,                     // remove when reset
+                   true                      // sensitive (do not log)
+)
+
+// The key of the hash that identifies the networks in networkTransports.
+SETTING_BYTEARRAY(networkTransportsSecret,        // getter
+                  setNetworkTransportsSecret,     // setter
+                  removeNetworkTransportsSecret,  // remover
+                  hasNetworkTransportsSecret,     // has
+                  "networkTransportsSecret",      // key
+                  "",                             // default value
+                  true,                           // remove when reset
+                  true                            // sensitive (do not log)
+)
+
 SETTING_BOOL(onboardingCompleted,        // getter
              setOnboardingCompleted,     // setter
              removeOnboardingCompleted,  // remover
@@ -445,6 +468,26 @@ SETTING_BYTEARRAY(servers,        // getter
                   true  // sensitive (do not log) - noisy and limited value
 )
 
+SETTING_BYTEARRAY(serversETag,        // getter
+                  setServersETag,     // setter
+                  removeServersETag,  // remover
+                  hasServersETag,     // has
+                  "serversETag",      // key
+                  "",                 // default value
+                  true,               // remove when reset
+                  false               // sensitive (do not log)
+)
+
+SETTING_BYTEARRAY(serversLastModified,        // getter
+                  setServersLastModified,     // setter
+                  removeServersLastModified,  // remover
+                  hasServersLastModified,     // has
+                  "serversLastModified",      // key
+                  "",                         // default value
+                  true,                       // remove when reset
+                  false                       // sensitive (do not log)
+)
+
 SETTING_BYTEARRAY(serverData,        // getter
                   setServerData,     // setter
                   removeServerData,  // remover
@@ -455,6 +498,16 @@ SETTING_BYTEARRAY(serverData,        // getter
                   true               // sensitive (do not log)
 )
 
+SETTING_BYTEARRAY(serverLatencyCache,        // getter
+                  setServerLatencyCache,     // setter
+                  removeServerLatencyCache,  // remover
+                  hasServerLatencyCache,     // has
+                  "serverLatencyCache",      // key
+                  "",                        // default value
+                  true,                      // remove when reset
+                  true  // sensitive (do not log) - noisy and limited value
+)
+
 SETTING_BOOL(serverSwitchNotification,        // getter
              setServerSwitchNotification,     // setter
              removeServerSwitchNotification,  // remover
@@ -8,8 +8,10 @@
 #include "errorhandler.h"
 #include "leakdetector.h"
 #include "logger.h"
+#include "models/servercountrymodel.h"
 #include "mozillavpn.h"
 #include "networkrequest.h"
+#include "settingsholder.h"
 
 namespace {
 Logger logger("TaskServers");
@@ -26,6 +28,16 @@ TaskServers::~TaskServers() { MZ_COUNT_DTOR(TaskServers); }
 void TaskServers::run() {
   NetworkRequest* request = new NetworkRequest(this, 200);
   request->auth();
+
+  // The server list rarely changes. If we already have one, only download it
+  // again if it changed since.
+  SettingsHolder* settingsHolder = SettingsHolder::instance();
+  if (MozillaVPN::instance()->serverCountryModel()->initialized()) {
+    request->setCacheValidators(settingsHolder->serversETag(),
+                                settingsHolder->serversLastModified());
+    request->addExpectedStatus(304);
+  }
+
   request->get(Constants::apiUrl(Constants::Servers));
 
   connect(request, &NetworkRequest::requestFailed, this,
@@ -36,9 +48,20 @@ void TaskServers::run() {
           });
 
   connect(request, &NetworkRequest::requestCompleted, this,
-          [this](const QByteArray& data) {
+          [this, request](const QByteArray& data) {
+            if (request->statusCode() == 304) {
+              logger.debug() << "Servers not modified";
+              emit completed();
+              return;
+            }
+
             logger.debug() << "Servers obtained";
-            MozillaVPN::instance()->serversFetched(data);
+            if (MozillaVPN::instance()->serversFetched(data)) {
+              SettingsHolder* settingsHolder = SettingsHolder::instance();
+              settingsHolder->setServersETag(request->rawHeader("ETag"));
+              settingsHolder->setServersLastModified(
+                  request->rawHeader("Last-Modified"));
+            }
             emit completed();
           });
 }
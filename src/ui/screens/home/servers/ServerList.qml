@@ -354,18 +354,6 @@ FocusScope {
                     id: searchBar
                     objectName: "countrySearchBar"
 
-                    _filterProxySource: VPNServerCountryModel
-                    _filterProxyCallback: country => {
-                                              const searchString = getSearchBarText();
-                                              const includesSearchString = nameString => (
-                                                  nameString.toLowerCase().includes(searchString)
-                                                  );
-                                              const includesName = includesSearchString(country.name);
-                                              const includesLocalizedName = includesSearchString(country.localizedName);
-                                              const matchesCountryCode = country.code.toLowerCase() === searchString;
-
-                                              return includesName || includesLocalizedName || matchesCountryCode;
-                                          }
                     _searchBarHasError: countriesRepeater.count === 0
                     _searchBarPlaceholderText: MZI18n.ServersViewSearchPlaceholder
 
@@ -391,9 +379,15 @@ FocusScope {
                     visible: showRecentConnections && searchBar.getSearchBarText().length === 0
                 }
 
+                VPNServerSearchModel {
+                    id: serverSearchModel
+                    sourceModel: VPNServerCountryModel
+                    query: searchBar.getSearchBarText()
+                }
+
                 Repeater {
                     id: countriesRepeater
-                    model: searchBar.getProxyModel()
+                    model: serverSearchModel
                     delegate: ServerCountry {}
                 }
             }
@@ -0,0 +1,18 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VPNSERVERSEARCHMODEL_H
+#define VPNSERVERSEARCHMODEL_H
+
+#include <QQmlEngine>
+
+#include "models/serversearchmodel.h"
+
+struct VPNServerSearchModel {
+  Q_GADGET
+  QML_FOREIGN(ServerSearchModel)
+  QML_ELEMENT
+};
+
+#endif  // VPNSERVERSEARCHMODEL_H
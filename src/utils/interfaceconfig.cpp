@@ -54,9 +54,68 @@ QJsonObject InterfaceConfig::toJson() const {
 
   json.insert("lwoVersion", QJsonValue((double)m_lwoVersion));
 
+  if (!m_candidates.isEmpty()) {
+    QJsonArray candidates;
+    for (const Candidate& candidate : m_candidates) {
+      candidates.append(candidate.toJson());
+    }
+    json.insert("candidates", candidates);
+  }
+
   return json;
 }
 
+QJsonObject InterfaceConfig::Candidate::toJson() const {
+  QJsonObject json;
+  QMetaEnum obfuscationMetaEnum =
+      QMetaEnum::fromType<Server::ObfuscationMethod>();
+
+  json.insert("serverPublicKey", QJsonValue(m_serverPublicKey));
+  json.insert("serverIpv4AddrIn", QJsonValue(m_serverIpv4AddrIn));
+  json.insert("serverIpv6AddrIn", QJsonValue(m_serverIpv6AddrIn));
+  json.insert("serverPort", QJsonValue((double)m_serverPort));
+  json.insert("obfuscationMethod",
+              QJsonValue(obfuscationMetaEnum.valueToKey(m_obfuscationMethod)));
+  json.insert("lwoVersion", QJsonValue((double)m_lwoVersion));
+  return json;
+}
+
+bool InterfaceConfig::Candidate::fromJson(const QJsonObject& obj) {
+  m_serverPublicKey = obj.value("serverPublicKey").toString();
+  m_serverIpv4AddrIn = obj.value("serverIpv4AddrIn").toString();
+  m_serverIpv6AddrIn = obj.value("serverIpv6AddrIn").toString();
+  m_serverPort = obj.value("serverPort").toInt();
+  m_lwoVersion = obj.value("lwoVersion").toInt(1);
+
+  m_obfuscationMethod = Server::ObfuscationMethod::NoObfuscation;
+  if (obj.contains("obfuscationMethod")) {
+    QByteArray method = obj.value("obfuscationMethod").toString().toUtf8();
+    QMetaEnum meta = QMetaEnum::fromType<Server::ObfuscationMethod>();
+    bool okay = false;
+    int value = meta.keyToValue(method.constData(), &okay);
+    if (!okay) {
+      return false;
+    }
+    m_obfuscationMethod = Server::ObfuscationMethod(value);
+  }
+
+  return !m_serverPublicKey.isEmpty() &&
+         !(m_serverIpv4AddrIn.isEmpty() && m_serverIpv6AddrIn.isEmpty()) &&
+         (m_serverPort > 0) && (m_lwoVersion >= 1) && (m_lwoVersion <= 2);
+}
+
+bool InterfaceConfig::hasPeer(const QString& serverPublicKey) const {
+  if (m_serverPublicKey == serverPublicKey) {
+    return true;
+  }
+  for (const Candidate& candidate : m_candidates) {
+    if (candidate.m_serverPublicKey == serverPublicKey) {
+      return true;
+    }
+  }
+  return false;
+}
+
 QString InterfaceConfig::toWgConf(const QMap<QString, QString>& extra,
                                   const QString peerComment) const {
 #define VALIDATE(x) \
@@ -46,6 +46,26 @@ class InterfaceConfig {
   Server::ObfuscationMethod m_obfuscationMethod;
   int m_lwoVersion = 1;
 
+  // Other servers of the same city to race against the one above, possibly
+  // through other transports. The daemon configures all of them, keeps the
+  // first to complete a handshake, and drops the others.
+  struct Candidate {
+    QString m_serverPublicKey;
+    QString m_serverIpv4AddrIn;
+    QString m_serverIpv6AddrIn;
+    int m_serverPort = 0;
+    Server::ObfuscationMethod m_obfuscationMethod =
+        Server::ObfuscationMethod::NoObfuscation;
+    int m_lwoVersion = 1;
+
+    QJsonObject toJson() const;
+    // Returns false if the object does not describe a usable server.
+    bool fromJson(const QJsonObject& obj);
+  };
+  QList<Candidate> m_candidates;
+
+  bool hasPeer(const QString& serverPublicKey) const;
+
   QJsonObject toJson() const;
   QString toWgConf(
       const QMap<QString, QString>& extra = QMap<QString, QString>(),
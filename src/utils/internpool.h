@@ -0,0 +1,58 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef INTERNPOOL_H
+#define INTERNPOOL_H
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+
+// A table of values that are repeated across many objects, such as country
+// codes or port ranges. Each distinct value is stored once: interned copies
+// share its data, and objects can refer to it by a small index instead.
+//
+// Values are never removed, so only use this for values from a small set.
+// Index 0 is always the default constructed value.
+template <typename T>
+class InternPool final {
+ public:
+  InternPool() { indexOf(T()); }
+
+  // The index of |value| in the pool, which is added if needed.
+  quint32 indexOf(const T& value) {
+    QMutexLocker locker(&m_mutex);
+    auto it = m_indexes.constFind(value);
+    if (it != m_indexes.constEnd()) {
+      return it.value();
+    }
+
+    quint32 index = static_cast<quint32>(m_values.count());
+    m_values.append(value);
+    m_indexes.insert(m_values.last(), index);
+    return index;
+  }
+
+  T at(quint32 index) const {
+    QMutexLocker locker(&m_mutex);
+    Q_ASSERT(index < static_cast<quint32>(m_values.count()));
+    return m_values.at(index);
+  }
+
+  // A copy of |value| that shares its data with the pooled one.
+  T intern(const T& value) { return at(indexOf(value)); }
+
+  qsizetype count() const {
+    QMutexLocker locker(&m_mutex);
+    return m_values.count();
+  }
+
+ private:
+  mutable QMutex m_mutex;
+  QList<T> m_values;
+  QHash<T, quint32> m_indexes;
+};
+
+#endif  // INTERNPOOL_H
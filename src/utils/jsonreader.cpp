@@ -0,0 +1,364 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "jsonreader.h"
+
+#include <cstring>
+
+namespace {
+// Same limit as QJsonDocument.
+constexpr qsizetype MAX_DEPTH = 1024;
+
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+void appendUtf8(QByteArray& out, char32_t code) {
+  if (code < 0x80) {
+    out.append(static_cast<char>(code));
+  } else if (code < 0x800) {
+    out.append(static_cast<char>(0xc0 | (code >> 6)));
+    out.append(static_cast<char>(0x80 | (code & 0x3f)));
+  } else if (code < 0x10000) {
+    out.append(static_cast<char>(0xe0 | (code >> 12)));
+    out.append(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+    out.append(static_cast<char>(0x80 | (code & 0x3f)));
+  } else {
+    out.append(static_cast<char>(0xf0 | (code >> 18)));
+    out.append(static_cast<char>(0x80 | ((code >> 12) & 0x3f)));
+    out.append(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+    out.append(static_cast<char>(0x80 | (code & 0x3f)));
+  }
+}
+}  // namespace
+
+JsonReader::JsonReader(const QByteArray& data)
+    : m_pos(data.constData()), m_end(data.constData() + data.size()) {}
+
+JsonReader::TokenType JsonReader::readNext() {
+  if (m_type == Invalid || m_type == EndDocument) {
+    return m_type;
+  }
+
+  skipWhitespace();
+
+  if (m_done) {
+    if (m_pos != m_end) {
+      return setError();
+    }
+    m_type = EndDocument;
+    return m_type;
+  }
+
+  if (m_pos == m_end) {
+    return setError();
+  }
+
+  if (m_stack.isEmpty() || m_needValue) {
+    m_needValue = false;
+    return readValue();
+  }
+
+  const char close = m_stack.last() == '{' ? '}' : ']';
+  if (*m_pos == close) {
+    ++m_pos;
+    m_stack.removeLast();
+    return endValue(close == '}' ? EndObject : EndArray);
+  }
+
+  if (m_needComma) {
+    if (*m_pos != ',') {
+      return setError();
+    }
+    ++m_pos;
+    m_needComma = false;
+    skipWhitespace();
+    if (m_pos == m_end) {
+      return setError();
+    }
+  }
+
+  if (close == ']') {
+    return readValue();
+  }
+
+  if (*m_pos != '"' || readString(Key) == Invalid) {
+    return setError();
+  }
+
+  skipWhitespace();
+  if (m_pos == m_end || *m_pos != ':') {
+    return setError();
+  }
+  ++m_pos;
+  m_needValue = true;
+  return m_type;
+}
+
+bool JsonReader::readNextMember() {
+  if (readNext() != Key) {
+    if (m_type != EndObject) {
+      setError();
+    }
+    return false;
+  }
+
+  m_key = m_string;
+  return readNext() != Invalid;
+}
+
+bool JsonReader::readNextElement() {
+  switch (readNext()) {
+    case EndArray:
+      return false;
+    case Invalid:
+    case Key:
+    case EndObject:
+    case EndDocument:
+      setError();
+      return false;
+    default:
+      return true;
+  }
+}
+
+bool JsonReader::skipValue() {
+  if (m_type != BeginObject && m_type != BeginArray) {
+    return !hasError();
+  }
+
+  qsizetype depth = m_stack.count();
+  while (m_stack.count() >= depth) {
+    if (readNext() == Invalid) {
+      return false;
+    }
+  }
+  return true;
+}
+
+JsonReader::TokenType JsonReader::setError() {
+  m_type = Invalid;
+  m_string.clear();
+  return m_type;
+}
+
+JsonReader::TokenType JsonReader::readValue() {
+  switch (*m_pos) {
+    case '{':
+    case '[':
+      if (m_stack.count() >= MAX_DEPTH) {
+        return setError();
+      }
+      m_stack.append(*m_pos);
+      m_needComma = false;
+      m_type = *m_pos == '{' ? BeginObject : BeginArray;
+      ++m_pos;
+      return m_type;
+
+    case '"':
+      if (readString(String) == Invalid) {
+        return m_type;
+      }
+      return endValue(String);
+
+    case 't':
+      return readLiteral("true", Bool, true);
+
+    case 'f':
+      return readLiteral("false", Bool, false);
+
+    case 'n':
+      return readLiteral("null", Null, false);
+
+    default:
+      return readNumber();
+  }
+}
+
+JsonReader::TokenType JsonReader::readString(TokenType type) {
+  Q_ASSERT(*m_pos == '"');
+  const char* begin = ++m_pos;
+
+  // The common case: no escape sequences, so the string can be used in place.
+  while (m_pos != m_end && *m_pos != '"' && *m_pos != '\\') {
+    if (static_cast<unsigned char>(*m_pos) < 0x20) {
+      return setError();
+    }
+    ++m_pos;
+  }
+  if (m_pos == m_end) {
+    return setError();
+  }
+  if (*m_pos == '"') {
+    m_string = QByteArray::fromRawData(begin, m_pos - begin);
+    ++m_pos;
+    m_type = type;
+    return m_type;
+  }
+
+  m_buffer.clear();
+  m_buffer.append(begin, m_pos - begin);
+  while (m_pos != m_end && *m_pos != '"') {
+    char c = *m_pos++;
+    if (static_cast<unsigned char>(c) < 0x20) {
+      return setError();
+    }
+    if (c != '\\') {
+      m_buffer.append(c);
+      continue;
+    }
+    if (m_pos == m_end) {
+      return setError();
+    }
+
+    c = *m_pos++;
+    switch (c) {
+      case '"':
+      case '\\':
+      case '/':
+        m_buffer.append(c);
+        break;
+      case 'b':
+        m_buffer.append('\b');
+        break;
+      case 'f':
+        m_buffer.append('\f');
+        break;
+      case 'n':
+        m_buffer.append('\n');
+        break;
+      case 'r':
+        m_buffer.append('\r');
+        break;
+      case 't':
+        m_buffer.append('\t');
+        break;
+      case 'u': {
+        char32_t code = 0;
+        for (int pair = 0; pair < 2; ++pair) {
+          if (m_end - m_pos < 4) {
+            return setError();
+          }
+          char32_t unit = 0;
+          for (int i = 0; i < 4; ++i) {
+            int value = hexValue(*m_pos++);
+            if (value < 0) {
+              return setError();
+            }
+            unit = (unit << 4) | value;
+          }
+
+          if (pair == 1) {
+            if (unit < 0xdc00 || unit > 0xdfff) {
+              return setError();
+            }
+            code = 0x10000 + ((code - 0xd800) << 10) + (unit - 0xdc00);
+            break;
+          }
+
+          code = unit;
+          if (code < 0xd800 || code > 0xdbff) {
+            break;
+          }
+          // A high surrogate must be followed by an escaped low surrogate.
+          if (m_end - m_pos < 2 || m_pos[0] != '\\' || m_pos[1] != 'u') {
+            return setError();
+          }
+          m_pos += 2;
+        }
+        if (code >= 0xdc00 && code <= 0xdfff) {
+          return setError();
+        }
+        appendUtf8(m_buffer, code);
+        break;
+      }
+      default:
+        return setError();
+    }
+  }
+  if (m_pos == m_end) {
+    return setError();
+  }
+
+  ++m_pos;
+  m_string = m_buffer;
+  m_type = type;
+  return m_type;
+}
+
+JsonReader::TokenType JsonReader::readNumber() {
+  const char* begin = m_pos;
+
+  if (m_pos != m_end && *m_pos == '-') {
+    ++m_pos;
+  }
+  if (m_pos == m_end || !isDigit(*m_pos)) {
+    return setError();
+  }
+  if (*m_pos == '0') {
+    ++m_pos;
+  } else {
+    while (m_pos != m_end && isDigit(*m_pos)) ++m_pos;
+  }
+
+  if (m_pos != m_end && *m_pos == '.') {
+    ++m_pos;
+    if (m_pos == m_end || !isDigit(*m_pos)) {
+      return setError();
+    }
+    while (m_pos != m_end && isDigit(*m_pos)) ++m_pos;
+  }
+
+  if (m_pos != m_end && (*m_pos == 'e' || *m_pos == 'E')) {
+    ++m_pos;
+    if (m_pos != m_end && (*m_pos == '+' || *m_pos == '-')) {
+      ++m_pos;
+    }
+    if (m_pos == m_end || !isDigit(*m_pos)) {
+      return setError();
+    }
+    while (m_pos != m_end && isDigit(*m_pos)) ++m_pos;
+  }
+
+  bool ok = false;
+  m_number = QByteArray::fromRawData(begin, m_pos - begin).toDouble(&ok);
+  if (!ok) {
+    return setError();
+  }
+  return endValue(Number);
+}
+
+JsonReader::TokenType JsonReader::readLiteral(const char* literal,
+                                              TokenType type, bool value) {
+  size_t length = strlen(literal);
+  if (static_cast<size_t>(m_end - m_pos) < length ||
+      memcmp(m_pos, literal, length) != 0) {
+    return setError();
+  }
+  m_pos += length;
+  m_boolean = value;
+  return endValue(type);
+}
+
+JsonReader::TokenType JsonReader::endValue(TokenType type) {
+  if (m_stack.isEmpty()) {
+    m_done = true;
+  } else {
+    m_needComma = true;
+  }
+  m_type = type;
+  return m_type;
+}
+
+void JsonReader::skipWhitespace() {
+  while (m_pos != m_end && (*m_pos == ' ' || *m_pos == '\t' ||
+                            *m_pos == '\n' || *m_pos == '\r')) {
+    ++m_pos;
+  }
+}
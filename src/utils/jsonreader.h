@@ -0,0 +1,98 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef JSONREADER_H
+#define JSONREADER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVarLengthArray>
+
+// A streaming reader for JSON documents, in the spirit of QXmlStreamReader.
+//
+// Unlike QJsonDocument, no tree of values is built: the document is read one
+// token at a time, and it is up to the caller to keep what it needs. This
+// keeps the memory needed to parse a large document down to the size of the
+// document itself.
+//
+// Strings without escape sequences are not copied, so the data passed to the
+// reader must outlive it, and the result of utf8() is only valid until the
+// next token is read.
+class JsonReader final {
+ public:
+  enum TokenType {
+    NoToken,
+    Invalid,
+    BeginObject,
+    EndObject,
+    BeginArray,
+    EndArray,
+    Key,
+    String,
+    Number,
+    Bool,
+    Null,
+    EndDocument,
+  };
+
+  explicit JsonReader(const QByteArray& data);
+
+  TokenType readNext();
+  TokenType tokenType() const { return m_type; }
+  bool hasError() const { return m_type == Invalid; }
+
+  bool isObject() const { return m_type == BeginObject; }
+  bool isArray() const { return m_type == BeginArray; }
+  bool isString() const { return m_type == String; }
+  bool isNumber() const { return m_type == Number; }
+  bool isBool() const { return m_type == Bool; }
+
+  // The value of the current token, if it is of the right type.
+  QByteArray utf8() const { return m_string; }
+  QString string() const { return QString::fromUtf8(m_string); }
+  double number() const { return m_number; }
+  bool boolean() const { return m_boolean; }
+
+  // Advance to the value of the next member of the current object, whose
+  // name is then available from key(). Returns false at the end of the
+  // object, or if the document is invalid.
+  bool readNextMember();
+  const QByteArray& key() const { return m_key; }
+
+  // Advance to the next element of the current array. Returns false at the
+  // end of the array, or if the document is invalid.
+  bool readNextElement();
+
+  // Skip over the current value, including the contents of an object or an
+  // array. Returns false if the document is invalid.
+  bool skipValue();
+
+ private:
+  TokenType setError();
+  TokenType readValue();
+  TokenType readString(TokenType type);
+  TokenType readNumber();
+  TokenType readLiteral(const char* literal, TokenType type, bool value);
+  TokenType endValue(TokenType type);
+  void skipWhitespace();
+
+ private:
+  const char* m_pos;
+  const char* const m_end;
+
+  TokenType m_type = NoToken;
+  QByteArray m_string;
+  QByteArray m_key;
+  QByteArray m_buffer;
+  double m_number = 0;
+  bool m_boolean = false;
+
+  // The containers we are in, and where we are in the innermost one.
+  QVarLengthArray<char, 16> m_stack;
+  bool m_needComma = false;
+  bool m_needValue = false;
+  bool m_done = false;
+};
+
+#endif  // JSONREADER_H
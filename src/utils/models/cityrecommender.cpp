@@ -0,0 +1,160 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "cityrecommender.h"
+
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+
+#include "models/servercity.h"
+
+namespace {
+bool sameCoordinate(double a, double b) {
+  return (a == b) || (qIsNaN(a) && qIsNaN(b));
+}
+
+bool located(double latitude, double longitude) {
+  return !qIsNaN(latitude) && !qIsNaN(longitude);
+}
+}  // namespace
+
+QList<ServerCity*> CityRecommender::recommend(const QList<ServerCity*>& cities,
+                                              double latitude,
+                                              double longitude,
+                                              double latencyScale,
+                                              qsizetype count) {
+  bool changed = updateInputs(cities);
+  if (!sameCoordinate(m_latitude, latitude) ||
+      !sameCoordinate(m_longitude, longitude) ||
+      (m_latencyScale != latencyScale)) {
+    m_latitude = latitude;
+    m_longitude = longitude;
+    m_latencyScale = latencyScale;
+    changed = true;
+  }
+
+  if (m_valid && !changed && (count <= m_count)) {
+    return m_result.mid(0, count);
+  }
+
+  // Without a location, the distance doesn't count at all.
+  double ox = 0;
+  double oy = 0;
+  double oz = 0;
+  if (located(latitude, longitude)) {
+    double phi = qDegreesToRadians(latitude);
+    double lambda = qDegreesToRadians(longitude);
+    ox = qCos(phi) * qCos(lambda);
+    oy = qCos(phi) * qSin(lambda);
+    oz = qSin(phi);
+  }
+  double weight = located(latitude, longitude) ? 1.0 : 0.0;
+
+  qsizetype size = m_cities.count();
+  m_ranks.resize(size);
+  const double* x = m_x.constData();
+  const double* y = m_y.constData();
+  const double* z = m_z.constData();
+  const double* known = m_located.constData();
+  const qint64* latencies = m_latencies.constData();
+  const int* scores = m_scores.constData();
+  double* ranks = m_ranks.data();
+  for (qsizetype i = 0; i < size; i++) {
+    double dot = std::clamp(ox * x[i] + oy * y[i] + oz * z[i], -1.0, 1.0);
+    double distance = std::acos(dot) * known[i] * weight;
+    ranks[i] = rank(scores[i], latencies[i], latencyScale, distance);
+  }
+
+  select(count);
+  m_count = count;
+  m_valid = true;
+  return m_result;
+}
+
+// Copies the inputs of the ranking, and returns whether any of them changed.
+bool CityRecommender::updateInputs(const QList<ServerCity*>& cities) {
+  qsizetype size = cities.count();
+  bool changed = m_cities.count() != size;
+  if (changed) {
+    m_cities.resize(size);
+    m_latitudes.resize(size);
+    m_longitudes.resize(size);
+    m_x.resize(size);
+    m_y.resize(size);
+    m_z.resize(size);
+    m_located.resize(size);
+    m_latencies.resize(size);
+    m_scores.resize(size);
+  }
+
+  for (qsizetype i = 0; i < size; i++) {
+    ServerCity* city = cities.at(i);
+    double latitude = city->latitude();
+    double longitude = city->longitude();
+    if ((m_cities.at(i) != city) ||
+        !sameCoordinate(m_latitudes.at(i), latitude) ||
+        !sameCoordinate(m_longitudes.at(i), longitude)) {
+      m_cities[i] = city;
+      m_latitudes[i] = latitude;
+      m_longitudes[i] = longitude;
+      if (located(latitude, longitude)) {
+        double phi = qDegreesToRadians(latitude);
+        double lambda = qDegreesToRadians(longitude);
+        m_x[i] = qCos(phi) * qCos(lambda);
+        m_y[i] = qCos(phi) * qSin(lambda);
+        m_z[i] = qSin(phi);
+        m_located[i] = 1.0;
+      } else {
+        m_x[i] = 0;
+        m_y[i] = 0;
+        m_z[i] = 0;
+        m_located[i] = 0;
+      }
+      changed = true;
+    }
+
+    if (m_latencies.at(i) != city->latency()) {
+      m_latencies[i] = city->latency();
+      changed = true;
+    }
+    if (m_scores.at(i) != city->connectionScore()) {
+      m_scores[i] = city->connectionScore();
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+void CityRecommender::select(qsizetype count) {
+  // Cities that rank the same are taken in the order of the list.
+  auto better = [this](int a, int b) {
+    if (m_ranks.at(a) != m_ranks.at(b)) {
+      return m_ranks.at(a) > m_ranks.at(b);
+    }
+    return a < b;
+  };
+
+  // The root of the heap is the worst of the best cities found so far.
+  QList<int> heap;
+  heap.reserve(count);
+  for (int i = 0; i < m_ranks.count(); i++) {
+    if (heap.count() < count) {
+      heap.append(i);
+      std::push_heap(heap.begin(), heap.end(), better);
+    } else if (!heap.isEmpty() && better(i, heap.first())) {
+      std::pop_heap(heap.begin(), heap.end(), better);
+      heap.last() = i;
+      std::push_heap(heap.begin(), heap.end(), better);
+    }
+  }
+  std::sort_heap(heap.begin(), heap.end(), better);
+
+  m_result.clear();
+  m_result.reserve(heap.count());
+  for (int i : heap) {
+    m_result.append(m_cities.at(i));
+  }
+}
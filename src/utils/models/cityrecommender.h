@@ -0,0 +1,67 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef CITYRECOMMENDER_H
+#define CITYRECOMMENDER_H
+
+#include <QList>
+
+class ServerCity;
+
+// Ranks the cities by connection score, breaking ties with their latency and
+// their distance from the user, and returns the best ones.
+//
+// The position of each city is kept as a unit vector on the sphere, so the
+// great circle distance is the arc cosine of a dot product rather than a
+// handful of trigonometric functions. The inputs of the ranking are copied
+// into flat arrays that are scored in a single loop, and the best cities are
+// selected with a bounded heap.
+//
+// The result is kept until the inputs change: the list of cities, their
+// position, latency or score, the user location, or the latency scale.
+class CityRecommender final {
+ public:
+  // The cities must stay valid until the next call. The location is in
+  // degrees, and NaN if it's not known.
+  QList<ServerCity*> recommend(const QList<ServerCity*>& cities,
+                               double latitude, double longitude,
+                               double latencyScale, qsizetype count);
+
+  // The ranking of a city, as computed by recommend(). The distance is in
+  // radians.
+  static double rank(int score, qint64 latency, double latencyScale,
+                     double distance) {
+    return score * 256.0 - latency / latencyScale - distance;
+  }
+
+ private:
+  bool updateInputs(const QList<ServerCity*>& cities);
+  void select(qsizetype count);
+
+ private:
+  QList<ServerCity*> m_cities;
+
+  // Indexed like m_cities.
+  QList<double> m_latitudes;
+  QList<double> m_longitudes;
+  QList<double> m_x;
+  QList<double> m_y;
+  QList<double> m_z;
+  // 1 if the position of the city is known, 0 otherwise.
+  QList<double> m_located;
+  QList<qint64> m_latencies;
+  QList<int> m_scores;
+  QList<double> m_ranks;
+
+  double m_latitude = 0;
+  double m_longitude = 0;
+  double m_latencyScale = 0;
+
+  bool m_valid = false;
+  // How many cities were asked for when m_result was selected.
+  qsizetype m_count = 0;
+  QList<ServerCity*> m_result;
+};
+
+#endif  // CITYRECOMMENDER_H
@@ -0,0 +1,92 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef DISTANCEQUEUE_H
+#define DISTANCEQUEUE_H
+
+#include <QList>
+#include <algorithm>
+
+// A queue of values ordered by their distance, nearest first.
+//
+// Values are appended in any order, and the keys are kept in a flat array
+// apart from the values themselves. Rather than sorting everything up front,
+// only the next chunk of the queue is selected (with std::nth_element) and
+// sorted as it is consumed. The chunks grow as the queue is drained, so a
+// consumer that only takes the first few values doesn't pay for sorting the
+// rest, and draining the whole queue remains O(n log n).
+//
+// Values at an equal distance are taken in the order they were appended.
+template <typename T>
+class DistanceQueue final {
+ public:
+  void clear() {
+    m_keys.clear();
+    m_values.clear();
+    m_next = 0;
+    m_sorted = 0;
+    m_chunk = INITIAL_CHUNK;
+  }
+
+  void reserve(qsizetype size) {
+    m_keys.reserve(size);
+    m_values.reserve(size);
+  }
+
+  void append(const T& value, double distance) {
+    Q_ASSERT(m_next == 0);
+    m_keys.append({distance, static_cast<int>(m_values.count())});
+    m_values.append(value);
+  }
+
+  qsizetype count() const { return m_keys.count() - m_next; }
+  bool isEmpty() const { return count() == 0; }
+
+  // Remove and return the nearest value. The queue must not be empty.
+  T takeFirst() {
+    Q_ASSERT(!isEmpty());
+    if (m_next >= m_sorted) {
+      sortNextChunk();
+    }
+    T value = std::move(m_values[m_keys[m_next++].index]);
+    if (isEmpty()) {
+      clear();
+    }
+    return value;
+  }
+
+ private:
+  static constexpr qsizetype INITIAL_CHUNK = 64;
+
+  struct Key {
+    double distance;
+    int index;
+
+    bool operator<(const Key& other) const {
+      if (distance != other.distance) {
+        return distance < other.distance;
+      }
+      return index < other.index;
+    }
+  };
+
+  void sortNextChunk() {
+    auto first = m_keys.begin() + m_next;
+    auto last = first + std::min(m_chunk, count());
+    if (last != m_keys.end()) {
+      std::nth_element(first, last, m_keys.end());
+    }
+    std::sort(first, last);
+    m_sorted = last - m_keys.begin();
+    m_chunk *= 2;
+  }
+
+  QList<Key> m_keys;
+  QList<T> m_values;
+  qsizetype m_next = 0;
+  qsizetype m_sorted = 0;
+  qsizetype m_chunk = INITIAL_CHUNK;
+};
+
+#endif  // DISTANCEQUEUE_H
@@ -4,20 +4,65 @@
 
 #include "server.h"
 
+#include <QDataStream>
 #include <QDateTime>
+#include <QHostAddress>
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QJsonValue>
 #include <QRandomGenerator>
+#include <cstring>
+#include <limits>
 
+#include "internpool.h"
+#include "jsonreader.h"
 #include "leakdetector.h"
 
+namespace {
+
+using PortRanges = QList<QPair<uint32_t, uint32_t>>;
+
+InternPool<QString>& stringPool() {
+  static InternPool<QString> pool;
+  return pool;
+}
+
+InternPool<PortRanges>& portRangePool() {
+  static InternPool<PortRanges> pool;
+  return pool;
+}
+
+// Mullvad ports for UDP over TCP obfuscation, hardcoded as specified
+// Use QPair so we can reuse choosePort logic, maybe expose these ports in
+// guardian APIs in the future
+const PortRanges& udpOverTcpPorts() {
+  static const PortRanges ports{{80, 80}, {443, 443}, {5001, 5001}};
+  return ports;
+}
+
+// The same conversion as QJsonValue::toInt().
+int toInt(double value) {
+  if (value < std::numeric_limits<int>::min() ||
+      value > std::numeric_limits<int>::max()) {
+    return 0;
+  }
+  int result = static_cast<int>(value);
+  return result == value ? result : 0;
+}
+
+// The same conversion as QJsonValue::toString(), for optional properties.
+bool readOptionalString(JsonReader& reader, QString& value) {
+  value = reader.isString() ? reader.string() : QString();
+  return reader.skipValue();
+}
+
+}  // namespace
+
 Server::Server() { MZ_COUNT_CTOR(Server); }
 
 Server::Server(const QString& countryCode, const QString& cityName) {
   MZ_COUNT_CTOR(Server);
-  m_countryCode = countryCode;
-  m_cityName = cityName;
+  setLocation(countryCode, cityName);
 }
 
 Server::Server(const Server& other) {
@@ -33,6 +78,7 @@ Server& Server::operator=(const Server& other) {
   m_ipv4Gateway = other.m_ipv4Gateway;
   m_ipv6AddrIn = other.m_ipv6AddrIn;
   m_ipv6Gateway = other.m_ipv6Gateway;
+  m_addressTexts = other.m_addressTexts;
   m_portRanges = other.m_portRanges;
   m_publicKey = other.m_publicKey;
   m_weight = other.m_weight;
@@ -92,7 +138,7 @@ bool Server::fromJson(const QJsonObject& obj) {
   QJsonValue socks5_name = obj.value("socks5_name");
   QJsonValue multihop_port = obj.value("multihop_port");
 
-  QList<QPair<uint32_t, uint32_t>> prList;
+  PortRanges prList;
   QJsonArray portRangesArray = portRanges.toArray();
   for (const QJsonValue& portRangeValue : portRangesArray) {
     if (!portRangeValue.isArray()) {
@@ -132,11 +178,9 @@ bool Server::fromJson(const QJsonObject& obj) {
   }
 
   m_hostname = hostname.toString();
-  m_ipv4AddrIn = ipv4AddrIn.toString();
-  m_ipv4Gateway = ipv4Gateway.toString();
-  m_ipv6AddrIn = ipv6AddrIn.toString();
-  m_ipv6Gateway = ipv6Gateway.toString();
-  m_portRanges.swap(prList);
+  setAddresses(ipv4AddrIn.toString(), ipv4Gateway.toString(),
+               ipv6AddrIn.toString(), ipv6Gateway.toString());
+  setPortRanges(prList);
   m_publicKey = publicKey.toString();
   m_weight = weight.toInt();
   m_socksName = socks5_name.toString();
@@ -145,22 +189,254 @@ bool Server::fromJson(const QJsonObject& obj) {
   return true;
 }
 
+bool Server::fromJson(JsonReader& reader) {
+  // Reset.
+  m_hostname = "";
+
+  if (!reader.isObject()) {
+    return false;
+  }
+
+  enum {
+    Hostname = 1 << 0,
+    Ipv4AddrIn = 1 << 1,
+    Ipv4Gateway = 1 << 2,
+    PublicKey = 1 << 3,
+    Weight = 1 << 4,
+    PortRanges = 1 << 5,
+    Required = (1 << 6) - 1,
+  };
+  int found = 0;
+
+  QString hostname;
+  QString ipv4AddrIn;
+  QString ipv4Gateway;
+  QString ipv6AddrIn;
+  QString ipv6Gateway;
+  QString publicKey;
+  QString socksName;
+  double weight = 0;
+  int multihopPort = 0;
+  bool supportsLwoV1 = false;
+  bool supportsLwoV2 = false;
+  PortRanges prList;
+
+  auto readString = [&reader, &found](QString& value, int field) {
+    if (!reader.isString()) {
+      return false;
+    }
+    value = reader.string();
+    found |= field;
+    return true;
+  };
+
+  while (reader.readNextMember()) {
+    const QByteArray& key = reader.key();
+    if (key == "hostname") {
+      if (!readString(hostname, Hostname)) {
+        return false;
+      }
+    } else if (key == "ipv4_addr_in") {
+      if (!readString(ipv4AddrIn, Ipv4AddrIn)) {
+        return false;
+      }
+    } else if (key == "ipv4_gateway") {
+      if (!readString(ipv4Gateway, Ipv4Gateway)) {
+        return false;
+      }
+    } else if (key == "public_key") {
+      if (!readString(publicKey, PublicKey)) {
+        return false;
+      }
+    } else if (key == "weight") {
+      if (!reader.isNumber()) {
+        return false;
+      }
+      weight = reader.number();
+      found |= Weight;
+    } else if (key == "port_ranges") {
+      if (!reader.isArray()) {
+        return false;
+      }
+      while (reader.readNextElement()) {
+        if (!reader.isArray()) {
+          return false;
+        }
+
+        int port[2];
+        int count = 0;
+        while (reader.readNextElement()) {
+          if (!reader.isNumber() || count == 2) {
+            return false;
+          }
+          port[count++] = toInt(reader.number());
+        }
+        if (reader.hasError() || count != 2) {
+          return false;
+        }
+
+        prList.append(QPair<uint32_t, uint32_t>(port[0], port[1]));
+      }
+      if (reader.hasError()) {
+        return false;
+      }
+      found |= PortRanges;
+    } else if (key == "ipv6_addr_in") {
+      // If this object comes from the IOS migration, the ipv6_addr_in is
+      // missing.
+      if (!readOptionalString(reader, ipv6AddrIn)) {
+        return false;
+      }
+    } else if (key == "ipv6_gateway") {
+      // If the server doesn't support IPv6, then ipv6_gateway will be missing.
+      if (!readOptionalString(reader, ipv6Gateway)) {
+        return false;
+      }
+    } else if (key == "socks5_name") {
+      if (!readOptionalString(reader, socksName)) {
+        return false;
+      }
+    } else if (key == "multihop_port") {
+      multihopPort = reader.isNumber() ? toInt(reader.number()) : 0;
+      if (!reader.skipValue()) {
+        return false;
+      }
+    } else if (key == "features" && reader.isObject()) {
+      // Server features / obfuscation methods
+      while (reader.readNextMember()) {
+        if (reader.key() == "lwo" && reader.isObject()) {
+          supportsLwoV1 = true;
+        } else if (reader.key() == "lwo_v2" && reader.isObject()) {
+          supportsLwoV2 = true;
+        }
+        if (!reader.skipValue()) {
+          return false;
+        }
+      }
+      if (reader.hasError()) {
+        return false;
+      }
+    } else if (!reader.skipValue()) {
+      return false;
+    }
+  }
+
+  if (reader.hasError() || found != Required) {
+    return false;
+  }
+
+  m_hostname = hostname;
+  setAddresses(ipv4AddrIn, ipv4Gateway, ipv6AddrIn, ipv6Gateway);
+  setPortRanges(prList);
+  m_publicKey = publicKey;
+  m_weight = toInt(weight);
+  m_socksName = socksName;
+  m_multihopPort = multihopPort;
+  m_supportsLwoV1 = supportsLwoV1;
+  m_supportsLwoV2 = supportsLwoV2;
+
+  return true;
+}
+
+void Server::setLocation(const QString& countryCode, const QString& cityName) {
+  m_countryCode = stringPool().indexOf(countryCode);
+  m_cityName = stringPool().indexOf(cityName);
+}
+
+QString Server::countryCode() const { return stringPool().at(m_countryCode); }
+
+QString Server::cityName() const { return stringPool().at(m_cityName); }
+
+void Server::setPortRanges(const PortRanges& portRanges) {
+  m_portRanges = portRangePool().intern(portRanges);
+}
+
+void Server::setAddresses(const QString& ipv4AddrIn,
+                          const QString& ipv4Gateway,
+                          const QString& ipv6AddrIn,
+                          const QString& ipv6Gateway) {
+  m_addressTexts.clear();
+  m_ipv4AddrIn.set(ipv4AddrIn, m_addressTexts);
+  m_ipv4Gateway.set(ipv4Gateway, m_addressTexts);
+  m_ipv6AddrIn.set(ipv6AddrIn, m_addressTexts);
+  m_ipv6Gateway.set(ipv6Gateway, m_addressTexts);
+}
+
+void Server::Address::set(const QString& text, QList<QString>& texts) {
+  memset(m_data, 0, sizeof(m_data));
+  if (text.isEmpty()) {
+    m_family = Empty;
+    return;
+  }
+
+  QHostAddress address;
+  if (address.setAddress(text) && address.scopeId().isEmpty() &&
+      address.toString() == text) {
+    if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+      quint32 ipv4 = address.toIPv4Address();
+      memcpy(m_data, &ipv4, sizeof(ipv4));
+      m_family = IPv4;
+      return;
+    }
+    if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+      Q_IPV6ADDR ipv6 = address.toIPv6Address();
+      memcpy(m_data, ipv6.c, sizeof(m_data));
+      m_family = IPv6;
+      return;
+    }
+  }
+
+  quint32 index = static_cast<quint32>(texts.count());
+  texts.append(text);
+  memcpy(m_data, &index, sizeof(index));
+  m_family = Text;
+}
+
+QString Server::Address::toString(const QList<QString>& texts) const {
+  switch (m_family) {
+    case IPv4:
+    case IPv6:
+      return toAddress(texts).toString();
+    case Text: {
+      quint32 index;
+      memcpy(&index, m_data, sizeof(index));
+      return texts.value(index);
+    }
+    default:
+      return QString();
+  }
+}
+
+QHostAddress Server::Address::toAddress(const QList<QString>& texts) const {
+  switch (m_family) {
+    case IPv4: {
+      quint32 ipv4;
+      memcpy(&ipv4, m_data, sizeof(ipv4));
+      return QHostAddress(ipv4);
+    }
+    case IPv6:
+      return QHostAddress(m_data);
+    case Text:
+      return QHostAddress(toString(texts));
+    default:
+      return QHostAddress();
+  }
+}
+
 bool Server::fromMultihop(const Server& exit, const Server& entry) {
+  // The addresses kept as text are indexes in the list of their server, so
+  // they are set again from both servers.
+  setAddresses(entry.ipv4AddrIn(), exit.ipv4Gateway(), entry.ipv6AddrIn(),
+               exit.ipv6Gateway());
   m_hostname = exit.m_hostname;
-  m_ipv4Gateway = exit.m_ipv4Gateway;
-  m_ipv6Gateway = exit.m_ipv6Gateway;
   m_publicKey = exit.m_publicKey;
   m_socksName = exit.m_socksName;
   m_multihopPort = exit.m_multihopPort;
-
-  m_ipv4AddrIn = entry.m_ipv4AddrIn;
-  m_ipv6AddrIn = entry.m_ipv6AddrIn;
   return forcePort(exit.m_multihopPort);
 }
 
 bool Server::forcePort(uint32_t port) {
-  m_portRanges.clear();
-  m_portRanges.append(QPair<uint32_t, uint32_t>(port, port));
+  setPortRanges(PortRanges{QPair<uint32_t, uint32_t>(port, port)});
   return true;
 }
 
@@ -184,38 +460,76 @@ bool Server::supportObfuscationMethod(const ObfuscationMethod method) const {
   }
 }
 
-// static
-const Server& Server::weightChooser(const QList<Server>& servers) {
-  static const Server emptyServer;
-  Q_ASSERT(!emptyServer.initialized());
-  if (servers.isEmpty()) {
-    return emptyServer;
-  }
-
+namespace {
+qsizetype weightedIndex(const QList<Server>& servers,
+                        QRandomGenerator* generator) {
   uint32_t weightSum = 0;
 
   for (const Server& server : servers) {
     weightSum += server.weight();
   }
 
-  quint32 r = QRandomGenerator::global()->generate() % (weightSum + 1);
+  quint32 r = generator->generate() % (weightSum + 1);
 
-  for (const Server& server : servers) {
-    if (server.weight() >= r) {
-      return server;
+  for (qsizetype i = 0; i < servers.count(); i++) {
+    if (servers.at(i).weight() >= r) {
+      return i;
     }
 
-    r -= server.weight();
+    r -= servers.at(i).weight();
   }
 
   // This should not happen.
   Q_ASSERT(false);
-  return emptyServer;
+  return -1;
+}
+}  // namespace
+
+// static
+const Server& Server::weightChooser(const QList<Server>& servers,
+                                    QRandomGenerator* generator) {
+  static const Server emptyServer;
+  Q_ASSERT(!emptyServer.initialized());
+  if (servers.isEmpty()) {
+    return emptyServer;
+  }
+
+  qsizetype index = weightedIndex(servers, generator);
+  return index >= 0 ? servers.at(index) : emptyServer;
+}
+
+// static
+const Server& Server::latencyChooser(const QList<Server>& servers,
+                                     const QList<qint64>& latencies,
+                                     QRandomGenerator* generator) {
+  Q_ASSERT(latencies.count() == servers.count());
+  static const Server emptyServer;
+  if (servers.isEmpty()) {
+    return emptyServer;
+  }
+
+  qsizetype first = weightedIndex(servers, generator);
+  qsizetype second = weightedIndex(servers, generator);
+  if ((first < 0) || (second < 0)) {
+    return emptyServer;
+  }
+
+  qint64 firstLatency = latencies.value(first);
+  qint64 secondLatency = latencies.value(second);
+  if ((firstLatency <= 0) || (secondLatency <= 0)) {
+    return servers.at(first);
+  }
+
+  // Compare weight / latency without dividing.
+  if (static_cast<double>(servers.at(second).weight()) * firstLatency >
+      static_cast<double>(servers.at(first).weight()) * secondLatency) {
+    return servers.at(second);
+  }
+  return servers.at(first);
 }
 
 uint32_t Server::choosePort(bool tcp) const {
-  QList<QPair<uint32_t, uint32_t>> portRanges =
-      tcp ? m_udpOverTcpPorts : m_portRanges;
+  const PortRanges& portRanges = tcp ? udpOverTcpPorts() : m_portRanges;
   if (portRanges.isEmpty()) {
     return 0;
   }
@@ -243,3 +557,32 @@ uint32_t Server::choosePort(bool tcp) const {
   Q_ASSERT(port != 0);
   return port;
 }
+
+QDataStream& operator<<(QDataStream& stream, const Server& server) {
+  return stream << server.m_hostname << server.ipv4AddrIn()
+                << server.ipv4Gateway() << server.ipv6AddrIn()
+                << server.ipv6Gateway() << server.m_portRanges
+                << server.m_publicKey << server.m_socksName << server.m_weight
+                << server.m_multihopPort << server.countryCode()
+                << server.cityName() << server.m_supportsLwoV1
+                << server.m_supportsLwoV2;
+}
+
+QDataStream& operator>>(QDataStream& stream, Server& server) {
+  QString ipv4AddrIn;
+  QString ipv4Gateway;
+  QString ipv6AddrIn;
+  QString ipv6Gateway;
+  PortRanges portRanges;
+  QString countryCode;
+  QString cityName;
+  stream >> server.m_hostname >> ipv4AddrIn >> ipv4Gateway >> ipv6AddrIn >>
+      ipv6Gateway >> portRanges >> server.m_publicKey >> server.m_socksName >>
+      server.m_weight >> server.m_multihopPort >> countryCode >> cityName >>
+      server.m_supportsLwoV1 >> server.m_supportsLwoV2;
+
+  server.setAddresses(ipv4AddrIn, ipv4Gateway, ipv6AddrIn, ipv6Gateway);
+  server.setPortRanges(portRanges);
+  server.setLocation(countryCode, cityName);
+  return stream;
+}
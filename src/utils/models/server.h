@@ -5,11 +5,15 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include <QHostAddress>
 #include <QList>
 #include <QObject>
 #include <QPair>
+#include <QRandomGenerator>
 #include <QString>
 
+class JsonReader;
+class QDataStream;
 class QJsonObject;
 
 class Server final {
@@ -34,9 +38,27 @@ class Server final {
   Q_ENUM(ObfuscationMethod)
 
   [[nodiscard]] bool fromJson(const QJsonObject& obj);
+  // Same as above, reading the object the reader is positioned on. The
+  // location is not part of the object, see setLocation().
+  [[nodiscard]] bool fromJson(JsonReader& reader);
   bool fromMultihop(const Server& exit, const Server& entry);
 
-  static const Server& weightChooser(const QList<Server>& servers);
+  // Picks a server at random, in proportion to its weight.
+  static const Server& weightChooser(
+      const QList<Server>& servers,
+      QRandomGenerator* generator = QRandomGenerator::global());
+
+  // Picks the better of two servers drawn by weightChooser(): the one with
+  // the higher weight per millisecond of latency. This avoids the slow
+  // servers of a city without sending everyone to the fastest one. The
+  // latencies are in the same order as the servers, with 0 for unknown; the
+  // first draw wins unless both latencies are known.
+  //
+  // Servers on cooldown are expected to be left out of the list, see
+  // ServerData::getServerList().
+  static const Server& latencyChooser(
+      const QList<Server>& servers, const QList<qint64>& latencies,
+      QRandomGenerator* generator = QRandomGenerator::global());
 
   bool initialized() const { return !m_hostname.isEmpty(); }
 
@@ -44,13 +66,31 @@ class Server final {
 
   const QString& hostname() const { return m_hostname; }
 
-  const QString& ipv4AddrIn() const { return m_ipv4AddrIn; }
+  QString ipv4AddrIn() const { return m_ipv4AddrIn.toString(m_addressTexts); }
 
-  const QString& ipv4Gateway() const { return m_ipv4Gateway; }
+  QString ipv4Gateway() const {
+    return m_ipv4Gateway.toString(m_addressTexts);
+  }
+
+  QString ipv6AddrIn() const { return m_ipv6AddrIn.toString(m_addressTexts); }
 
-  const QString& ipv6AddrIn() const { return m_ipv6AddrIn; }
+  QString ipv6Gateway() const {
+    return m_ipv6Gateway.toString(m_addressTexts);
+  }
 
-  const QString& ipv6Gateway() const { return m_ipv6Gateway; }
+  // The same addresses, ready to be used without parsing the text again.
+  QHostAddress ipv4AddrInAddress() const {
+    return m_ipv4AddrIn.toAddress(m_addressTexts);
+  }
+  QHostAddress ipv4GatewayAddress() const {
+    return m_ipv4Gateway.toAddress(m_addressTexts);
+  }
+  QHostAddress ipv6AddrInAddress() const {
+    return m_ipv6AddrIn.toAddress(m_addressTexts);
+  }
+  QHostAddress ipv6GatewayAddress() const {
+    return m_ipv6Gateway.toAddress(m_addressTexts);
+  }
 
   const QString& publicKey() const { return m_publicKey; }
 
@@ -64,9 +104,11 @@ class Server final {
 
   uint32_t multihopPort() const { return m_multihopPort; }
 
-  const QString& countryCode() const { return m_countryCode; }
+  QString countryCode() const;
+
+  QString cityName() const;
 
-  const QString& cityName() const { return m_cityName; }
+  void setLocation(const QString& countryCode, const QString& cityName);
 
   bool supportsLwoV2() const { return m_supportsLwoV2; }
 
@@ -82,25 +124,49 @@ class Server final {
   }
 
  private:
+  // An IP address in binary form. Anything that does not read back the same
+  // way is kept as text instead, in the |texts| of its server: it comes from
+  // the server list, so it doesn't belong in the string pool.
+  class Address final {
+   public:
+    void set(const QString& text, QList<QString>& texts);
+    QString toString(const QList<QString>& texts) const;
+    QHostAddress toAddress(const QList<QString>& texts) const;
+
+   private:
+    enum Family : quint8 { Empty, Text, IPv4, IPv6 };
+    Family m_family = Empty;
+    quint8 m_data[16] = {};
+  };
+
+  void setAddresses(const QString& ipv4AddrIn, const QString& ipv4Gateway,
+                    const QString& ipv6AddrIn, const QString& ipv6Gateway);
+  void setPortRanges(const QList<QPair<uint32_t, uint32_t>>& portRanges);
+
+ private:
+  // Thousands of servers are kept, and copied around, so the strings they
+  // have in common and the port ranges are interned, and the addresses are
+  // stored in binary form.
   QString m_hostname;
-  QString m_ipv4AddrIn;
-  QString m_ipv4Gateway;
-  QString m_ipv6AddrIn;
-  QString m_ipv6Gateway;
-  QList<QPair<uint32_t, uint32_t>> m_portRanges;
-  // Mullvad ports for UDP over TCP obfuscation, hardcoded as specified
-  // Use QPair so we can reuse choosePort logic, maybe expose these ports in
-  // guardian APIs in the future
-  QList<QPair<uint32_t, uint32_t>> m_udpOverTcpPorts{
-      {80, 80}, {443, 443}, {5001, 5001}};
   QString m_publicKey;
   QString m_socksName;
+  Address m_ipv4AddrIn;
+  Address m_ipv4Gateway;
+  Address m_ipv6AddrIn;
+  Address m_ipv6Gateway;
+  // The addresses kept as text, usually none.
+  QList<QString> m_addressTexts;
+  QList<QPair<uint32_t, uint32_t>> m_portRanges;
   uint32_t m_weight = 0;
   uint32_t m_multihopPort = 0;
-  QString m_countryCode;
-  QString m_cityName;
+  // Indexes in the string pool.
+  quint32 m_countryCode = 0;
+  quint32 m_cityName = 0;
   bool m_supportsLwoV1 = false;
   bool m_supportsLwoV2 = false;
+
+  friend QDataStream& operator<<(QDataStream& stream, const Server& server);
+  friend QDataStream& operator>>(QDataStream& stream, Server& server);
 };
 
 #endif  // SERVER_H
@@ -5,12 +5,20 @@
 #include "servercity.h"
 
 #include <QCoreApplication>
+#include <QDataStream>
+#include <QHash>
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QJsonValue>
 
+#include "jsonreader.h"
 #include "leakdetector.h"
 
+namespace {
+// City name -> localized name, for the current language.
+QHash<QString, QString> s_localizedNames;
+}  // namespace
+
 ServerCity::ServerCity() { MZ_COUNT_CTOR(ServerCity); }
 
 ServerCity::ServerCity(const ServerCity& other) {
@@ -21,13 +29,23 @@ ServerCity::ServerCity(const ServerCity& other) {
 ServerCity& ServerCity::operator=(const ServerCity& other) {
   if (this == &other) return *this;
 
+  bool identityChanged =
+      (m_name != other.m_name) || (m_code != other.m_code) ||
+      (m_country != other.m_country) || (m_latitude != other.m_latitude) ||
+      (m_longitude != other.m_longitude);
+
   m_name = other.m_name;
   m_code = other.m_code;
   m_country = other.m_country;
+  m_hashKey = other.m_hashKey;
   m_latitude = other.m_latitude;
   m_longitude = other.m_longitude;
   m_servers = other.m_servers;
+  m_serverIds = other.m_serverIds;
 
+  if (identityChanged) {
+    emit changed();
+  }
   return *this;
 }
 
@@ -82,10 +100,101 @@ bool ServerCity::fromJson(const QJsonObject& obj, const QString& country) {
   m_latitude = latitude.toDouble();
   m_longitude = longitude.toDouble();
   m_servers.swap(servers);
+  m_serverIds.clear();
 
   return true;
 }
 
+bool ServerCity::fromJson(JsonReader& reader, QList<Server>& servers) {
+  if (!reader.isObject()) {
+    return false;
+  }
+
+  enum {
+    Name = 1 << 0,
+    Code = 1 << 1,
+    Latitude = 1 << 2,
+    Longitude = 1 << 3,
+    Servers = 1 << 4,
+    Required = (1 << 5) - 1,
+  };
+  int found = 0;
+
+  QString name;
+  QString code;
+  double latitude = 0;
+  double longitude = 0;
+  QList<QString> pubkeys;
+
+  while (reader.readNextMember()) {
+    const QByteArray& key = reader.key();
+    if (key == "name" || key == "code") {
+      if (!reader.isString()) {
+        return false;
+      }
+      if (key == "name") {
+        name = reader.string();
+        found |= Name;
+      } else {
+        code = reader.string();
+        found |= Code;
+      }
+    } else if (key == "latitude" || key == "longitude") {
+      if (!reader.isNumber()) {
+        return false;
+      }
+      if (key == "latitude") {
+        latitude = reader.number();
+        found |= Latitude;
+      } else {
+        longitude = reader.number();
+        found |= Longitude;
+      }
+    } else if (key == "servers") {
+      if (!reader.isArray()) {
+        return false;
+      }
+      while (reader.readNextElement()) {
+        Server server;
+        if (!server.fromJson(reader)) {
+          return false;
+        }
+        pubkeys.append(server.publicKey());
+        servers.append(server);
+      }
+      if (reader.hasError()) {
+        return false;
+      }
+      found |= Servers;
+    } else if (!reader.skipValue()) {
+      return false;
+    }
+  }
+
+  if (reader.hasError() || found != Required) {
+    return false;
+  }
+
+  m_name = name;
+  m_code = code;
+  m_hashKey = hashKey(m_country, m_name);
+  m_latitude = latitude;
+  m_longitude = longitude;
+  m_servers.swap(pubkeys);
+  m_serverIds.clear();
+
+  return true;
+}
+
+void ServerCity::setCountry(const QString& country) {
+  bool countryChanged = m_country != country;
+  m_country = country;
+  m_hashKey = hashKey(m_country, m_name);
+  if (countryChanged) {
+    emit changed();
+  }
+}
+
 // static
 QString ServerCity::hashKey(const QString& country, const QString cityName) {
   return cityName + "," + country;
@@ -93,15 +202,47 @@ QString ServerCity::hashKey(const QString& country, const QString cityName) {
 
 // static
 QString ServerCity::localizedName(const QString& name) {
-  return QCoreApplication::translate("ServerCity", qPrintable(name));
+  auto it = s_localizedNames.constFind(name);
+  if (it != s_localizedNames.constEnd()) {
+    return it.value();
+  }
+
+  QString localized =
+      QCoreApplication::translate("ServerCity", qPrintable(name));
+  s_localizedNames.insert(name, localized);
+  return localized;
 }
 
-void ServerCity::setLatency(qint64 msec) {
+// static
+void ServerCity::clearLocalizedNames() { s_localizedNames.clear(); }
+
+void ServerCity::setLatency(qint64 msec, qint64 jitter, double packetLoss) {
+  if ((m_latency == msec) && (m_jitter == jitter) &&
+      qFuzzyCompare(1.0 + m_packetLoss, 1.0 + packetLoss)) {
+    return;
+  }
   m_latency = msec;
+  m_jitter = jitter;
+  m_packetLoss = packetLoss;
   emit latencyChanged();
 }
 
 void ServerCity::setConnectionScore(int score) {
+  if (m_connectionScore == score) {
+    return;
+  }
   m_connectionScore = score;
   emit scoreChanged();
 }
+
+QDataStream& operator<<(QDataStream& stream, const ServerCity& city) {
+  return stream << city.m_name << city.m_code << city.m_country
+                << city.m_latitude << city.m_longitude << city.m_servers;
+}
+
+QDataStream& operator>>(QDataStream& stream, ServerCity& city) {
+  stream >> city.m_name >> city.m_code >> city.m_country >> city.m_latitude >>
+      city.m_longitude >> city.m_servers;
+  city.m_hashKey = ServerCity::hashKey(city.m_country, city.m_name);
+  return stream;
+}
@@ -11,18 +11,24 @@
 
 #include "server.h"
 
+class JsonReader;
+class QDataStream;
 class QJsonObject;
 
 class ServerCity final : public QObject {
   Q_OBJECT
 
-  Q_PROPERTY(QString name READ name CONSTANT)
-  Q_PROPERTY(QString code READ code CONSTANT)
-  Q_PROPERTY(QString country READ country CONSTANT)
-  Q_PROPERTY(QString localizedName READ localizedName CONSTANT)
-  Q_PROPERTY(double latitude READ latitude CONSTANT)
-  Q_PROPERTY(double longitude READ longitude CONSTANT)
+  // ServerCountryModel assigns its cities in place when the server list
+  // changes, and reuses their storage for other cities.
+  Q_PROPERTY(QString name READ name NOTIFY changed)
+  Q_PROPERTY(QString code READ code NOTIFY changed)
+  Q_PROPERTY(QString country READ country NOTIFY changed)
+  Q_PROPERTY(QString localizedName READ localizedName NOTIFY changed)
+  Q_PROPERTY(double latitude READ latitude NOTIFY changed)
+  Q_PROPERTY(double longitude READ longitude NOTIFY changed)
   Q_PROPERTY(qint64 latency READ latency NOTIFY latencyChanged)
+  Q_PROPERTY(qint64 jitter READ jitter NOTIFY latencyChanged)
+  Q_PROPERTY(double packetLoss READ packetLoss NOTIFY latencyChanged)
   Q_PROPERTY(int connectionScore READ connectionScore NOTIFY scoreChanged)
 
  public:
@@ -32,6 +38,10 @@ class ServerCity final : public QObject {
   ~ServerCity();
 
   [[nodiscard]] bool fromJson(const QJsonObject& obj, const QString& country);
+  // Same as above, reading the object the reader is positioned on. Its
+  // servers are fully parsed and appended to |servers|. The country is not
+  // part of the object, see setCountry().
+  [[nodiscard]] bool fromJson(JsonReader& reader, QList<Server>& servers);
 
   bool initialized() const { return !m_name.isEmpty(); }
 
@@ -40,9 +50,14 @@ class ServerCity final : public QObject {
   const QString& code() const { return m_code; }
 
   const QString& country() const { return m_country; }
+  void setCountry(const QString& country);
 
+  // The localized names are memoized, as they are looked up for every
+  // comparison when the cities are sorted. The memo has to be cleared when
+  // the language changes.
   static QString localizedName(const QString& name);
   const QString localizedName() const { return localizedName(m_name); }
+  static void clearLocalizedNames();
 
   const QString& hashKey() const { return m_hashKey; }
   static QString hashKey(const QString& country, const QString cityName);
@@ -51,15 +66,23 @@ class ServerCity final : public QObject {
 
   double longitude() const { return m_longitude; }
 
-  const QList<QString> servers() const { return m_servers; }
+  const QList<QString>& servers() const { return m_servers; }
 
-  void setLatency(qint64 msec);
+  // The IDs that ServerCountryModel assigned to the servers, in the same
+  // order as their public keys. Empty for cities outside of the model.
+  const QList<int>& serverIds() const { return m_serverIds; }
+  void setServerIds(const QList<int>& ids) { m_serverIds = ids; }
+
+  void setLatency(qint64 msec, qint64 jitter = 0, double packetLoss = 0.0);
   qint64 latency() const { return m_latency; }
+  qint64 jitter() const { return m_jitter; }
+  double packetLoss() const { return m_packetLoss; }
 
   void setConnectionScore(int score);
   int connectionScore() const { return m_connectionScore; }
 
  signals:
+  void changed() const;
   void latencyChanged() const;
   void scoreChanged() const;
 
@@ -68,14 +91,20 @@ class ServerCity final : public QObject {
   QString m_name;
   QString m_code;
   QString m_hashKey;
-  double m_latitude;
-  double m_longitude;
+  double m_latitude = 0;
+  double m_longitude = 0;
 
   QList<QString> m_servers;
+  QList<int> m_serverIds;
 
   // Settable field for connection scoring.
   qint64 m_latency = 0;
+  qint64 m_jitter = 0;
+  double m_packetLoss = 0.0;
   int m_connectionScore = 0;
+
+  friend QDataStream& operator<<(QDataStream& stream, const ServerCity& city);
+  friend QDataStream& operator>>(QDataStream& stream, ServerCity& city);
 };
 
 #endif  // SERVERCITY_H
@@ -5,14 +5,23 @@
 #include "servercountry.h"
 
 #include <QCoreApplication>
+#include <QDataStream>
+#include <QHash>
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QJsonValue>
 #include <QStringList>
+#include <utility>
 
 #include "collator.h"
+#include "jsonreader.h"
 #include "leakdetector.h"
 
+namespace {
+// (code, name) -> localized name, for the current language.
+QHash<std::pair<QString, QString>, QString> s_localizedNames;
+}  // namespace
+
 ServerCountry::ServerCountry() { MZ_COUNT_CTOR(ServerCountry); }
 
 ServerCountry::ServerCountry(const ServerCountry& other) {
@@ -72,12 +81,101 @@ bool ServerCountry::fromJson(const QJsonObject& countryObj) {
   return true;
 }
 
+bool ServerCountry::fromJson(JsonReader& reader, QList<ServerCity>& cities,
+                             QList<Server>& servers) {
+  if (!reader.isObject()) {
+    return false;
+  }
+
+  QString countryName;
+  QString countryCode;
+  bool hasName = false;
+  bool hasCode = false;
+  bool hasCities = false;
+  qsizetype firstCity = cities.count();
+  qsizetype firstServer = servers.count();
+
+  while (reader.readNextMember()) {
+    const QByteArray& key = reader.key();
+    if (key == "name") {
+      if (!reader.isString()) {
+        return false;
+      }
+      countryName = reader.string();
+      hasName = true;
+    } else if (key == "code") {
+      if (!reader.isString()) {
+        return false;
+      }
+      countryCode = reader.string();
+      hasCode = true;
+    } else if (key == "cities") {
+      if (!reader.isArray()) {
+        return false;
+      }
+      while (reader.readNextElement()) {
+        ServerCity city;
+        if (!city.fromJson(reader, servers) || city.name().isEmpty()) {
+          return false;
+        }
+        cities.append(city);
+      }
+      if (reader.hasError()) {
+        return false;
+      }
+      hasCities = true;
+    } else if (!reader.skipValue()) {
+      return false;
+    }
+  }
+
+  if (reader.hasError() || !hasName || !hasCode || !hasCities) {
+    return false;
+  }
+
+  // The country code can come after the cities in the object, so their
+  // location is only filled in now.
+  QList<QString> cityNames;
+  qsizetype server = firstServer;
+  for (qsizetype i = firstCity; i < cities.count(); ++i) {
+    ServerCity& city = cities[i];
+    city.setCountry(countryCode);
+    cityNames.append(city.name());
+
+    qsizetype count = city.servers().count();
+    for (qsizetype j = 0; j < count; ++j) {
+      servers[server++].setLocation(countryCode, city.name());
+    }
+  }
+  Q_ASSERT(server == servers.count());
+
+  m_name = countryName;
+  m_code = countryCode;
+  m_cities.swap(cityNames);
+
+  sortCities();
+
+  return true;
+}
+
 // static
 QString ServerCountry::localizedName(const QString& code, const QString& name) {
-  return QCoreApplication::translate("ServerCountry", qPrintable(code),
-                                     qPrintable(name));
+  // The name is only used when there is no translation for the code.
+  auto key = std::make_pair(code, name);
+  auto it = s_localizedNames.constFind(key);
+  if (it != s_localizedNames.constEnd()) {
+    return it.value();
+  }
+
+  QString localized = QCoreApplication::translate(
+      "ServerCountry", qPrintable(code), qPrintable(name));
+  s_localizedNames.insert(key, localized);
+  return localized;
 }
 
+// static
+void ServerCountry::clearLocalizedNames() { s_localizedNames.clear(); }
+
 namespace {
 
 bool sortCityCallback(const QString& a, const QString& b, Collator* collator) {
@@ -95,3 +193,11 @@ void ServerCountry::sortCities() {
             std::bind(sortCityCallback, std::placeholders::_1,
                       std::placeholders::_2, &collator));
 }
+
+QDataStream& operator<<(QDataStream& stream, const ServerCountry& country) {
+  return stream << country.m_name << country.m_code << country.m_cities;
+}
+
+QDataStream& operator>>(QDataStream& stream, ServerCountry& country) {
+  return stream >> country.m_name >> country.m_code >> country.m_cities;
+}
@@ -10,6 +10,8 @@
 
 #include "servercity.h"
 
+class JsonReader;
+class QDataStream;
 class QJsonObject;
 
 class ServerCountry final {
@@ -20,13 +22,20 @@ class ServerCountry final {
   ~ServerCountry();
 
   [[nodiscard]] bool fromJson(const QJsonObject& obj);
+  // Same as above, reading the object the reader is positioned on. Its cities
+  // and their servers are fully parsed in the same pass, and appended to
+  // |cities| and |servers|.
+  [[nodiscard]] bool fromJson(JsonReader& reader, QList<ServerCity>& cities,
+                              QList<Server>& servers);
 
   const QString& name() const { return m_name; }
 
   const QString& code() const { return m_code; }
 
+  // Memoized like ServerCity::localizedName().
   static QString localizedName(const QString& code, const QString& name);
   QString localizedName() const { return localizedName(m_code, m_name); }
+  static void clearLocalizedNames();
 
   const QList<QString>& cities() const { return m_cities; }
 
@@ -37,6 +46,10 @@ class ServerCountry final {
   QString m_code;
 
   QList<QString> m_cities;
+
+  friend QDataStream& operator<<(QDataStream& stream,
+                                 const ServerCountry& country);
+  friend QDataStream& operator>>(QDataStream& stream, ServerCountry& country);
 };
 
 #endif  // SERVERCOUNTRY_H
@@ -4,27 +4,49 @@
 
 #include "servercountrymodel.h"
 
-#include <QJsonArray>
-#include <QJsonDocument>
-#include <QJsonObject>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+#include <QScopeGuard>
+#include <QSet>
+#include <algorithm>
 
 #include "collator.h"
+#include "jsonreader.h"
 #include "leakdetector.h"
 #include "logger.h"
 #include "models/servercountry.h"
 
 namespace {
 Logger logger("ServerCountryModel");
+
+// "MZSL", followed by the version of the snapshot format. Bump the version
+// whenever the serialization of the models changes.
+constexpr quint32 SNAPSHOT_MAGIC = 0x4d5a534c;
+constexpr quint16 SNAPSHOT_VERSION = 1;
+constexpr QDataStream::Version SNAPSHOT_STREAM_VERSION = QDataStream::Qt_6_0;
+
+// Whether the parts of a city that come from the server list are the same.
+bool sameCity(const ServerCity& a, const ServerCity& b) {
+  return (a.name() == b.name()) && (a.code() == b.code()) &&
+         (a.latitude() == b.latitude()) && (a.longitude() == b.longitude()) &&
+         (a.servers() == b.servers());
 }
+}  // namespace
 
 ServerCountryModel::ServerCountryModel() { MZ_COUNT_CTOR(ServerCountryModel); }
 
-ServerCountryModel::~ServerCountryModel() { MZ_COUNT_DTOR(ServerCountryModel); }
+ServerCountryModel::~ServerCountryModel() {
+  MZ_COUNT_DTOR(ServerCountryModel);
+  closeSnapshot();
+}
 
 bool ServerCountryModel::fromJson(const QByteArray& json) {
   logger.debug() << "Reading from JSON";
 
-  if (!json.isEmpty() && m_rawJson == json) {
+  QByteArray jsonHash = hashJson(json);
+  if (!json.isEmpty() && m_rawJsonHash == jsonHash) {
     logger.debug() << "Nothing has changed";
     return true;
   }
@@ -33,88 +55,435 @@ bool ServerCountryModel::fromJson(const QByteArray& json) {
     return false;
   }
 
-  m_rawJson = json;
+  m_rawJsonHash = jsonHash;
   emit changed();
   return true;
 }
 
 bool ServerCountryModel::fromJsonInternal(const QByteArray& s) {
-  beginResetModel();
+  // The list of servers is large, so it is read in a single pass without
+  // building a QJsonDocument first.
+  JsonReader reader(s);
+  if (reader.readNext() != JsonReader::BeginObject) {
+    return false;
+  }
 
-  m_rawJson = "";
-  m_countries.clear();
-  m_cities.clear();
-  m_servers.clear();
+  QList<ServerCountry> countries;
+  QHash<QString, ServerCity> cities;
+  QList<Server> servers;
+  bool hasCountries = false;
+  while (reader.readNextMember()) {
+    if (reader.key() != "countries") {
+      if (!reader.skipValue()) {
+        return false;
+      }
+      continue;
+    }
+
+    if (!reader.isArray()) {
+      return false;
+    }
+    hasCountries = true;
+
+    while (reader.readNextElement()) {
+      ServerCountry country;
+      QList<ServerCity> countryCities;
+      QList<Server> countryServers;
+      if (!country.fromJson(reader, countryCities, countryServers)) {
+        return false;
+      }
+
+      if (country.cities().isEmpty()) {
+        continue;
+      }
+
+      countries.append(country);
 
-  QJsonDocument doc = QJsonDocument::fromJson(s);
-  if (!doc.isObject()) {
+      for (const ServerCity& city : countryCities) {
+        cities[city.hashKey()] = city;
+      }
+
+      servers.append(countryServers);
+    }
+  }
+
+  if (!hasCountries || reader.readNext() != JsonReader::EndDocument) {
     return false;
   }
 
-  QJsonObject obj = doc.object();
+  closeSnapshot();
+  m_servers.clear();
+  for (const Server& server : servers) {
+    int id = addServerId(server.publicKey());
+    if (id >= m_servers.count()) {
+      m_servers.resize(m_serverKeys.count());
+    }
+    m_servers[id] = server;
+  }
 
-  QJsonValue countries = obj.value("countries");
-  if (!countries.isArray()) {
-    return false;
+  updateModel(countries, cities);
+  return true;
+}
+
+void ServerCountryModel::updateModel(QList<ServerCountry>& countries,
+                                     QHash<QString, ServerCity>& cities) {
+  sortCountries(countries);
+  assignServerIds(cities);
+
+  // Rows whose country was removed or renamed go first. A renamed country
+  // may sort elsewhere, so it is added back below.
+  QHash<QString, qsizetype> newRows;
+  for (qsizetype row = 0; row < countries.count(); row++) {
+    newRows.insert(countries.at(row).code(), row);
+  }
+  auto removed = [&](qsizetype row) {
+    const ServerCountry& country = m_countries.at(row);
+    auto it = newRows.constFind(country.code());
+    return (it == newRows.constEnd()) ||
+           (countries.at(it.value()).name() != country.name());
+  };
+
+  // Both lists are sorted the same way, so the rows that are kept should
+  // appear in the same order in the new list. If they don't, for instance
+  // because the list was sorted for another language, start over.
+  qsizetype lastRow = -1;
+  for (qsizetype row = 0; row < m_countries.count(); row++) {
+    if (removed(row)) {
+      continue;
+    }
+    qsizetype newRow = newRows.value(m_countries.at(row).code());
+    if (newRow < lastRow) {
+      beginResetModel();
+      m_countries.swap(countries);
+      updateCities(cities);
+      endResetModel();
+      return;
+    }
+    lastRow = newRow;
   }
 
-  QJsonArray countriesArray = countries.toArray();
-  for (const QJsonValue& countryValue : countriesArray) {
-    if (!countryValue.isObject()) {
-      return false;
+  for (qsizetype row = m_countries.count() - 1; row >= 0; row--) {
+    if (!removed(row)) {
+      continue;
+    }
+    qsizetype first = row;
+    while ((first > 0) && removed(first - 1)) {
+      first--;
     }
+    beginRemoveRows(QModelIndex(), static_cast<int>(first),
+                    static_cast<int>(row));
+    m_countries.remove(first, row - first + 1);
+    endRemoveRows();
+    row = first;
+  }
 
-    QJsonObject countryObj = countryValue.toObject();
+  QSet<QString> changedCountries = updateCities(cities);
 
-    ServerCountry country;
-    if (!country.fromJson(countryObj)) {
-      return false;
+  // The remaining rows are in the same order as in the new list, so the new
+  // countries are inserted in between them.
+  QSet<QString> keptCountries;
+  for (const ServerCountry& country : m_countries) {
+    keptCountries.insert(country.code());
+  }
+  qsizetype row = 0;
+  while (row < countries.count()) {
+    if ((row < m_countries.count()) &&
+        (m_countries.at(row).code() == countries.at(row).code())) {
+      const ServerCountry& country = countries.at(row);
+      if ((m_countries.at(row).cities() != country.cities()) ||
+          changedCountries.contains(country.code())) {
+        m_countries[row] = country;
+        QModelIndex index = createIndex(static_cast<int>(row), 0);
+        emit dataChanged(index, index, {CitiesRole});
+      }
+      row++;
+      continue;
     }
 
-    if (country.cities().isEmpty()) {
+    qsizetype last = row;
+    while ((last + 1 < countries.count()) &&
+           !keptCountries.contains(countries.at(last + 1).code())) {
+      last++;
+    }
+    beginInsertRows(QModelIndex(), static_cast<int>(row),
+                    static_cast<int>(last));
+    for (qsizetype i = row; i <= last; i++) {
+      m_countries.insert(i, countries.at(i));
+    }
+    endInsertRows();
+    row = last + 1;
+  }
+
+  Q_ASSERT(m_countries.count() == countries.count());
+}
+
+// Cities that did not change are kept as they are. The others are updated in
+// place, keeping their latency and score, removed or added. Returns the codes
+// of the countries whose cities changed.
+QSet<QString> ServerCountryModel::updateCities(
+    const QHash<QString, ServerCity>& cities) {
+  QSet<QString> changedCountries;
+  for (auto it = m_cities.begin(); it != m_cities.end();) {
+    ServerCity* city = m_citySlots.at(it.value());
+    auto next = cities.constFind(it.key());
+    if (next == cities.constEnd()) {
+      changedCountries.insert(city->country());
+      releaseCity(it.value());
+      it = m_cities.erase(it);
       continue;
     }
+    if (!sameCity(*city, next.value())) {
+      // The latency and the score are not assigned.
+      *city = next.value();
+      changedCountries.insert(city->country());
+    }
+    ++it;
+  }
+  for (auto it = cities.constBegin(); it != cities.constEnd(); ++it) {
+    if (!m_cities.contains(it.key())) {
+      m_cities.insert(it.key(), allocateCity(it.value()));
+      changedCountries.insert(it->country());
+    }
+  }
 
-    m_countries.append(country);
+  m_cityList.clear();
+  m_cityList.reserve(m_cities.count());
+  for (ServerCity* city : m_citySlots) {
+    if (city->initialized()) {
+      m_cityList.append(city);
+    }
+  }
 
-    QJsonValue cities = countryObj.value("cities");
-    if (!cities.isArray()) {
-      return false;
+  return changedCountries;
+}
+
+int ServerCountryModel::allocateCity(const ServerCity& city) {
+  int slot;
+  if (m_freeCitySlots.isEmpty()) {
+    slot = static_cast<int>(m_citySlots.count());
+    // Owned by the model, so that QML never takes the ownership of a city.
+    ServerCity* storage = new ServerCity();
+    storage->setParent(this);
+    m_citySlots.append(storage);
+    m_cityGenerations.append(0);
+  } else {
+    slot = m_freeCitySlots.takeLast();
+  }
+
+  *m_citySlots.at(slot) = city;
+  return slot;
+}
+
+void ServerCountryModel::releaseCity(int slot) {
+  ServerCity* city = m_citySlots.at(slot);
+  *city = ServerCity();
+  city->setLatency(0);
+  city->setConnectionScore(0);
+
+  m_cityGenerations[slot]++;
+  m_freeCitySlots.append(slot);
+}
+
+ServerCountryModel::CityHandle ServerCountryModel::cityHandle(
+    const ServerCity& city) const {
+  int slot = m_cities.value(city.hashKey(), -1);
+  if ((slot < 0) || (m_citySlots.at(slot) != &city)) {
+    return CityHandle();
+  }
+  return CityHandle{slot, m_cityGenerations.at(slot)};
+}
+
+ServerCity* ServerCountryModel::city(const CityHandle& handle) const {
+  if ((handle.slot < 0) || (handle.slot >= m_citySlots.count()) ||
+      (m_cityGenerations.at(handle.slot) != handle.generation)) {
+    return nullptr;
+  }
+  return m_citySlots.at(handle.slot);
+}
+
+QList<const ServerCity*> ServerCountryModel::cityList(
+    const ServerCountry& country) const {
+  QList<const ServerCity*> list;
+  for (const QString& name : country.cities()) {
+    const ServerCity& city = findCity(country.code(), name);
+    if (city.initialized()) {
+      list.append(&city);
     }
+  }
+  return list;
+}
 
-    QJsonArray cityArray = cities.toArray();
-    for (const QJsonValue& cityValue : cityArray) {
-      if (!cityValue.isObject()) {
-        return false;
-      }
-      QJsonObject cityObj = cityValue.toObject();
-      QJsonValue servers = cityObj.value("servers");
-      if (!servers.isArray()) {
-        return false;
-      }
+// The snapshot starts with a header, followed by the serialized models:
+//
+//   magic, version, SHA-256 of the JSON, SHA-256 of the body
+//   body: countries, cities, servers
+//
+// Each list is preceded by the number of items it contains.
+bool ServerCountryModel::fromSnapshot(const QString& fileName,
+                                      const QByteArray& json) {
+  logger.debug() << "Reading from snapshot";
+
+  QByteArray jsonHash = hashJson(json);
+  if (!json.isEmpty() && m_rawJsonHash == jsonHash) {
+    logger.debug() << "Nothing has changed";
+    return true;
+  }
 
-      ServerCity city;
-      if (!city.fromJson(cityObj, country.code())) {
-        return false;
-      }
-      m_cities[city.hashKey()] = city;
-
-      QJsonArray serverArray = servers.toArray();
-      for (const QJsonValue& serverValue : serverArray) {
-        Server server(country.code(), city.name());
-        if (!server.fromJson(serverValue.toObject())) {
-          return false;
-        }
-        m_servers[server.publicKey()] = server;
+  QFile* file = new QFile(fileName, this);
+  auto guard = qScopeGuard([&file]() { delete file; });
+  if (!file->open(QIODevice::ReadOnly)) {
+    return false;
+  }
+  qint64 size = file->size();
+  const char* data = reinterpret_cast<const char*>(file->map(0, size));
+  if (!data) {
+    logger.warning() << "Unable to map the snapshot";
+    return false;
+  }
+
+  QByteArray mapped = QByteArray::fromRawData(data, size);
+  QDataStream header(mapped);
+  header.setVersion(SNAPSHOT_STREAM_VERSION);
+  quint32 magic = 0;
+  quint16 version = 0;
+  QByteArray sourceHash;
+  QByteArray checksum;
+  header >> magic >> version >> sourceHash >> checksum;
+  if ((header.status() != QDataStream::Ok) || (magic != SNAPSHOT_MAGIC) ||
+      (version != SNAPSHOT_VERSION)) {
+    logger.debug() << "Ignoring unknown snapshot format";
+    return false;
+  }
+  if (sourceHash != jsonHash) {
+    logger.debug() << "Snapshot is out of date";
+    return false;
+  }
+
+  qint64 offset = header.device()->pos();
+  QByteArray body = QByteArray::fromRawData(data + offset, size - offset);
+  if (QCryptographicHash::hash(body, QCryptographicHash::Sha256) != checksum) {
+    logger.warning() << "Snapshot is corrupted";
+    return false;
+  }
+
+  // Countries and cities are needed straight away to populate the UI.
+  QDataStream stream(body);
+  stream.setVersion(SNAPSHOT_STREAM_VERSION);
+  QList<ServerCountry> countries;
+  QHash<QString, ServerCity> cities;
+  quint32 count = 0;
+  stream >> count;
+  for (quint32 i = 0; (i < count) && (stream.status() == QDataStream::Ok);
+       i++) {
+    ServerCountry country;
+    stream >> country;
+    countries.append(country);
+  }
+  stream >> count;
+  for (quint32 i = 0; (i < count) && (stream.status() == QDataStream::Ok);
+       i++) {
+    ServerCity city;
+    stream >> city;
+    cities[city.hashKey()] = city;
+  }
+  if (stream.status() != QDataStream::Ok) {
+    logger.warning() << "Snapshot is truncated";
+    return false;
+  }
+
+  closeSnapshot();
+  m_servers.clear();
+  offset = stream.device()->pos();
+  m_snapshotServers = QByteArray::fromRawData(body.constData() + offset,
+                                              body.size() - offset);
+  m_snapshot = file;
+  guard.dismiss();
+  updateModel(countries, cities);
+
+  m_rawJsonHash = jsonHash;
+  emit changed();
+  return true;
+}
+
+bool ServerCountryModel::writeSnapshot(const QString& fileName) const {
+  loadServers();
+
+  QByteArray body;
+  {
+    QDataStream stream(&body, QIODevice::WriteOnly);
+    stream.setVersion(SNAPSHOT_STREAM_VERSION);
+    stream << static_cast<quint32>(m_countries.count());
+    for (const ServerCountry& country : m_countries) {
+      stream << country;
+    }
+    stream << static_cast<quint32>(m_cityList.count());
+    for (const ServerCity* city : m_cityList) {
+      stream << *city;
+    }
+    quint32 count = static_cast<quint32>(std::count_if(
+        m_servers.cbegin(), m_servers.cend(),
+        [](const Server& server) { return server.initialized(); }));
+    stream << count;
+    for (const Server& server : m_servers) {
+      if (server.initialized()) {
+        stream << server;
       }
     }
   }
 
-  sortCountries();
+  QSaveFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly)) {
+    logger.warning() << "Unable to write the snapshot";
+    return false;
+  }
 
-  endResetModel();
+  QDataStream stream(&file);
+  stream.setVersion(SNAPSHOT_STREAM_VERSION);
+  stream << SNAPSHOT_MAGIC << SNAPSHOT_VERSION << m_rawJsonHash
+         << QCryptographicHash::hash(body, QCryptographicHash::Sha256);
+  stream.writeRawData(body.constData(), body.size());
+  return file.commit();
+}
 
-  return true;
+void ServerCountryModel::loadServers() const {
+  if (!m_snapshot) {
+    return;
+  }
+
+  QDataStream stream(m_snapshotServers);
+  stream.setVersion(SNAPSHOT_STREAM_VERSION);
+  quint32 count = 0;
+  stream >> count;
+  m_servers.resize(m_serverKeys.count());
+  for (quint32 i = 0; (i < count) && (stream.status() == QDataStream::Ok);
+       i++) {
+    Server server;
+    stream >> server;
+    int id = serverId(server.publicKey());
+    if (id >= 0) {
+      m_servers[id] = server;
+    }
+  }
+  if (stream.status() != QDataStream::Ok) {
+    logger.error() << "Failed to read the servers from the snapshot";
+  }
+
+  closeSnapshot();
+}
+
+void ServerCountryModel::closeSnapshot() const {
+  // The data points into the mapping, so it has to go first.
+  m_snapshotServers.clear();
+  delete m_snapshot;
+  m_snapshot = nullptr;
+}
+
+// static
+QByteArray ServerCountryModel::hashJson(const QByteArray& json) {
+  if (json.isEmpty()) {
+    return QByteArray();
+  }
+  return QCryptographicHash::hash(json, QCryptographicHash::Sha256);
 }
 
 QHash<int, QByteArray> ServerCountryModel::roleNames() const {
@@ -144,14 +513,9 @@ QVariant ServerCountryModel::data(const QModelIndex& index, int role) const {
       return QVariant(m_countries.at(index.row()).code());
 
     case CitiesRole: {
-      const ServerCountry& country = m_countries.at(index.row());
-
       QList<QVariant> list;
-      for (const QString& name : country.cities()) {
-        const ServerCity& city = findCity(country.code(), name);
-        if (city.initialized()) {
-          list.append(QVariant::fromValue(&city));
-        }
+      for (const ServerCity* city : cityList(m_countries.at(index.row()))) {
+        list.append(QVariant::fromValue(city));
       }
 
       return QVariant(list);
@@ -170,36 +534,64 @@ bool ServerCountryModel::exists(const QString& countryCode,
 
 ServerCity& ServerCountryModel::findCity(const QString& countryCode,
                                          const QString& cityName) {
-  auto index = m_cities.find(ServerCity::hashKey(countryCode, cityName));
-  if (index == m_cities.end()) {
+  auto index = m_cities.constFind(ServerCity::hashKey(countryCode, cityName));
+  if (index == m_cities.constEnd()) {
     static ServerCity emptycity;
     return emptycity;
   }
 
-  return *index;
+  return *m_citySlots.at(index.value());
 }
 
 const ServerCity& ServerCountryModel::findCity(const QString& countryCode,
                                                const QString& cityName) const {
   auto index = m_cities.constFind(ServerCity::hashKey(countryCode, cityName));
-  if (index == m_cities.end()) {
+  if (index == m_cities.constEnd()) {
     static const ServerCity emptycity;
     return emptycity;
   }
 
-  return *index;
+  return *m_citySlots.at(index.value());
 }
 
 const Server& ServerCountryModel::server(const QString& pubkey) const {
-  auto iterator = m_servers.constFind(pubkey);
-  if (iterator != m_servers.constEnd()) {
-    return iterator.value();
+  return server(serverId(pubkey));
+}
+
+const Server& ServerCountryModel::server(int id) const {
+  loadServers();
+
+  if ((id >= 0) && (id < m_servers.count())) {
+    return m_servers.at(id);
   }
 
   static const Server emptyserver;
   return emptyserver;
 }
 
+int ServerCountryModel::addServerId(const QString& pubkey) {
+  auto iterator = m_serverIds.constFind(pubkey);
+  if (iterator != m_serverIds.constEnd()) {
+    return iterator.value();
+  }
+
+  int id = static_cast<int>(m_serverKeys.count());
+  m_serverKeys.append(pubkey);
+  m_serverIds.insert(pubkey, id);
+  return id;
+}
+
+void ServerCountryModel::assignServerIds(QHash<QString, ServerCity>& cities) {
+  for (ServerCity& city : cities) {
+    QList<int> ids;
+    ids.reserve(city.servers().count());
+    for (const QString& pubkey : city.servers()) {
+      ids.append(addServerId(pubkey));
+    }
+    city.setServerIds(ids);
+  }
+}
+
 const QString ServerCountryModel::countryName(
     const QString& countryCode) const {
   for (const ServerCountry& country : m_countries) {
@@ -212,6 +604,9 @@ const QString ServerCountryModel::countryName(
 }
 
 void ServerCountryModel::retranslate() {
+  ServerCountry::clearLocalizedNames();
+  ServerCity::clearLocalizedNames();
+
   beginResetModel();
   sortCountries();
   endResetModel();
@@ -222,18 +617,24 @@ namespace {
 bool sortCountryCallback(const ServerCountry& a, const ServerCountry& b,
                          Collator* collator) {
   Q_ASSERT(collator);
-  return collator->compare(a.localizedName(), b.localizedName()) < 0;
+  int result = collator->compare(a.localizedName(), b.localizedName());
+  if (result != 0) {
+    return result < 0;
+  }
+  // Keep the order stable, so that updates can be matched row by row.
+  return a.code() < b.code();
 }
 
 }  // anonymous namespace
 
-void ServerCountryModel::sortCountries() {
+// static
+void ServerCountryModel::sortCountries(QList<ServerCountry>& countries) {
   Collator collator;
-  std::sort(m_countries.begin(), m_countries.end(),
+  std::sort(countries.begin(), countries.end(),
             std::bind(sortCountryCallback, std::placeholders::_1,
                       std::placeholders::_2, &collator));
 
-  for (ServerCountry& country : m_countries) {
+  for (ServerCountry& country : countries) {
     country.sortCities();
   }
 }
@@ -7,11 +7,15 @@
 
 #include <QAbstractListModel>
 #include <QByteArray>
+#include <QHash>
+#include <QList>
 #include <QObject>
+#include <QSet>
 
 #include "models/servercountry.h"
 
 class Location;
+class QFile;
 
 class ServerCountryModel final : public QAbstractListModel {
   Q_OBJECT
@@ -28,9 +32,19 @@ class ServerCountryModel final : public QAbstractListModel {
   ServerCountryModel();
   ~ServerCountryModel();
 
+  // Only the countries, cities and servers that differ from the current list
+  // are updated, with the matching row signals. The list is left unchanged if
+  // the data is invalid.
   [[nodiscard]] bool fromJson(const QByteArray& data);
 
-  bool initialized() const { return !m_rawJson.isEmpty(); }
+  // A binary snapshot of the parsed model, so that the JSON doesn't need to
+  // be parsed again on the next launch. The snapshot is only loaded if it was
+  // written from the same JSON.
+  [[nodiscard]] bool fromSnapshot(const QString& fileName,
+                                  const QByteArray& json);
+  bool writeSnapshot(const QString& fileName) const;
+
+  bool initialized() const { return !m_rawJsonHash.isEmpty(); }
 
   bool exists(const QString& countryCode, const QString& cityName) const;
   ServerCity& findCity(const QString& countryCode, const QString& cityName);
@@ -38,10 +52,43 @@ class ServerCountryModel final : public QAbstractListModel {
                              const QString& cityName) const;
 
   const Server& server(const QString& pubkey) const;
+  const Server& server(int id) const;
+
+  // Servers are also identified by a dense integer ID, assigned the first
+  // time their public key is seen. IDs are never reused, so data indexed by
+  // them stays valid when the list changes. serverId() returns -1 for
+  // unknown keys, addServerId() assigns a new ID to them.
+  int serverId(const QString& pubkey) const {
+    return m_serverIds.value(pubkey, -1);
+  }
+  int addServerId(const QString& pubkey);
+  QString publicKey(int id) const {
+    return ((id >= 0) && (id < m_serverKeys.count())) ? m_serverKeys.at(id)
+                                                       : QString();
+  }
+  qsizetype serverIdCount() const { return m_serverKeys.count(); }
 
   const QString countryName(const QString& countryCode) const;
 
-  const QHash<QString, ServerCity>& cities() const { return m_cities; }
+  // Cities keep their address for as long as the model exists, so pointers
+  // to them stay valid when the list is updated. A city that is removed from
+  // the list is reset, and its storage may be reused for a new city later.
+  const QList<ServerCity*>& cities() const { return m_cityList; }
+
+  // Identifies a city across updates of the list. Unlike a pointer, a handle
+  // doesn't resolve to another city if the storage is reused: city() returns
+  // nullptr once the city it was taken for is removed.
+  struct CityHandle {
+    int slot = -1;
+    quint32 generation = 0;
+  };
+  CityHandle cityHandle(const ServerCity& city) const;
+  ServerCity* city(const CityHandle& handle) const;
+
+  // The storage of the cities by slot, to index data about the cities in
+  // flat arrays. Unused slots hold a city that is not initialized.
+  qsizetype citySlotCount() const { return m_citySlots.count(); }
+  const ServerCity* citySlot(int slot) const { return m_citySlots.at(slot); }
 
   const QList<ServerCountry>& countries() const { return m_countries; }
 
@@ -63,14 +110,44 @@ class ServerCountryModel final : public QAbstractListModel {
  private:
   [[nodiscard]] bool fromJsonInternal(const QByteArray& data);
 
-  void sortCountries();
+  void updateModel(QList<ServerCountry>& countries,
+                   QHash<QString, ServerCity>& cities);
+  QSet<QString> updateCities(const QHash<QString, ServerCity>& cities);
+  int allocateCity(const ServerCity& city);
+  void releaseCity(int slot);
+  QList<const ServerCity*> cityList(const ServerCountry& country) const;
+
+  void sortCountries() { sortCountries(m_countries); }
+  static void sortCountries(QList<ServerCountry>& countries);
+  void assignServerIds(QHash<QString, ServerCity>& cities);
+  void loadServers() const;
+  void closeSnapshot() const;
+
+  static QByteArray hashJson(const QByteArray& json);
 
  private:
-  QByteArray m_rawJson;
+  QByteArray m_rawJsonHash;
 
   QList<ServerCountry> m_countries;
-  QHash<QString, ServerCity> m_cities;
-  QHash<QString, Server> m_servers;
+
+  // The cities are allocated in slots that are never freed, see cities().
+  // The generation of a slot is bumped every time its city is removed.
+  QList<ServerCity*> m_citySlots;
+  QList<quint32> m_cityGenerations;
+  QList<int> m_freeCitySlots;
+  // The slot of each city, by hash key.
+  QHash<QString, int> m_cities;
+  QList<ServerCity*> m_cityList;
+  // Indexed by server ID.
+  mutable QList<Server> m_servers;
+
+  QList<QString> m_serverKeys;
+  QHash<QString, int> m_serverIds;
+
+  // When loaded from a snapshot, the servers are only decoded from the
+  // memory mapped file once they are first needed.
+  mutable QFile* m_snapshot = nullptr;
+  mutable QByteArray m_snapshotServers;
 };
 
 #endif  // SERVERCOUNTRYMODEL_H
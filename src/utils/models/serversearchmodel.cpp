@@ -0,0 +1,214 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "serversearchmodel.h"
+
+#include "leakdetector.h"
+#include "models/servercity.h"
+#include "models/servercountrymodel.h"
+
+namespace {
+quint64 trigramKey(const QChar* text) {
+  return (static_cast<quint64>(text[0].unicode()) << 32) |
+         (static_cast<quint64>(text[1].unicode()) << 16) | text[2].unicode();
+}
+
+void addTrigrams(QHash<quint64, QList<int>>& index, const QString& name,
+                 int row) {
+  for (qsizetype i = 0; i + 3 <= name.size(); i++) {
+    QList<int>& rows = index[trigramKey(name.constData() + i)];
+    // Rows are indexed in order, so a duplicate can only be the last one.
+    if (rows.isEmpty() || (rows.last() != row)) {
+      rows.append(row);
+    }
+  }
+}
+}  // namespace
+
+ServerSearchModel::ServerSearchModel(QObject* parent)
+    : QSortFilterProxyModel(parent) {
+  MZ_COUNT_CTOR(ServerSearchModel);
+
+  connect(this, &QAbstractItemModel::rowsInserted, this,
+          &ServerSearchModel::countChanged);
+  connect(this, &QAbstractItemModel::rowsRemoved, this,
+          &ServerSearchModel::countChanged);
+  connect(this, &QAbstractItemModel::modelReset, this,
+          &ServerSearchModel::countChanged);
+  connect(this, &QAbstractItemModel::layoutChanged, this,
+          &ServerSearchModel::countChanged);
+}
+
+ServerSearchModel::~ServerSearchModel() { MZ_COUNT_DTOR(ServerSearchModel); }
+
+void ServerSearchModel::setSourceModel(QAbstractItemModel* model) {
+  for (const QMetaObject::Connection& connection : m_sourceConnections) {
+    disconnect(connection);
+  }
+  m_sourceConnections.clear();
+  invalidateIndex();
+
+  // These have to run before the proxy filters the changed rows again, so
+  // they are connected first.
+  if (model) {
+    m_sourceConnections = {
+        connect(model, &QAbstractItemModel::modelReset, this,
+                &ServerSearchModel::invalidateIndex),
+        connect(model, &QAbstractItemModel::rowsInserted, this,
+                &ServerSearchModel::invalidateIndex),
+        connect(model, &QAbstractItemModel::rowsRemoved, this,
+                &ServerSearchModel::invalidateIndex),
+        connect(model, &QAbstractItemModel::rowsMoved, this,
+                &ServerSearchModel::invalidateIndex),
+        connect(model, &QAbstractItemModel::dataChanged, this,
+                &ServerSearchModel::invalidateIndex),
+        connect(model, &QAbstractItemModel::layoutChanged, this,
+                &ServerSearchModel::invalidateIndex),
+    };
+  }
+
+  QSortFilterProxyModel::setSourceModel(model);
+}
+
+void ServerSearchModel::setQuery(const QString& query) {
+  if (m_query == query) {
+    return;
+  }
+  m_query = query;
+
+  QString normalized = normalize(query.trimmed());
+  if (normalized != m_matchedQuery) {
+    if (m_indexed) {
+      // Whatever contains the new query also contains the previous one.
+      bool narrow = !m_matchedQuery.isEmpty() &&
+                    normalized.startsWith(m_matchedQuery);
+      match(normalized, narrow);
+    } else {
+      m_matchedQuery = normalized;
+    }
+    invalidateFilter();
+  }
+
+  emit queryChanged();
+}
+
+// static
+QString ServerSearchModel::normalize(const QString& text) {
+  // Decompose the accented letters, and drop the accents.
+  QString decomposed = text.normalized(QString::NormalizationForm_KD);
+  QString result;
+  result.reserve(decomposed.size());
+  for (QChar c : decomposed) {
+    if (c.category() != QChar::Mark_NonSpacing) {
+      result.append(c);
+    }
+  }
+  return result.toCaseFolded();
+}
+
+bool ServerSearchModel::filterAcceptsRow(int sourceRow,
+                                         const QModelIndex&) const {
+  if (m_matchedQuery.isEmpty()) {
+    return true;
+  }
+
+  if (!m_indexed) {
+    buildIndex();
+  }
+
+  if ((sourceRow < m_matches.size()) && m_matches.testBit(sourceRow)) {
+    return true;
+  }
+  return m_codes.value(m_matchedQuery, -1) == sourceRow;
+}
+
+void ServerSearchModel::invalidateIndex() { m_indexed = false; }
+
+void ServerSearchModel::buildIndex() const {
+  m_names.clear();
+  m_codes.clear();
+  m_trigrams.clear();
+
+  QAbstractItemModel* model = sourceModel();
+  int rows = model ? model->rowCount() : 0;
+  for (int row = 0; row < rows; row++) {
+    QModelIndex index = model->index(row, 0);
+
+    QStringList names;
+    names.append(
+        normalize(index.data(ServerCountryModel::NameRole).toString()));
+    names.append(normalize(
+        index.data(ServerCountryModel::LocalizedNameRole).toString()));
+
+    const QList<QVariant> cities =
+        index.data(ServerCountryModel::CitiesRole).toList();
+    for (const QVariant& value : cities) {
+      const ServerCity* city = value.value<ServerCity*>();
+      if (city) {
+        names.append(normalize(city->name()));
+        names.append(normalize(city->localizedName()));
+      }
+    }
+    names.removeDuplicates();
+
+    for (const QString& name : names) {
+      addTrigrams(m_trigrams, name, row);
+    }
+    m_names.append(names);
+
+    QString code = index.data(ServerCountryModel::CodeRole).toString();
+    m_codes.insert(normalize(code), row);
+  }
+
+  m_indexed = true;
+  match(m_matchedQuery, false);
+}
+
+void ServerSearchModel::match(const QString& normalized, bool narrow) const {
+  QBitArray matches(m_names.count());
+  auto check = [&](int row) {
+    for (const QString& name : m_names.at(row)) {
+      if (name.contains(normalized)) {
+        matches.setBit(row);
+        return;
+      }
+    }
+  };
+
+  if (normalized.isEmpty()) {
+    // Everything matches, see filterAcceptsRow().
+  } else if (narrow) {
+    for (int row = 0; row < m_matches.size(); row++) {
+      if (m_matches.testBit(row)) {
+        check(row);
+      }
+    }
+  } else if (normalized.size() >= 3) {
+    // Only the countries with a name that has every trigram of the query can
+    // match, so the shortest list of them is enough to start from.
+    const QList<int>* candidates = nullptr;
+    for (qsizetype i = 0; i + 3 <= normalized.size(); i++) {
+      auto it = m_trigrams.constFind(trigramKey(normalized.constData() + i));
+      if (it == m_trigrams.constEnd()) {
+        candidates = nullptr;
+        break;
+      }
+      if (!candidates || (it->count() < candidates->count())) {
+        candidates = &it.value();
+      }
+    }
+    if (candidates) {
+      for (int row : *candidates) {
+        check(row);
+      }
+    }
+  } else {
+    for (int row = 0; row < m_names.count(); row++) {
+      check(row);
+    }
+  }
+
+  m_matches = matches;
+  m_matchedQuery = normalized;
+}
@@ -0,0 +1,73 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef SERVERSEARCHMODEL_H
+#define SERVERSEARCHMODEL_H
+
+#include <QBitArray>
+#include <QHash>
+#include <QList>
+#include <QSortFilterProxyModel>
+#include <QString>
+#include <QStringList>
+
+// Filters a ServerCountryModel down to the countries whose name, or the name
+// of one of their cities, contains the query. Names match in English and in
+// the current language, ignoring case and accents. A country also matches if
+// the query is its code.
+//
+// The normalized names are indexed by trigram when the source model changes,
+// so that typing a query doesn't go through the translator for every
+// country and city. When a keystroke extends the query, only the countries
+// that matched so far are checked again.
+class ServerSearchModel final : public QSortFilterProxyModel {
+  Q_OBJECT
+  Q_DISABLE_COPY_MOVE(ServerSearchModel)
+
+  Q_PROPERTY(QString query READ query WRITE setQuery NOTIFY queryChanged)
+  Q_PROPERTY(int count READ count NOTIFY countChanged)
+
+ public:
+  explicit ServerSearchModel(QObject* parent = nullptr);
+  ~ServerSearchModel();
+
+  const QString& query() const { return m_query; }
+  void setQuery(const QString& query);
+
+  int count() const { return rowCount(); }
+
+  void setSourceModel(QAbstractItemModel* sourceModel) override;
+
+  static QString normalize(const QString& text);
+
+ signals:
+  void queryChanged();
+  void countChanged();
+
+ protected:
+  bool filterAcceptsRow(int sourceRow,
+                        const QModelIndex& sourceParent) const override;
+
+ private:
+  void invalidateIndex();
+  void buildIndex() const;
+  void match(const QString& normalized, bool narrow) const;
+
+ private:
+  QString m_query;
+
+  // The query that m_matches was computed for, normalized.
+  mutable QString m_matchedQuery;
+  mutable QBitArray m_matches;
+
+  // The normalized names of each country and its cities, by source row.
+  mutable bool m_indexed = false;
+  mutable QList<QStringList> m_names;
+  mutable QHash<QString, int> m_codes;
+  mutable QHash<quint64, QList<int>> m_trigrams;
+
+  QList<QMetaObject::Connection> m_sourceConnections;
+};
+
+#endif  // SERVERSEARCHMODEL_H
@@ -152,6 +152,6 @@ void DnsPingSender::readData() {
     }
 
     logger.debug() << "Received valid DNS reply";
-    emit recvPing(qFromBigEndian<quint16>(header.id));
+    emit recvPing(qFromBigEndian<quint16>(header.id), monotonicTime());
   }
 }
@@ -21,5 +21,5 @@ DummyPingSender::~DummyPingSender() { MZ_COUNT_DTOR(DummyPingSender); }
 
 void DummyPingSender::sendPing(const QHostAddress& dest, quint16 sequence) {
   logger.debug() << "Dummy ping to:" << dest.toString();
-  emit recvPing(sequence);
+  emit recvPing(sequence, monotonicTime());
 }
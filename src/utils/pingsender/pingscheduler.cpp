@@ -0,0 +1,100 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "pingscheduler.h"
+
+#include <algorithm>
+
+#include "leakdetector.h"
+
+namespace {
+// Number of round trip times used to estimate the timeout.
+constexpr qsizetype PING_SCHEDULER_SAMPLES = 64;
+
+// Don't trust the percentiles until we have seen this many replies.
+constexpr qsizetype PING_SCHEDULER_MIN_SAMPLES = 8;
+
+// The timeout is this multiple of the 95th percentile round trip time.
+constexpr qint64 PING_SCHEDULER_TIMEOUT_FACTOR = 2;
+
+// The window starts small, and grows exponentially until the first loss.
+constexpr int PING_SCHEDULER_INITIAL_WINDOW = 16;
+}  // namespace
+
+PingScheduler::PingScheduler(int minWindow, int maxWindow, qint64 minTimeout,
+                             qint64 maxTimeout)
+    : m_minWindow(minWindow),
+      m_maxWindow(maxWindow),
+      m_minTimeout(minTimeout),
+      m_maxTimeout(maxTimeout) {
+  MZ_COUNT_CTOR(PingScheduler);
+  Q_ASSERT(minWindow > 0);
+  Q_ASSERT(minWindow <= maxWindow);
+  Q_ASSERT(minTimeout <= maxTimeout);
+  reset(maxWindow);
+}
+
+PingScheduler::~PingScheduler() { MZ_COUNT_DTOR(PingScheduler); }
+
+void PingScheduler::reset(int maxWindow) {
+  m_maxWindow = std::max(maxWindow, m_minWindow);
+  m_window = std::clamp(PING_SCHEDULER_INITIAL_WINDOW, m_minWindow,
+                        m_maxWindow);
+  m_threshold = m_maxWindow;
+  m_lastDecrease = 0;
+
+  m_samples.clear();
+  m_nextSample = 0;
+  m_timeoutValid = false;
+}
+
+qint64 PingScheduler::timeout() const {
+  if (m_timeoutValid) {
+    return m_timeout;
+  }
+
+  if (m_samples.count() < PING_SCHEDULER_MIN_SAMPLES) {
+    m_timeout = m_maxTimeout;
+  } else {
+    QVector<qint64> sorted(m_samples);
+    auto p95 = sorted.begin() + (sorted.count() * 95) / 100;
+    std::nth_element(sorted.begin(), p95, sorted.end());
+    m_timeout = std::clamp(*p95 * PING_SCHEDULER_TIMEOUT_FACTOR, m_minTimeout,
+                           m_maxTimeout);
+  }
+
+  m_timeoutValid = true;
+  return m_timeout;
+}
+
+void PingScheduler::pingReceived(qint64 rtt) {
+  if (m_samples.count() < PING_SCHEDULER_SAMPLES) {
+    m_samples.append(rtt);
+  } else {
+    m_samples[m_nextSample] = rtt;
+    m_nextSample = (m_nextSample + 1) % PING_SCHEDULER_SAMPLES;
+  }
+  m_timeoutValid = false;
+
+  // Grow by one ping per reply until we reach the threshold, and then by
+  // one ping per window.
+  if (m_window < m_threshold) {
+    m_window += 1.0;
+  } else {
+    m_window += 1.0 / m_window;
+  }
+  m_window = std::min(m_window, static_cast<double>(m_maxWindow));
+}
+
+void PingScheduler::pingTimeout(qint64 sendTime, qint64 now) {
+  // Pings sent before the last decrease were sent with the old window, and
+  // their loss has already been accounted for.
+  if (sendTime < m_lastDecrease) {
+    return;
+  }
+
+  m_window = std::max(m_window / 2, static_cast<double>(m_minWindow));
+  m_threshold = m_window;
+  m_lastDecrease = now;
+}
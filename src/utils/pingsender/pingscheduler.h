@@ -0,0 +1,51 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef PINGSCHEDULER_H
+#define PINGSCHEDULER_H
+
+#include <QVector>
+#include <QtGlobal>
+
+// Congestion control for bulk latency probes. The number of pings allowed in
+// flight grows while replies come back cleanly, and is halved whenever a ping
+// times out (additive-increase/multiplicative-decrease). The timeout for each
+// ping is derived from the distribution of recently observed round trip times
+// rather than being a fixed constant.
+//
+// All timestamps and durations are in milliseconds.
+class PingScheduler final {
+ public:
+  PingScheduler(int minWindow, int maxWindow, qint64 minTimeout,
+                qint64 maxTimeout);
+  ~PingScheduler();
+
+  void reset(int maxWindow);
+
+  // Number of pings that may be in flight at once.
+  int window() const { return static_cast<int>(m_window); }
+
+  // How long to wait for a reply before declaring a ping lost.
+  qint64 timeout() const;
+
+  void pingReceived(qint64 rtt);
+  void pingTimeout(qint64 sendTime, qint64 now);
+
+ private:
+  const int m_minWindow;
+  int m_maxWindow;
+  const qint64 m_minTimeout;
+  const qint64 m_maxTimeout;
+
+  double m_window = 0;
+  double m_threshold = 0;
+  qint64 m_lastDecrease = 0;
+
+  QVector<qint64> m_samples;
+  qsizetype m_nextSample = 0;
+  mutable qint64 m_timeout = 0;
+  mutable bool m_timeoutValid = false;
+};
+
+#endif  // PINGSCHEDULER_H
@@ -4,12 +4,26 @@
 
 #include "pingsender.h"
 
+#include <chrono>
+
 #include "logger.h"
 
 namespace {
 Logger logger("PingSender");
 }
 
+// static
+qint64 PingSender::monotonicTime() {
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+void PingSender::sendPings(const QList<PingRequest>& requests) {
+  for (const PingRequest& request : requests) {
+    sendPing(request.destination, request.sequence);
+  }
+}
+
 quint16 PingSender::inetChecksum(const void* data, size_t len) {
   int nleft, sum;
   quint16* w;
@@ -7,6 +7,7 @@
 
 #include <QElapsedTimer>
 #include <QHostAddress>
+#include <QList>
 #include <QObject>
 
 class PingSender : public QObject {
@@ -21,10 +22,33 @@ class PingSender : public QObject {
 
   virtual void sendPing(const QHostAddress& destination, quint16 sequence) = 0;
 
+  struct PingRequest {
+    QHostAddress destination;
+    quint16 sequence;
+  };
+
+  // Send a batch of pings in one go. Platforms that can submit several
+  // packets with a single system call should override this, the default
+  // implementation just sends them one at a time.
+  virtual void sendPings(const QList<PingRequest>& requests);
+
+  // The number of pings that may be in flight at once. Senders that share
+  // their reply buffers between outstanding pings must keep this low.
+  virtual int maxInFlight() const { return 8; }
+
   static quint16 inetChecksum(const void* data, size_t length);
 
+  // Monotonic clock used to timestamp pings, in microseconds.
+  static qint64 monotonicTime();
+
+  // Round a duration in microseconds to the nearest millisecond.
+  static qint64 toMsec(qint64 usec) {
+    return (usec >= 0) ? (usec + 500) / 1000 : (usec - 500) / 1000;
+  }
+
  signals:
-  void recvPing(quint16 sequence);
+  // The timestamp is when the reply was received, as per monotonicTime().
+  void recvPing(quint16 sequence, qint64 timestamp);
   void criticalPingError();
 };
 
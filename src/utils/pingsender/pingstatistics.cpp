@@ -0,0 +1,66 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "pingstatistics.h"
+
+#include <QDataStream>
+#include <algorithm>
+#include <cmath>
+
+#include "pingsender.h"
+
+namespace {
+// Weight of a new sample in the moving averages (RFC 6298).
+constexpr float PING_STATISTICS_LATENCY_GAIN = 1.0f / 8;
+constexpr float PING_STATISTICS_JITTER_GAIN = 1.0f / 4;
+
+// Packet loss is a plain average over the first few probes, and a moving
+// average after that, so the ratio is meaningful from the very first probe.
+constexpr quint32 PING_STATISTICS_LOSS_WINDOW = 8;
+
+float lossGain(quint32 probes) {
+  return 1.0f / std::min(probes, PING_STATISTICS_LOSS_WINDOW);
+}
+}  // namespace
+
+void PingStatistics::addSample(qint64 rttUsec) {
+  float sample = std::max<qint64>(rttUsec, 1);
+  if (m_latency <= 0) {
+    m_latency = sample;
+    m_jitter = 0;
+  } else {
+    float delta = sample - m_latency;
+    m_jitter += (std::abs(delta) - m_jitter) * PING_STATISTICS_JITTER_GAIN;
+    m_latency += delta * PING_STATISTICS_LATENCY_GAIN;
+  }
+
+  m_probes++;
+  m_packetLoss -= m_packetLoss * lossGain(m_probes);
+}
+
+void PingStatistics::addLoss() {
+  m_probes++;
+  m_packetLoss += (1.0f - m_packetLoss) * lossGain(m_probes);
+}
+
+qint64 PingStatistics::latency() const {
+  if (m_latency <= 0) {
+    return 0;
+  }
+  return std::max<qint64>(PingSender::toMsec(qRound64(m_latency)), 1);
+}
+
+qint64 PingStatistics::jitter() const {
+  return PingSender::toMsec(qRound64(m_jitter));
+}
+
+QDataStream& operator<<(QDataStream& stream, const PingStatistics& stats) {
+  return stream << stats.m_latency << stats.m_jitter << stats.m_packetLoss
+                << stats.m_probes;
+}
+
+QDataStream& operator>>(QDataStream& stream, PingStatistics& stats) {
+  return stream >> stats.m_latency >> stats.m_jitter >> stats.m_packetLoss >>
+         stats.m_probes;
+}
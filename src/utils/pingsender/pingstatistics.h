@@ -0,0 +1,46 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef PINGSTATISTICS_H
+#define PINGSTATISTICS_H
+
+#include <QtGlobal>
+
+class QDataStream;
+
+// Running statistics for the pings sent to a single server. Latency and jitter
+// are exponentially weighted moving averages, so that one unlucky probe does
+// not define the result, while still following a server whose latency really
+// changes. Jitter is the mean deviation of the round trip time from the
+// average, as used by TCP to estimate its retransmission timeout.
+//
+// Samples are recorded in microseconds, as timestamped by the ping senders,
+// and the averages keep that precision. The getters return milliseconds.
+class PingStatistics final {
+ public:
+  void addSample(qint64 rttUsec);
+  void addLoss();
+
+  // Number of probes sent to the server, whether or not they were answered.
+  quint32 probes() const { return m_probes; }
+
+  // Average round trip time, or zero if the server has never replied.
+  qint64 latency() const;
+  qint64 jitter() const;
+
+  // Fraction of probes that went unanswered, from 0.0 to 1.0.
+  double packetLoss() const { return m_packetLoss; }
+
+ private:
+  float m_latency = 0;
+  float m_jitter = 0;
+  float m_packetLoss = 0;
+  quint32 m_probes = 0;
+
+  friend QDataStream& operator<<(QDataStream& stream,
+                                 const PingStatistics& stats);
+  friend QDataStream& operator>>(QDataStream& stream, PingStatistics& stats);
+};
+
+#endif  // PINGSTATISTICS_H
@@ -0,0 +1,198 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef PINGTRACKER_H
+#define PINGTRACKER_H
+
+#include <QList>
+#include <QVector>
+#include <QtGlobal>
+#include <algorithm>
+
+// Bookkeeping for pings in flight, with constant time operations regardless
+// of how many pings are outstanding.
+//
+// Pings are stored in a fixed size table, and the sequence number sent on the
+// wire encodes the index into that table, so replies are matched with a
+// single lookup. The upper bits of the sequence number count how many times
+// the table entry has been reused, so a late reply is not mistaken for a new
+// ping that happens to occupy the same entry.
+//
+// Deadlines are kept in a hashed timer wheel: a ring of buckets that each
+// hold the pings expiring during one tick. Finding the expired pings only
+// walks the buckets for the ticks that have elapsed.
+template <typename T>
+class PingTracker final {
+ public:
+  // Number of pings that can be in flight at once.
+  static constexpr int CAPACITY_BITS = 10;
+  static constexpr int CAPACITY = 1 << CAPACITY_BITS;
+
+  // The tick is the resolution of the timer wheel, in the same units as the
+  // deadlines. Pings may expire up to one tick late.
+  explicit PingTracker(qint64 tick, int wheelSize = 1024)
+      : m_tick(tick), m_wheel(wheelSize, -1), m_entries(CAPACITY) {
+    Q_ASSERT(tick > 0);
+    Q_ASSERT(wheelSize > 0);
+    clear();
+  }
+
+  void clear() {
+    m_free.clear();
+    m_free.reserve(CAPACITY);
+    for (int i = CAPACITY - 1; i >= 0; i--) {
+      m_entries[i].used = false;
+      m_entries[i].record = T();
+      m_free.append(i);
+    }
+    m_wheel.fill(-1);
+    m_wheelTick = -1;
+  }
+
+  qsizetype count() const { return CAPACITY - m_free.count(); }
+  bool isEmpty() const { return count() == 0; }
+  bool isFull() const { return m_free.isEmpty(); }
+
+  // Track a new ping, returning the sequence number to send it with. The
+  // tracker must not be full.
+  quint16 insert(const T& record, qint64 deadline) {
+    Q_ASSERT(!isFull());
+    int index = m_free.takeLast();
+    Entry& entry = m_entries[index];
+    entry.generation++;
+    entry.sequence = static_cast<quint16>((entry.generation << CAPACITY_BITS) |
+                                          static_cast<quint16>(index));
+    entry.record = record;
+    entry.deadline = deadline;
+    entry.used = true;
+
+    // The wheel starts at the earliest deadline we know of.
+    qint64 tick = deadline / m_tick;
+    if ((m_wheelTick < 0) || (tick < m_wheelTick)) {
+      m_wheelTick = tick;
+    }
+    link(index, bucket(tick));
+    return entry.sequence;
+  }
+
+  // Stop tracking the ping with this sequence number. Returns false if it is
+  // not in flight, for example because it has already expired.
+  bool take(quint16 sequence, T* record = nullptr) {
+    int index = sequence & (CAPACITY - 1);
+    Entry& entry = m_entries[index];
+    if (!entry.used || (entry.sequence != sequence)) {
+      return false;
+    }
+    if (record) {
+      *record = std::move(entry.record);
+    }
+    release(index);
+    return true;
+  }
+
+  // Stop tracking and return every ping whose deadline has passed.
+  QList<T> expire(qint64 now) {
+    QList<T> expired;
+    if (m_wheelTick < 0) {
+      return expired;
+    }
+
+    // Walk the buckets for each tick that has elapsed. If we have fallen
+    // more than a full revolution behind, every bucket gets visited once.
+    qint64 nowTick = now / m_tick;
+    qint64 ticks = std::min<qint64>(nowTick - m_wheelTick + 1, m_wheel.count());
+    for (qint64 t = 0; t < ticks; t++) {
+      int index = m_wheel[bucket(m_wheelTick + t)];
+      while (index >= 0) {
+        int next = m_entries[index].next;
+        if (m_entries[index].deadline <= now) {
+          expired.append(std::move(m_entries[index].record));
+          release(index);
+        }
+        index = next;
+      }
+    }
+
+    m_wheelTick = std::max(m_wheelTick, nowTick);
+    return expired;
+  }
+
+  // The earliest deadline of the pings in flight, rounded up to the end of
+  // its tick, or -1 if there are none.
+  qint64 nextDeadline() const {
+    if (isEmpty()) {
+      return -1;
+    }
+
+    qint64 next = -1;
+    for (qint64 t = 0; t < m_wheel.count(); t++) {
+      for (int index = m_wheel[bucket(m_wheelTick + t)]; index >= 0;
+           index = m_entries[index].next) {
+        qint64 deadline = m_entries[index].deadline;
+        if ((next < 0) || (deadline < next)) {
+          next = deadline;
+        }
+      }
+      // Deadlines beyond the first occupied bucket can only be later, unless
+      // they belong to a future revolution of the wheel.
+      if ((next >= 0) && (next / m_tick <= m_wheelTick + t)) {
+        break;
+      }
+    }
+    return ((next / m_tick) + 1) * m_tick;
+  }
+
+ private:
+  struct Entry {
+    T record;
+    qint64 deadline = 0;
+    quint16 sequence = 0;
+    quint16 generation = 0;
+    bool used = false;
+    int bucket = -1;
+    int prev = -1;
+    int next = -1;
+  };
+
+  int bucket(qint64 tick) const {
+    return static_cast<int>(tick % m_wheel.count());
+  }
+
+  void link(int index, int bucket) {
+    Entry& entry = m_entries[index];
+    entry.bucket = bucket;
+    entry.prev = -1;
+    entry.next = m_wheel[bucket];
+    if (entry.next >= 0) {
+      m_entries[entry.next].prev = index;
+    }
+    m_wheel[bucket] = index;
+  }
+
+  void release(int index) {
+    Entry& entry = m_entries[index];
+    if (entry.prev >= 0) {
+      m_entries[entry.prev].next = entry.next;
+    } else {
+      m_wheel[entry.bucket] = entry.next;
+    }
+    if (entry.next >= 0) {
+      m_entries[entry.next].prev = entry.prev;
+    }
+    entry.used = false;
+    entry.record = T();
+    entry.bucket = entry.prev = entry.next = -1;
+    m_free.append(index);
+  }
+
+ private:
+  const qint64 m_tick;
+  QVector<int> m_wheel;
+  qint64 m_wheelTick = -1;
+
+  QVector<Entry> m_entries;
+  QVector<int> m_free;
+};
+
+#endif  // PINGTRACKER_H
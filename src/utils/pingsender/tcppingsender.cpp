@@ -4,19 +4,111 @@
 
 #include "tcppingsender.h"
 
+#if defined(MZ_LINUX) || defined(MZ_ANDROID)
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <netinet/in.h>
+#  include <netinet/tcp.h>
+#  include <string.h>
+#  include <sys/epoll.h>
+#  include <sys/socket.h>
+#  include <unistd.h>
+
+#  include <QSocketNotifier>
+#  include <QtEndian>
+#endif
+
 #include <QTcpSocket>
+#include <algorithm>
 
 #include "leakdetector.h"
+#include "logger.h"
+
+namespace {
+Logger logger("TcpPingSender");
+
+#if defined(MZ_LINUX) || defined(MZ_ANDROID)
+// Maximum number of events to drain with a single system call.
+constexpr int TCP_PING_EPOLL_EVENTS = 64;
+
+// Connections still pending after this long are abandoned, so that unanswered
+// probes don't hold on to file descriptors until the kernel gives up.
+constexpr qint64 TCP_PING_EXPIRE_USEC = 10 * 1000 * 1000;
+constexpr int TCP_PING_EXPIRE_INTERVAL_MSEC = 1000;
+
+// Number of SYN retransmissions before the kernel gives up. Retries are
+// handled by the caller, and we don't want them to skew the measurement.
+constexpr int TCP_PING_SYN_COUNT = 1;
+
+socklen_t prepareAddress(const QHostAddress& address, quint16 port,
+                         struct sockaddr_storage* addr) {
+  memset(addr, 0, sizeof(struct sockaddr_storage));
+  if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+    struct sockaddr_in6* sin6 = reinterpret_cast<struct sockaddr_in6*>(addr);
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_port = htons(port);
+    Q_IPV6ADDR qaddr = address.toIPv6Address();
+    memcpy(&sin6->sin6_addr, &qaddr, sizeof(sin6->sin6_addr));
+    return sizeof(struct sockaddr_in6);
+  }
+  if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+    struct sockaddr_in* sin = reinterpret_cast<struct sockaddr_in*>(addr);
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(port);
+    sin->sin_addr.s_addr = qToBigEndian<quint32>(address.toIPv4Address());
+    return sizeof(struct sockaddr_in);
+  }
+  return 0;
+}
+#endif
+}  // namespace
 
 TcpPingSender::TcpPingSender(const QHostAddress& source, quint16 port,
                              QObject* parent)
     : PingSender(parent), m_source(source), m_port(port) {
   MZ_COUNT_CTOR(TcpPingSender);
+
+#if defined(MZ_LINUX) || defined(MZ_ANDROID)
+  m_epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (m_epoll < 0) {
+    logger.warning() << "Failed to create epoll instance:" << strerror(errno);
+    return;
+  }
+
+  // The epoll instance becomes readable whenever any of the sockets in it are
+  // ready, so a single notifier serves every probe.
+  m_notifier = new QSocketNotifier(m_epoll, QSocketNotifier::Read, this);
+  connect(m_notifier, &QSocketNotifier::activated, this,
+          &TcpPingSender::epollReady);
+
+  m_expireTimer.setInterval(TCP_PING_EXPIRE_INTERVAL_MSEC);
+  connect(&m_expireTimer, &QTimer::timeout, this,
+          &TcpPingSender::expireSockets);
+#endif
 }
 
-TcpPingSender::~TcpPingSender() { MZ_COUNT_DTOR(TcpPingSender); }
+TcpPingSender::~TcpPingSender() {
+  MZ_COUNT_DTOR(TcpPingSender);
+
+#if defined(MZ_LINUX) || defined(MZ_ANDROID)
+  for (int fd : m_pending.keys()) {
+    closeSocket(fd);
+  }
+  if (m_epoll >= 0) {
+    close(m_epoll);
+  }
+#endif
+}
 
 void TcpPingSender::sendPing(const QHostAddress& dest, quint16 sequence) {
+  if (isNative() && sendNativePing(dest, sequence)) {
+    return;
+  }
+  sendSocketPing(dest, sequence);
+}
+
+void TcpPingSender::sendSocketPing(const QHostAddress& dest,
+                                   quint16 sequence) {
   QTcpSocket* socket = new QTcpSocket(this);
   if (!m_source.isNull()) {
     socket->bind(m_source);
@@ -24,7 +116,7 @@ void TcpPingSender::sendPing(const QHostAddress& dest, quint16 sequence) {
 
   // Consider the ping to be recieved once the TCP handshake is complete.
   connect(socket, &QAbstractSocket::connected, this,
-          [this, sequence] { emit recvPing(sequence); });
+          [this, sequence] { emit recvPing(sequence, monotonicTime()); });
 
   // Cleanup the socket upon completion.
   connect(socket, &QAbstractSocket::connected, socket, &QObject::deleteLater);
@@ -36,3 +128,135 @@ void TcpPingSender::sendPing(const QHostAddress& dest, quint16 sequence) {
   // Try to connect
   socket->connectToHost(dest, m_port);
 }
+
+#if defined(MZ_LINUX) || defined(MZ_ANDROID)
+bool TcpPingSender::sendNativePing(const QHostAddress& dest,
+                                   quint16 sequence) {
+  struct sockaddr_storage addr;
+  socklen_t addrlen = prepareAddress(dest, m_port, &addr);
+  if (addrlen == 0) {
+    return false;
+  }
+
+  int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                  IPPROTO_TCP);
+  if (fd < 0) {
+    logger.warning() << "Failed to create socket:" << strerror(errno);
+    return false;
+  }
+
+  // Reset the connection when it is closed, rather than leaving thousands of
+  // sockets behind in TIME_WAIT after a sweep.
+  struct linger linger = {1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+  int syncnt = TCP_PING_SYN_COUNT;
+  setsockopt(fd, IPPROTO_TCP, TCP_SYNCNT, &syncnt, sizeof(syncnt));
+
+  if (!m_source.isNull()) {
+    struct sockaddr_storage source;
+    socklen_t sourcelen = prepareAddress(m_source, 0, &source);
+    if ((sourcelen == 0) ||
+        (bind(fd, reinterpret_cast<struct sockaddr*>(&source), sourcelen) !=
+         0)) {
+      // The destination is probably of another address family.
+      close(fd);
+      return false;
+    }
+  }
+
+  qint64 timestamp = monotonicTime();
+  if ((connect(fd, reinterpret_cast<struct sockaddr*>(&addr), addrlen) != 0) &&
+      (errno != EINPROGRESS)) {
+    logger.debug() << "Failed to connect:" << strerror(errno);
+    close(fd);
+    return true;
+  }
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLOUT | EPOLLONESHOT;
+  event.data.fd = fd;
+  if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+    logger.warning() << "Failed to watch socket:" << strerror(errno);
+    close(fd);
+    return false;
+  }
+
+  m_pending.insert(fd, {sequence, timestamp});
+  if (!m_expireTimer.isActive()) {
+    m_expireTimer.start();
+  }
+  return true;
+}
+
+void TcpPingSender::epollReady() {
+  struct epoll_event events[TCP_PING_EPOLL_EVENTS];
+  for (;;) {
+    int count = epoll_wait(m_epoll, events, TCP_PING_EPOLL_EVENTS, 0);
+    if (count <= 0) {
+      return;
+    }
+
+    for (int i = 0; i < count; i++) {
+      int fd = events[i].data.fd;
+      auto pending = m_pending.constFind(fd);
+      if (pending == m_pending.constEnd()) {
+        continue;
+      }
+      PendingSocket socket = pending.value();
+
+      // Failed connections, such as a refusal, don't count as a reply.
+      int error = 0;
+      socklen_t errlen = sizeof(error);
+      if ((getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errlen) != 0) ||
+          (error != 0)) {
+        closeSocket(fd);
+        continue;
+      }
+
+      // The smoothed round trip time only has the handshake to go on, so it
+      // is exactly the time taken for our SYN to be answered.
+      struct tcp_info info;
+      socklen_t infolen = sizeof(info);
+      qint64 received = monotonicTime();
+      if ((getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &infolen) == 0) &&
+          (info.tcpi_rtt > 0)) {
+        received = std::min<qint64>(received,
+                                    socket.timestamp + info.tcpi_rtt);
+      }
+      closeSocket(fd);
+      emit recvPing(socket.sequence, received);
+    }
+
+    if (count < TCP_PING_EPOLL_EVENTS) {
+      return;
+    }
+  }
+}
+
+void TcpPingSender::closeSocket(int fd) {
+  epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  m_pending.remove(fd);
+  if (m_pending.isEmpty()) {
+    m_expireTimer.stop();
+  }
+}
+
+void TcpPingSender::expireSockets() {
+  qint64 expired = monotonicTime() - TCP_PING_EXPIRE_USEC;
+  for (int fd : m_pending.keys()) {
+    if (m_pending.value(fd).timestamp < expired) {
+      closeSocket(fd);
+    }
+  }
+}
+#else
+bool TcpPingSender::sendNativePing(const QHostAddress&, quint16) {
+  return false;
+}
+
+void TcpPingSender::epollReady() {}
+void TcpPingSender::closeSocket(int) {}
+void TcpPingSender::expireSockets() {}
+#endif
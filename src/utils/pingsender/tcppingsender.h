@@ -5,8 +5,21 @@
 #ifndef TCPPINGSENDER_H
 #define TCPPINGSENDER_H
 
+#include <QHash>
+#include <QTimer>
+
 #include "pingsender.h"
 
+class QSocketNotifier;
+
+// Measures latency using the time taken to complete a TCP handshake, for
+// platforms where ICMP sockets are not available.
+//
+// On Linux and Android, the connections are made with non-blocking sockets
+// that share a single epoll instance, and the round trip time is read from
+// the kernel with TCP_INFO. This allows many probes to be in flight at once,
+// and isn't skewed by delays in the event loop. Elsewhere, each probe uses a
+// QTcpSocket and is timed when the connection is reported.
 class TcpPingSender final : public PingSender {
   Q_OBJECT
   Q_DISABLE_COPY_MOVE(TcpPingSender)
@@ -17,10 +30,34 @@ class TcpPingSender final : public PingSender {
   ~TcpPingSender();
 
   void sendPing(const QHostAddress& dest, quint16 sequence) override;
+  // Each probe costs a socket, and even more so through QTcpSocket.
+  int maxInFlight() const override { return isNative() ? 64 : 16; }
+
+  // True if probes are sent using the kernel's sockets directly, and many of
+  // them may be in flight at once.
+  bool isNative() const { return m_epoll >= 0; }
+
+ private:
+  void sendSocketPing(const QHostAddress& dest, quint16 sequence);
+  bool sendNativePing(const QHostAddress& dest, quint16 sequence);
+  void epollReady();
+  void closeSocket(int fd);
+  void expireSockets();
 
  private:
   QHostAddress m_source;
   quint16 m_port;
+
+  struct PendingSocket {
+    quint16 sequence;
+    qint64 timestamp;
+  };
+  int m_epoll = -1;
+#if defined(MZ_LINUX) || defined(MZ_ANDROID)
+  QSocketNotifier* m_notifier = nullptr;
+#endif
+  QHash<int, PendingSocket> m_pending;
+  QTimer m_expireTimer;
 };
 
-#endif  // DNSPINGSENDER_H
+#endif  // TCPPINGSENDER_H
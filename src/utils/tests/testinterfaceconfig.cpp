@@ -0,0 +1,122 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testinterfaceconfig.h"
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QtTest/QtTest>
+
+#include "interfaceconfig.h"
+
+namespace {
+QJsonObject validCandidate() {
+  QJsonObject obj;
+  obj["serverPublicKey"] = "key";
+  obj["serverIpv4AddrIn"] = "1.2.3.4";
+  obj["serverIpv6AddrIn"] = "2001:db8::1";
+  obj["serverPort"] = 51820;
+  obj["obfuscationMethod"] = "LWO";
+  obj["lwoVersion"] = 2;
+  return obj;
+}
+}  // namespace
+
+void TestInterfaceConfig::candidateRoundTrip() {
+  InterfaceConfig::Candidate candidate;
+  candidate.m_serverPublicKey = "key";
+  candidate.m_serverIpv4AddrIn = "1.2.3.4";
+  candidate.m_serverIpv6AddrIn = "2001:db8::1";
+  candidate.m_serverPort = 53;
+  candidate.m_obfuscationMethod = Server::ObfuscationMethod::LWO;
+  candidate.m_lwoVersion = 2;
+
+  InterfaceConfig::Candidate parsed;
+  QVERIFY(parsed.fromJson(candidate.toJson()));
+  QCOMPARE(parsed.m_serverPublicKey, candidate.m_serverPublicKey);
+  QCOMPARE(parsed.m_serverIpv4AddrIn, candidate.m_serverIpv4AddrIn);
+  QCOMPARE(parsed.m_serverIpv6AddrIn, candidate.m_serverIpv6AddrIn);
+  QCOMPARE(parsed.m_serverPort, candidate.m_serverPort);
+  QCOMPARE(parsed.m_obfuscationMethod, candidate.m_obfuscationMethod);
+  QCOMPARE(parsed.m_lwoVersion, candidate.m_lwoVersion);
+}
+
+void TestInterfaceConfig::candidateDefaults() {
+  QJsonObject obj = validCandidate();
+  obj.remove("obfuscationMethod");
+  obj.remove("lwoVersion");
+  obj.remove("serverIpv6AddrIn");
+
+  InterfaceConfig::Candidate candidate;
+  QVERIFY(candidate.fromJson(obj));
+  QCOMPARE(candidate.m_obfuscationMethod,
+           Server::ObfuscationMethod::NoObfuscation);
+  QCOMPARE(candidate.m_lwoVersion, 1);
+  QVERIFY(candidate.m_serverIpv6AddrIn.isEmpty());
+}
+
+void TestInterfaceConfig::candidateInvalid_data() {
+  QTest::addColumn<QJsonObject>("json");
+
+  QJsonObject obj = validCandidate();
+  obj.remove("serverPublicKey");
+  QTest::addRow("no public key") << obj;
+
+  obj = validCandidate();
+  obj.remove("serverIpv4AddrIn");
+  obj.remove("serverIpv6AddrIn");
+  QTest::addRow("no address") << obj;
+
+  obj = validCandidate();
+  obj.remove("serverPort");
+  QTest::addRow("no port") << obj;
+
+  obj = validCandidate();
+  obj["serverPort"] = -1;
+  QTest::addRow("negative port") << obj;
+
+  obj = validCandidate();
+  obj["obfuscationMethod"] = "Carrier pigeon";
+  QTest::addRow("unknown obfuscation") << obj;
+
+  obj = validCandidate();
+  obj["obfuscationMethod"] = 1;
+  QTest::addRow("numeric obfuscation") << obj;
+
+  obj = validCandidate();
+  obj["lwoVersion"] = 0;
+  QTest::addRow("lwoVersion 0") << obj;
+
+  obj = validCandidate();
+  obj["lwoVersion"] = 3;
+  QTest::addRow("lwoVersion 3") << obj;
+
+  QTest::addRow("empty") << QJsonObject();
+}
+
+void TestInterfaceConfig::candidateInvalid() {
+  QFETCH(QJsonObject, json);
+
+  InterfaceConfig::Candidate candidate;
+  QVERIFY(!candidate.fromJson(json));
+}
+
+void TestInterfaceConfig::candidatesToJson() {
+  InterfaceConfig config;
+  config.m_hopType = InterfaceConfig::SingleHop;
+  config.m_obfuscationMethod = Server::ObfuscationMethod::NoObfuscation;
+  QVERIFY(!config.toJson().contains("candidates"));
+
+  InterfaceConfig::Candidate candidate;
+  QVERIFY(candidate.fromJson(validCandidate()));
+  config.m_candidates.append(candidate);
+  QVERIFY(config.hasPeer("key"));
+
+  QJsonArray candidates = config.toJson().value("candidates").toArray();
+  QCOMPARE(candidates.count(), 1);
+  QJsonObject obj = candidates.at(0).toObject();
+  QCOMPARE(obj.value("serverPublicKey").toString(), "key");
+  QCOMPARE(obj.value("obfuscationMethod").toString(), "LWO");
+  QCOMPARE(obj.value("lwoVersion").toInt(), 2);
+}
@@ -0,0 +1,21 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <QObject>
+
+#include "testhelper.h"
+
+class TestInterfaceConfig final : public QObject,
+                                  TestHelper<TestInterfaceConfig> {
+  Q_OBJECT
+
+ private slots:
+  void candidateRoundTrip();
+  void candidateDefaults();
+
+  void candidateInvalid_data();
+  void candidateInvalid();
+
+  void candidatesToJson();
+};
@@ -0,0 +1,192 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testjsonreader.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtTest/QtTest>
+
+#include "jsonreader.h"
+
+namespace {
+// Rebuild the value the reader is positioned on, to compare the reader with
+// QJsonDocument.
+bool readValue(JsonReader& reader, QJsonValue& value) {
+  switch (reader.tokenType()) {
+    case JsonReader::BeginObject: {
+      QJsonObject obj;
+      while (reader.readNextMember()) {
+        QString key = QString::fromUtf8(reader.key());
+        QJsonValue member;
+        if (!readValue(reader, member)) {
+          return false;
+        }
+        obj.insert(key, member);
+      }
+      value = obj;
+      return !reader.hasError();
+    }
+
+    case JsonReader::BeginArray: {
+      QJsonArray array;
+      while (reader.readNextElement()) {
+        QJsonValue element;
+        if (!readValue(reader, element)) {
+          return false;
+        }
+        array.append(element);
+      }
+      value = array;
+      return !reader.hasError();
+    }
+
+    case JsonReader::String:
+      value = reader.string();
+      return true;
+
+    case JsonReader::Number:
+      value = reader.number();
+      return true;
+
+    case JsonReader::Bool:
+      value = reader.boolean();
+      return true;
+
+    case JsonReader::Null:
+      value = QJsonValue(QJsonValue::Null);
+      return true;
+
+    default:
+      return false;
+  }
+}
+}  // namespace
+
+void TestJsonReader::parse_data() {
+  QTest::addColumn<QByteArray>("json");
+  QTest::addColumn<bool>("valid");
+
+  QTest::addRow("empty") << QByteArray() << false;
+  QTest::addRow("whitespace") << QByteArray(" \n\t ") << false;
+  QTest::addRow("empty object") << QByteArray("{}") << true;
+  QTest::addRow("empty array") << QByteArray(" [ ] ") << true;
+  QTest::addRow("members")
+      << QByteArray(R"({"a": 1, "b": "two", "c": true, "d": null})") << true;
+  QTest::addRow("nested")
+      << QByteArray(R"({"a": [{"b": [[], {}]}, [1, [2, [3]]]], "c": {}})")
+      << true;
+  QTest::addRow("numbers")
+      << QByteArray("[0, -0, 1.5, -12.25e2, 3E-2, 1e+3, 42]") << true;
+
+  QTest::addRow("unterminated object") << QByteArray(R"({"a": 1)") << false;
+  QTest::addRow("unterminated array") << QByteArray("[1, 2") << false;
+  QTest::addRow("unterminated string") << QByteArray(R"(["abc])") << false;
+  QTest::addRow("trailing comma object")
+      << QByteArray(R"({"a": 1,})") << false;
+  QTest::addRow("trailing comma array") << QByteArray("[1,]") << false;
+  QTest::addRow("leading comma") << QByteArray("[,1]") << false;
+  QTest::addRow("missing comma") << QByteArray("[1 2]") << false;
+  QTest::addRow("missing colon") << QByteArray(R"({"a" 1})") << false;
+  QTest::addRow("missing value") << QByteArray(R"({"a":})") << false;
+  QTest::addRow("unquoted key") << QByteArray("{a: 1}") << false;
+  QTest::addRow("mismatched") << QByteArray("[1}") << false;
+  QTest::addRow("leading zero") << QByteArray("[01]") << false;
+  QTest::addRow("bare fraction") << QByteArray("[.5]") << false;
+  QTest::addRow("empty fraction") << QByteArray("[1.]") << false;
+  QTest::addRow("empty exponent") << QByteArray("[1e]") << false;
+  QTest::addRow("bad literal") << QByteArray("[tru]") << false;
+  QTest::addRow("bad escape") << QByteArray(R"(["\x"])") << false;
+  QTest::addRow("control character") << QByteArray("[\"a\tb\"]") << false;
+  QTest::addRow("trailing garbage") << QByteArray("{} x") << false;
+  QTest::addRow("two documents") << QByteArray("{}{}") << false;
+}
+
+void TestJsonReader::parse() {
+  QFETCH(QByteArray, json);
+  QFETCH(bool, valid);
+
+  JsonReader reader(json);
+  reader.readNext();
+  QJsonValue value;
+  bool result = readValue(reader, value) &&
+                (reader.readNext() == JsonReader::EndDocument);
+  QCOMPARE(result, valid);
+  if (!valid) {
+    QVERIFY(reader.hasError());
+    return;
+  }
+
+  QJsonParseError error;
+  QJsonDocument doc = QJsonDocument::fromJson(json, &error);
+  QCOMPARE(error.error, QJsonParseError::NoError);
+  if (doc.isObject()) {
+    QCOMPARE(value, QJsonValue(doc.object()));
+  } else {
+    QCOMPARE(value, QJsonValue(doc.array()));
+  }
+}
+
+void TestJsonReader::strings() {
+  QByteArray json(
+      R"(["plain", "quote \" backslash \\ slash \/", "\b\f\n\r\t",)"
+      R"( "caf\u00e9 \u20AC", "\ud83d\ude00", "café"])");
+  JsonReader reader(json);
+  QCOMPARE(reader.readNext(), JsonReader::BeginArray);
+
+  QStringList expected{"plain", "quote \" backslash \\ slash /", "\b\f\n\r\t",
+                       QString::fromUtf8("caf\xc3\xa9 \xe2\x82\xac"),
+                       QString::fromUtf8("\xf0\x9f\x98\x80"),
+                       QString::fromUtf8("caf\xc3\xa9")};
+  for (const QString& string : expected) {
+    QVERIFY(reader.readNextElement());
+    QVERIFY(reader.isString());
+    QCOMPARE(reader.string(), string);
+  }
+  QVERIFY(!reader.readNextElement());
+  QVERIFY(!reader.hasError());
+
+  // Unpaired surrogates are rejected.
+  for (const char* invalid : {R"(["\ud83d"])", R"(["\ude00"])",
+                              R"(["\ud83dA"])", R"(["\u12"])"}) {
+    QByteArray data(invalid);
+    JsonReader reader(data);
+    reader.readNext();
+    QVERIFY(!reader.readNextElement());
+    QVERIFY(reader.hasError());
+  }
+}
+
+void TestJsonReader::skipValue() {
+  QByteArray json(
+      R"({"skip": {"a": [1, {"b": []}], "c": "}"}, "keep": 42,)"
+      R"( "also skip": [[[]]], "last": "value"})");
+  JsonReader reader(json);
+  QCOMPARE(reader.readNext(), JsonReader::BeginObject);
+
+  QStringList keys;
+  while (reader.readNextMember()) {
+    keys.append(QString::fromUtf8(reader.key()));
+    if (reader.key() == "keep") {
+      QVERIFY(reader.isNumber());
+      QCOMPARE(reader.number(), 42);
+    }
+    if (reader.key() == "last") {
+      QCOMPARE(reader.string(), "value");
+    }
+    QVERIFY(reader.skipValue());
+  }
+  QVERIFY(!reader.hasError());
+  QCOMPARE(keys, QStringList({"skip", "keep", "also skip", "last"}));
+  QCOMPARE(reader.readNext(), JsonReader::EndDocument);
+
+  // Errors in skipped values are still reported.
+  QByteArray invalidJson(R"({"skip": [1, 2}, "keep": 42})");
+  JsonReader invalid(invalidJson);
+  QCOMPARE(invalid.readNext(), JsonReader::BeginObject);
+  QVERIFY(invalid.readNextMember());
+  QVERIFY(!invalid.skipValue());
+  QVERIFY(invalid.hasError());
+}
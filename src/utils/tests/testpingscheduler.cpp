@@ -0,0 +1,95 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testpingscheduler.h"
+
+#include <QtTest/QtTest>
+
+#include "pingscheduler.h"
+
+void TestPingScheduler::windowGrowth() {
+  PingScheduler scheduler(4, 64, 100, 5000);
+  int initial = scheduler.window();
+  QVERIFY(initial >= 4);
+  QVERIFY(initial <= 64);
+
+  // Every reply grows the window by one until the first loss.
+  scheduler.pingReceived(20);
+  QCOMPARE(scheduler.window(), initial + 1);
+
+  // The window never grows past the maximum.
+  for (int i = 0; i < 1000; i++) {
+    scheduler.pingReceived(20);
+  }
+  QCOMPARE(scheduler.window(), 64);
+
+  // Resetting restores the initial window, with a new maximum.
+  scheduler.reset(8);
+  QCOMPARE(scheduler.window(), 8);
+}
+
+void TestPingScheduler::windowDecrease() {
+  PingScheduler scheduler(4, 64, 100, 5000);
+  for (int i = 0; i < 1000; i++) {
+    scheduler.pingReceived(20);
+  }
+  QCOMPARE(scheduler.window(), 64);
+
+  // A timeout halves the window.
+  scheduler.pingTimeout(1000, 6000);
+  QCOMPARE(scheduler.window(), 32);
+
+  // Pings sent before the decrease don't shrink it any further.
+  scheduler.pingTimeout(1001, 6001);
+  scheduler.pingTimeout(5999, 6002);
+  QCOMPARE(scheduler.window(), 32);
+
+  // But pings sent afterwards do.
+  scheduler.pingTimeout(6000, 11000);
+  QCOMPARE(scheduler.window(), 16);
+
+  // After a loss, the window grows by roughly one ping per window.
+  for (int i = 0; i < 16; i++) {
+    scheduler.pingReceived(20);
+  }
+  QCOMPARE(scheduler.window(), 16);
+  scheduler.pingReceived(20);
+  QCOMPARE(scheduler.window(), 17);
+
+  // The window never drops below the minimum.
+  for (qint64 t = 20000; t < 30000; t += 1000) {
+    scheduler.pingTimeout(t, t);
+  }
+  QCOMPARE(scheduler.window(), 4);
+}
+
+void TestPingScheduler::timeout() {
+  PingScheduler scheduler(4, 64, 100, 5000);
+
+  // Without enough samples, use the maximum timeout.
+  QCOMPARE(scheduler.timeout(), 5000);
+  scheduler.pingReceived(30);
+  QCOMPARE(scheduler.timeout(), 5000);
+
+  // Once there are enough samples, the timeout tracks the round trip time.
+  for (int i = 0; i < 100; i++) {
+    scheduler.pingReceived(200);
+  }
+  QCOMPARE(scheduler.timeout(), 400);
+
+  // Fast replies are limited by the minimum timeout.
+  for (int i = 0; i < 100; i++) {
+    scheduler.pingReceived(10);
+  }
+  QCOMPARE(scheduler.timeout(), 100);
+
+  // Slow replies are limited by the maximum timeout.
+  for (int i = 0; i < 100; i++) {
+    scheduler.pingReceived(4000);
+  }
+  QCOMPARE(scheduler.timeout(), 5000);
+
+  scheduler.reset(64);
+  QCOMPARE(scheduler.timeout(), 5000);
+}
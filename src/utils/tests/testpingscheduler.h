@@ -0,0 +1,16 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <QObject>
+
+#include "testhelper.h"
+
+class TestPingScheduler final : public QObject, TestHelper<TestPingScheduler> {
+  Q_OBJECT
+
+ private slots:
+  void windowGrowth();
+  void windowDecrease();
+  void timeout();
+};
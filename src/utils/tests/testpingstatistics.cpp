@@ -0,0 +1,91 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testpingstatistics.h"
+
+#include <QDataStream>
+#include <QtTest/QtTest>
+
+#include "pingstatistics.h"
+
+void TestPingStatistics::latency() {
+  PingStatistics stats;
+  QCOMPARE(stats.latency(), 0);
+  QCOMPARE(stats.probes(), 0u);
+
+  // The first sample is taken as is.
+  stats.addSample(100);
+  QCOMPARE(stats.latency(), 100);
+  QCOMPARE(stats.jitter(), 0);
+
+  // A single outlier only moves the average a little.
+  stats.addSample(900);
+  QCOMPARE(stats.latency(), 200);
+
+  // But a lasting change is followed.
+  for (int i = 0; i < 50; i++) {
+    stats.addSample(20);
+  }
+  QVERIFY(stats.latency() < 25);
+  QCOMPARE(stats.probes(), 52u);
+}
+
+void TestPingStatistics::jitter() {
+  PingStatistics steady;
+  PingStatistics unsteady;
+  for (int i = 0; i < 20; i++) {
+    steady.addSample(50);
+    unsteady.addSample((i % 2) ? 20 : 80);
+  }
+
+  QCOMPARE(steady.latency(), 50);
+  QCOMPARE(steady.jitter(), 0);
+  QVERIFY(qAbs(unsteady.latency() - 50) < 10);
+  QVERIFY(unsteady.jitter() > 20);
+}
+
+void TestPingStatistics::packetLoss() {
+  PingStatistics stats;
+  QCOMPARE(stats.packetLoss(), 0.0);
+
+  // Losing the first probe is total loss, without a latency.
+  stats.addLoss();
+  QCOMPARE(stats.packetLoss(), 1.0);
+  QCOMPARE(stats.latency(), 0);
+
+  // Until the window fills up, this is a plain average.
+  stats.addSample(30);
+  stats.addSample(30);
+  stats.addSample(30);
+  QVERIFY(qAbs(stats.packetLoss() - 0.25) < 0.001);
+  QCOMPARE(stats.latency(), 30);
+
+  // Then it decays as the server keeps replying.
+  for (int i = 0; i < 50; i++) {
+    stats.addSample(30);
+  }
+  QVERIFY(stats.packetLoss() < 0.01);
+}
+
+void TestPingStatistics::serialize() {
+  PingStatistics stats;
+  stats.addSample(40);
+  stats.addSample(60);
+  stats.addLoss();
+
+  QByteArray data;
+  {
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << stats;
+  }
+
+  PingStatistics copy;
+  QDataStream stream(data);
+  stream >> copy;
+  QCOMPARE(stream.status(), QDataStream::Ok);
+  QCOMPARE(copy.latency(), stats.latency());
+  QCOMPARE(copy.jitter(), stats.jitter());
+  QCOMPARE(copy.packetLoss(), stats.packetLoss());
+  QCOMPARE(copy.probes(), stats.probes());
+}
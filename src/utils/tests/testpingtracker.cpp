@@ -0,0 +1,229 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testpingtracker.h"
+
+#include <QRandomGenerator>
+#include <QtTest/QtTest>
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+#include "pingtracker.h"
+
+void TestPingTracker::insertAndTake() {
+  PingTracker<QString> tracker(10);
+  QVERIFY(tracker.isEmpty());
+  QCOMPARE(tracker.count(), 0);
+
+  quint16 a = tracker.insert("a", 100);
+  quint16 b = tracker.insert("b", 200);
+  QVERIFY(a != b);
+  QCOMPARE(tracker.count(), 2);
+
+  QString record;
+  QVERIFY(tracker.take(b, &record));
+  QCOMPARE(record, QString("b"));
+  QVERIFY(!tracker.take(b, &record));
+  QCOMPARE(tracker.count(), 1);
+
+  QVERIFY(tracker.take(a, &record));
+  QCOMPARE(record, QString("a"));
+  QVERIFY(tracker.isEmpty());
+
+  // Fill the tracker up.
+  for (int i = 0; i < PingTracker<QString>::CAPACITY; i++) {
+    QVERIFY(!tracker.isFull());
+    tracker.insert(QString::number(i), 1000);
+  }
+  QVERIFY(tracker.isFull());
+
+  tracker.clear();
+  QVERIFY(tracker.isEmpty());
+  QVERIFY(!tracker.take(a));
+}
+
+void TestPingTracker::staleSequence() {
+  PingTracker<int> tracker(10);
+
+  // When an entry is reused, it gets a different sequence number.
+  quint16 first = tracker.insert(1, 100);
+  QVERIFY(tracker.take(first));
+  quint16 second = tracker.insert(2, 100);
+  QVERIFY(first != second);
+
+  // A late reply to the first ping must not match the second.
+  QVERIFY(!tracker.take(first));
+  int record = 0;
+  QVERIFY(tracker.take(second, &record));
+  QCOMPARE(record, 2);
+}
+
+void TestPingTracker::expire() {
+  PingTracker<int> tracker(10, 16);
+  tracker.insert(1, 105);
+  tracker.insert(2, 250);
+  tracker.insert(3, 110);
+  // This one is more than a revolution of the wheel away.
+  tracker.insert(4, 1000);
+
+  QVERIFY(tracker.expire(99).isEmpty());
+
+  QList<int> expired = tracker.expire(110);
+  std::sort(expired.begin(), expired.end());
+  QCOMPARE(expired, QList<int>({1, 3}));
+  QCOMPARE(tracker.count(), 2);
+
+  // Sharing a bucket with a later revolution doesn't expire it early.
+  QVERIFY(tracker.expire(249).isEmpty());
+  QCOMPARE(tracker.expire(260), QList<int>({2}));
+  QVERIFY(tracker.expire(999).isEmpty());
+
+  // Falling far behind still finds it.
+  QCOMPARE(tracker.expire(50000), QList<int>({4}));
+  QVERIFY(tracker.isEmpty());
+}
+
+void TestPingTracker::nextDeadline() {
+  PingTracker<int> tracker(10, 16);
+  QCOMPARE(tracker.nextDeadline(), -1);
+
+  tracker.insert(1, 1000);
+  QCOMPARE(tracker.nextDeadline(), 1010);
+
+  quint16 sequence = tracker.insert(2, 123);
+  QCOMPARE(tracker.nextDeadline(), 130);
+
+  QVERIFY(tracker.take(sequence));
+  QCOMPARE(tracker.nextDeadline(), 1010);
+}
+
+// Simulate a sweep over the server list, with a fixed window of pings in
+// flight. Replies arrive in a random order, and some are lost. Both
+// implementations are driven through the same sequence of events.
+namespace {
+constexpr int BENCHMARK_SERVERS = 10000;
+constexpr int BENCHMARK_WINDOW = 256;
+constexpr qint64 BENCHMARK_TIMEOUT = 1000;
+
+struct BenchmarkPing {
+  qint64 rtt;
+  bool lost;
+};
+
+struct BenchmarkRecord {
+  int server = 0;
+  quint16 sequence = 0;
+  qint64 timestamp = 0;
+};
+
+using Arrival = std::pair<qint64, quint16>;
+using ArrivalQueue =
+    std::priority_queue<Arrival, std::vector<Arrival>, std::greater<Arrival>>;
+
+// The previous implementation: a list sorted by transmit time, searched
+// linearly for replies.
+int simulateList(const QList<BenchmarkPing>& pings) {
+  QList<BenchmarkRecord> inflight;
+  ArrivalQueue arrivals;
+  quint16 nextSequence = 0;
+  qint64 now = 0;
+  int next = 0;
+  int received = 0;
+
+  while ((next < pings.count()) || !inflight.isEmpty()) {
+    while ((inflight.count() < BENCHMARK_WINDOW) && (next < pings.count())) {
+      BenchmarkRecord record{next, nextSequence++, now};
+      inflight.append(record);
+      if (!pings[next].lost) {
+        arrivals.push({now + pings[next].rtt, record.sequence});
+      }
+      next++;
+    }
+
+    qint64 deadline = inflight.first().timestamp + BENCHMARK_TIMEOUT;
+    if (!arrivals.empty() && (arrivals.top().first <= deadline)) {
+      now = arrivals.top().first;
+      quint16 sequence = arrivals.top().second;
+      arrivals.pop();
+      for (auto i = inflight.begin(); i != inflight.end(); i++) {
+        if (i->sequence == sequence) {
+          inflight.erase(i);
+          received++;
+          break;
+        }
+      }
+      continue;
+    }
+
+    now = deadline;
+    while (!inflight.isEmpty() &&
+           (inflight.first().timestamp + BENCHMARK_TIMEOUT) <= now) {
+      inflight.removeFirst();
+    }
+  }
+  return received;
+}
+
+int simulateTracker(const QList<BenchmarkPing>& pings) {
+  PingTracker<BenchmarkRecord> inflight(10);
+  ArrivalQueue arrivals;
+  qint64 now = 0;
+  int next = 0;
+  int received = 0;
+
+  while ((next < pings.count()) || !inflight.isEmpty()) {
+    while ((inflight.count() < BENCHMARK_WINDOW) && (next < pings.count())) {
+      quint16 sequence =
+          inflight.insert({next, 0, now}, now + BENCHMARK_TIMEOUT);
+      if (!pings[next].lost) {
+        arrivals.push({now + pings[next].rtt, sequence});
+      }
+      next++;
+    }
+
+    qint64 deadline = inflight.nextDeadline();
+    if (!arrivals.empty() && (arrivals.top().first <= deadline)) {
+      now = arrivals.top().first;
+      quint16 sequence = arrivals.top().second;
+      arrivals.pop();
+      if (inflight.take(sequence)) {
+        received++;
+      }
+      continue;
+    }
+
+    now = deadline;
+    inflight.expire(now);
+  }
+  return received;
+}
+}  // namespace
+
+void TestPingTracker::benchmark_data() {
+  QTest::addColumn<bool>("tracker");
+  QTest::addRow("QList") << false;
+  QTest::addRow("PingTracker") << true;
+}
+
+void TestPingTracker::benchmark() {
+  QFETCH(bool, tracker);
+
+  QRandomGenerator rng(1234);
+  QList<BenchmarkPing> pings;
+  int expected = 0;
+  for (int i = 0; i < BENCHMARK_SERVERS; i++) {
+    BenchmarkPing ping{rng.bounded(5, 400), rng.bounded(100) < 5};
+    if (!ping.lost) {
+      expected++;
+    }
+    pings.append(ping);
+  }
+
+  int received = 0;
+  QBENCHMARK {
+    received = tracker ? simulateTracker(pings) : simulateList(pings);
+  }
+  QCOMPARE(received, expected);
+}
@@ -0,0 +1,20 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <QObject>
+
+#include "testhelper.h"
+
+class TestPingTracker final : public QObject, TestHelper<TestPingTracker> {
+  Q_OBJECT
+
+ private slots:
+  void insertAndTake();
+  void staleSequence();
+  void expire();
+  void nextDeadline();
+
+  void benchmark_data();
+  void benchmark();
+};
@@ -4,11 +4,26 @@
 
 #include "testservermodels.h"
 
+#if defined(__GLIBC__)
+#  include <malloc.h>
+#endif
+
+#include <QRandomGenerator>
+#include <QScopeGuard>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTranslator>
+#include <QtMath>
 #include <QtTest/QtTest>
 
+#include "jsonreader.h"
+#include "models/cityrecommender.h"
+#include "models/distancequeue.h"
+#include "models/location.h"
 #include "models/servercity.h"
 #include "models/servercountry.h"
 #include "models/servercountrymodel.h"
+#include "models/serversearchmodel.h"
 
 // Server
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -128,11 +143,30 @@ void TestServerModels::serverFromJson() {
   Server s;
   QCOMPARE(s.fromJson(json), result);
 
+  // The streaming parser agrees.
+  QByteArray data = QJsonDocument(json).toJson();
+  JsonReader reader(data);
+  reader.readNext();
+  Server streamed;
+  QCOMPARE(streamed.fromJson(reader), result);
+
   if (!result) {
     QVERIFY(!s.initialized());
+    QVERIFY(!streamed.initialized());
     return;
   }
 
+  QVERIFY(streamed.initialized());
+  QCOMPARE(streamed.hostname(), s.hostname());
+  QCOMPARE(streamed.ipv4AddrIn(), s.ipv4AddrIn());
+  QCOMPARE(streamed.ipv4Gateway(), s.ipv4Gateway());
+  QCOMPARE(streamed.ipv6AddrIn(), s.ipv6AddrIn());
+  QCOMPARE(streamed.ipv6Gateway(), s.ipv6Gateway());
+  QCOMPARE(streamed.publicKey(), s.publicKey());
+  QCOMPARE(streamed.weight(), s.weight());
+  QCOMPARE(streamed.socksName(), s.socksName());
+  QCOMPARE(streamed.multihopPort(), s.multihopPort());
+
   QVERIFY(s.initialized());
 
   QFETCH(QString, hostname);
@@ -193,6 +227,52 @@ void TestServerModels::serverFromJson() {
   QCOMPARE(sC.multihopPort(), s.multihopPort());
 }
 
+void TestServerModels::serverAddresses() {
+  QJsonObject obj;
+  obj.insert("hostname", "hostname");
+  obj.insert("ipv4_addr_in", "185.65.134.2");
+  obj.insert("ipv4_gateway", "010.064.000.001");
+  obj.insert("ipv6_addr_in", "2a07:b944::2:2");
+  obj.insert("ipv6_gateway", "FC00:BBBB:BBBB:BB01::1");
+  obj.insert("public_key", "publicKey");
+  obj.insert("weight", 1);
+  obj.insert("port_ranges", QJsonArray{QJsonArray{53, 53}});
+  obj.insert("multihop_port", 1337);
+
+  // Addresses are stored in binary form, but read back exactly as they were
+  // given, even when they are not in canonical form.
+  Server s("se", "Gothenburg");
+  QVERIFY(s.fromJson(obj));
+  QCOMPARE(s.ipv4AddrIn(), "185.65.134.2");
+  QCOMPARE(s.ipv4Gateway(), "010.064.000.001");
+  QCOMPARE(s.ipv6AddrIn(), "2a07:b944::2:2");
+  QCOMPARE(s.ipv6Gateway(), "FC00:BBBB:BBBB:BB01::1");
+  QCOMPARE(s.countryCode(), "se");
+  QCOMPARE(s.cityName(), "Gothenburg");
+
+  // They can also be used without parsing the text again.
+  QCOMPARE(s.ipv4AddrInAddress(), QHostAddress("185.65.134.2"));
+  QCOMPARE(s.ipv6AddrInAddress(), QHostAddress("2a07:b944::2:2"));
+  QCOMPARE(s.ipv6GatewayAddress(), QHostAddress("fc00:bbbb:bbbb:bb01::1"));
+  QVERIFY(Server().ipv4AddrInAddress().isNull());
+
+  Server copy(s);
+  QCOMPARE(copy.ipv4AddrIn(), s.ipv4AddrIn());
+  QCOMPARE(copy.ipv6Gateway(), s.ipv6Gateway());
+  QCOMPARE(copy.countryCode(), s.countryCode());
+  QCOMPARE(copy.choosePort(), 53u);
+
+  // Multihop takes the entry address from the other server.
+  Server entry;
+  obj.insert("ipv4_addr_in", "10.0.0.2");
+  QVERIFY(entry.fromJson(obj));
+  Server multihop;
+  QVERIFY(multihop.fromMultihop(s, entry));
+  QCOMPARE(multihop.ipv4AddrIn(), "10.0.0.2");
+  QCOMPARE(multihop.ipv4Gateway(), s.ipv4Gateway());
+  QCOMPARE(multihop.choosePort(), 1337u);
+}
+
 void TestServerModels::serverWeightChooser() {
   QList<Server> list;
   list.append(Server());
@@ -201,6 +281,121 @@ void TestServerModels::serverWeightChooser() {
   QCOMPARE(&s, &list[0]);
 }
 
+namespace {
+// A city of servers, with the given weights.
+QList<Server> chooserServers(const QList<int>& weights) {
+  QList<Server> servers;
+  for (int i = 0; i < weights.count(); i++) {
+    QJsonObject obj;
+    obj.insert("hostname", QString("server-%1").arg(i));
+    obj.insert("ipv4_addr_in", QString("10.0.0.%1").arg(i + 1));
+    obj.insert("ipv4_gateway", "10.64.0.1");
+    obj.insert("ipv6_addr_in", "fc00::1");
+    obj.insert("ipv6_gateway", "fc00::2");
+    obj.insert("public_key", QString("key-%1").arg(i));
+    obj.insert("weight", weights.at(i));
+    obj.insert("socks5_name", "socks5_name");
+    obj.insert("multihop_port", 1337);
+    obj.insert("port_ranges", QJsonArray{QJsonArray{53, 53}});
+
+    Server server;
+    if (server.fromJson(obj)) {
+      servers.append(server);
+    }
+  }
+  return servers;
+}
+}  // namespace
+
+void TestServerModels::serverLatencyChooser() {
+  QList<Server> servers = chooserServers({100, 200, 300, 400});
+  QCOMPARE(servers.count(), 4);
+  QVERIFY(Server::latencyChooser({}, {}).hostname().isEmpty());
+
+  // Without latencies, the first draw is taken as weightChooser() would.
+  QRandomGenerator a(7);
+  QRandomGenerator b(7);
+  QList<qint64> unknown(servers.count(), 0);
+  for (int i = 0; i < 100; i++) {
+    const Server& s = Server::latencyChooser(servers, unknown, &a);
+    QCOMPARE(&s, &Server::weightChooser(servers, &b));
+    b.generate();
+  }
+
+  // A slow server is only taken when it is drawn twice.
+  QList<qint64> latencies{20, 20, 20, 1000};
+  int slow = 0;
+  for (int i = 0; i < 10000; i++) {
+    if (&Server::latencyChooser(servers, latencies, &a) == &servers.last()) {
+      slow++;
+    }
+  }
+  QVERIFY(slow > 0);
+  QVERIFY(slow < 2500);
+}
+
+// Connections to cities that have a slow server should get a lower latency
+// from latencyChooser() than from weightChooser(), and still be spread over
+// the fast servers.
+void TestServerModels::serverLatencyChooserCities() {
+  QRandomGenerator rng(1234);
+  struct City {
+    QList<Server> servers;
+    QList<qint64> latencies;
+  };
+  QList<City> cities;
+  for (int i = 0; i < 10; i++) {
+    City city;
+    city.servers = chooserServers({100, 100, 100, 100});
+    qint64 base = 10 + rng.bounded(150);
+    for (int j = 0; j < city.servers.count(); j++) {
+      city.latencies.append(base + j);
+    }
+    // One server of each city is overloaded, and much slower.
+    city.latencies[i % city.servers.count()] *= 5;
+    cities.append(city);
+  }
+
+  QSet<const Server*> chosen;
+  auto average = [&](bool latency) {
+    QRandomGenerator generator(42);
+    qint64 sum = 0;
+    for (int i = 0; i < 1000; i++) {
+      const City& city = cities.at(i % cities.count());
+      const Server& server =
+          latency ? Server::latencyChooser(city.servers, city.latencies,
+                                           &generator)
+                  : Server::weightChooser(city.servers, &generator);
+      sum += city.latencies.at(&server - city.servers.constData());
+      if (latency) {
+        chosen.insert(&server);
+      }
+    }
+    return sum / 1000.0;
+  };
+
+  double random = average(false);
+  double chosenByLatency = average(true);
+  qInfo() << "Average latency in ms, weightChooser:" << random
+          << "latencyChooser:" << chosenByLatency;
+  QVERIFY(chosenByLatency < random);
+  for (int i = 0; i < cities.count(); i++) {
+    const City& city = cities.at(i);
+    for (int j = 0; j < city.servers.count(); j++) {
+      if (j != i % city.servers.count()) {
+        QVERIFY(chosen.contains(&city.servers.at(j)));
+      }
+    }
+  }
+
+  QRandomGenerator generator(42);
+  QBENCHMARK {
+    for (const City& city : cities) {
+      Server::latencyChooser(city.servers, city.latencies, &generator);
+    }
+  }
+}
+
 // ServerCity
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
@@ -275,6 +470,23 @@ void TestServerModels::serverCityFromJson() {
 
   ServerCity sc;
   QCOMPARE(sc.fromJson(json, "test"), result);
+
+  // The streaming parser agrees, and also reads the servers.
+  QByteArray data = QJsonDocument(json).toJson();
+  JsonReader reader(data);
+  reader.readNext();
+  ServerCity streamed;
+  QList<Server> streamedServers;
+  QCOMPARE(streamed.fromJson(reader, streamedServers), result);
+  if (result) {
+    streamed.setCountry("test");
+    QCOMPARE(streamed.name(), sc.name());
+    QCOMPARE(streamed.code(), sc.code());
+    QCOMPARE(streamed.hashKey(), sc.hashKey());
+    QCOMPARE(streamed.servers(), sc.servers());
+    QCOMPARE(streamedServers.count(), sc.servers().count());
+  }
+
   if (!result) {
     QCOMPARE(sc.name(), "");
     QCOMPARE(sc.code(), "");
@@ -295,11 +507,13 @@ void TestServerModels::serverCityFromJson() {
   ServerCity scB(sc);
   QCOMPARE(scB.name(), sc.name());
   QCOMPARE(scB.code(), sc.code());
+  QCOMPARE(scB.hashKey(), sc.hashKey());
 
   ServerCity scC;
   scC = sc;
   QCOMPARE(scC.name(), sc.name());
   QCOMPARE(scC.code(), sc.code());
+  QCOMPARE(scC.hashKey(), sc.hashKey());
 }
 
 // ServerCountry
@@ -343,6 +557,21 @@ void TestServerModels::serverCountryFromJson() {
 
   ServerCountry sc;
   QCOMPARE(sc.fromJson(json), result);
+
+  // The streaming parser agrees.
+  QByteArray data = QJsonDocument(json).toJson();
+  JsonReader reader(data);
+  reader.readNext();
+  ServerCountry streamed;
+  QList<ServerCity> streamedCities;
+  QList<Server> streamedServers;
+  QCOMPARE(streamed.fromJson(reader, streamedCities, streamedServers), result);
+  if (result) {
+    QCOMPARE(streamed.name(), sc.name());
+    QCOMPARE(streamed.code(), sc.code());
+    QCOMPARE(streamed.cities(), sc.cities());
+  }
+
   if (!result) {
     QCOMPARE(sc.name(), "");
     QCOMPARE(sc.code(), "");
@@ -543,3 +772,773 @@ void TestServerModels::serverCountryModelFromJson() {
     }
   }
 }
+
+void TestServerModels::serverCountryModelSnapshot() {
+  QJsonObject server;
+  server.insert("hostname", "hostname");
+  server.insert("ipv4_addr_in", "ipv4AddrIn");
+  server.insert("ipv4_gateway", "ipv4Gateway");
+  server.insert("ipv6_addr_in", "ipv6AddrIn");
+  server.insert("ipv6_gateway", "ipv6Gateway");
+  server.insert("public_key", "publicKey");
+  server.insert("weight", 1234);
+  server.insert("port_ranges", QJsonArray{QJsonArray{1, 10}});
+  server.insert("multihop_port", 5678);
+  server.insert("socks5_name", "socks5_name");
+
+  QJsonObject city;
+  city.insert("code", "serverCityCode");
+  city.insert("name", "serverCityName");
+  city.insert("latitude", 12.34);
+  city.insert("longitude", 34.56);
+  city.insert("servers", QJsonArray{server});
+
+  QJsonObject country;
+  country.insert("name", "serverCountryName");
+  country.insert("code", "serverCountryCode");
+  country.insert("cities", QJsonArray{city});
+
+  QJsonObject obj;
+  obj.insert("countries", QJsonArray{country});
+  QByteArray json = QJsonDocument(obj).toJson();
+
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  QString fileName = dir.filePath("servers.snapshot");
+
+  {
+    ServerCountryModel m;
+    QVERIFY(!m.fromSnapshot(fileName, json));
+    QVERIFY(!m.initialized());
+    QVERIFY(m.fromJson(json));
+    QVERIFY(m.writeSnapshot(fileName));
+  }
+
+  // The snapshot restores the same model.
+  {
+    ServerCountryModel m;
+    QSignalSpy spy(&m, &ServerCountryModel::changed);
+    QVERIFY(m.fromSnapshot(fileName, json));
+    QVERIFY(m.initialized());
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(m.rowCount(QModelIndex()), 1);
+    QCOMPARE(m.countryName("serverCountryCode"), "serverCountryName");
+
+    const ServerCity& sc = m.findCity("serverCountryCode", "serverCityName");
+    QVERIFY(sc.initialized());
+    QCOMPARE(sc.code(), "serverCityCode");
+    QCOMPARE(sc.latitude(), 12.34);
+    QCOMPARE(sc.longitude(), 34.56);
+    QCOMPARE(sc.servers(), QList<QString>{"publicKey"});
+
+    // Servers can also be looked up by ID.
+    int id = m.serverId("publicKey");
+    QCOMPARE(id, 0);
+    QCOMPARE(sc.serverIds(), QList<int>{id});
+    QCOMPARE(m.publicKey(id), "publicKey");
+    QCOMPARE(m.serverId("unknown"), -1);
+    QCOMPARE(m.server(id).hostname(), "hostname");
+
+    const Server& s = m.server("publicKey");
+    QVERIFY(s.initialized());
+    QCOMPARE(s.hostname(), "hostname");
+    QCOMPARE(s.ipv4AddrIn(), "ipv4AddrIn");
+    QCOMPARE(s.ipv6Gateway(), "ipv6Gateway");
+    QCOMPARE(s.weight(), (uint32_t)1234);
+    QCOMPARE(s.multihopPort(), (uint32_t)5678);
+    QCOMPARE(s.socksName(), "socks5_name");
+    QCOMPARE(s.countryCode(), "serverCountryCode");
+    QCOMPARE(s.cityName(), "serverCityName");
+    uint32_t port = s.choosePort();
+    QVERIFY(port >= 1 && port <= 10);
+
+    // Loading the same JSON again changes nothing.
+    QVERIFY(m.fromJson(json));
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(m.serverId("publicKey"), id);
+    QCOMPARE(m.serverIdCount(), 1);
+  }
+
+  // A snapshot of another server list is not used.
+  {
+    ServerCountryModel m;
+    QVERIFY(!m.fromSnapshot(fileName, json + " "));
+    QVERIFY(!m.initialized());
+  }
+
+  // Nor is a corrupted one.
+  {
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.seek(file.size() - 1));
+    QVERIFY(file.putChar('\xff'));
+  }
+  {
+    ServerCountryModel m;
+    QVERIFY(!m.fromSnapshot(fileName, json));
+    QVERIFY(!m.initialized());
+  }
+}
+
+namespace {
+// A server list with one server per city, given as country code -> city
+// name -> public key.
+QByteArray updateServerList(
+    const QMap<QString, QMap<QString, QString>>& list) {
+  QJsonArray countries;
+  for (auto country = list.constBegin(); country != list.constEnd();
+       ++country) {
+    QJsonArray cities;
+    for (auto city = country->constBegin(); city != country->constEnd();
+         ++city) {
+      QJsonObject server;
+      server.insert("hostname", city.value());
+      server.insert("ipv4_addr_in", "10.0.0.1");
+      server.insert("ipv4_gateway", "10.0.0.2");
+      server.insert("ipv6_addr_in", "fc00::1");
+      server.insert("ipv6_gateway", "fc00::2");
+      server.insert("public_key", city.value());
+      server.insert("weight", 100);
+      server.insert("port_ranges", QJsonArray());
+
+      QJsonObject obj;
+      obj.insert("code", city.key().toLower());
+      obj.insert("name", city.key());
+      obj.insert("latitude", 0.0);
+      obj.insert("longitude", 0.0);
+      obj.insert("servers", QJsonArray{server});
+      cities.append(obj);
+    }
+
+    QJsonObject obj;
+    obj.insert("code", country.key());
+    obj.insert("name", country.key().toUpper());
+    obj.insert("cities", cities);
+    countries.append(obj);
+  }
+
+  QJsonObject obj;
+  obj.insert("countries", countries);
+  return QJsonDocument(obj).toJson();
+}
+}  // namespace
+
+void TestServerModels::serverCountryModelUpdate() {
+  ServerCountryModel m;
+  QVERIFY(m.fromJson(updateServerList({
+      {"aa", {{"Alpha", "keyA"}}},
+      {"bb", {{"Bravo", "keyB1"}, {"Brick", "keyB2"}}},
+      {"dd", {{"Delta", "keyD"}}},
+  })));
+  QCOMPARE(m.rowCount(QModelIndex()), 3);
+
+  ServerCity& alpha = m.findCity("aa", "Alpha");
+  alpha.setLatency(42);
+  alpha.setConnectionScore(3);
+  int alphaId = m.serverId("keyA");
+  int bravoId = m.serverId("keyB1");
+  const ServerCity* brick = &m.findCity("bb", "Brick");
+  ServerCountryModel::CityHandle alphaHandle = m.cityHandle(alpha);
+  const ServerCity* delta = &m.findCity("dd", "Delta");
+  ServerCountryModel::CityHandle deltaHandle = m.cityHandle(*delta);
+  QCOMPARE(m.city(alphaHandle), &alpha);
+
+  // Holders of a city are told when its storage goes to another city.
+  QSignalSpy alphaSpy(&alpha, &ServerCity::changed);
+  QSignalSpy deltaSpy(delta, &ServerCity::changed);
+
+  QSignalSpy resetSpy(&m, &QAbstractItemModel::modelReset);
+  QSignalSpy insertSpy(&m, &QAbstractItemModel::rowsInserted);
+  QSignalSpy removeSpy(&m, &QAbstractItemModel::rowsRemoved);
+  QSignalSpy changeSpy(&m, &QAbstractItemModel::dataChanged);
+
+  // One country is added, one removed, and a server is replaced in another.
+  QVERIFY(m.fromJson(updateServerList({
+      {"aa", {{"Alpha", "keyA"}}},
+      {"bb", {{"Bravo", "keyB1"}, {"Brick", "keyB3"}}},
+      {"cc", {{"Charlie", "keyC"}}},
+  })));
+  QCOMPARE(resetSpy.count(), 0);
+  QCOMPARE(m.rowCount(QModelIndex()), 3);
+
+  QCOMPARE(removeSpy.count(), 1);
+  QCOMPARE(removeSpy.at(0).at(1).toInt(), 2);
+  QCOMPARE(removeSpy.at(0).at(2).toInt(), 2);
+  QCOMPARE(insertSpy.count(), 1);
+  QCOMPARE(insertSpy.at(0).at(1).toInt(), 2);
+  QCOMPARE(insertSpy.at(0).at(2).toInt(), 2);
+  QCOMPARE(m.data(m.index(2, 0), ServerCountryModel::CodeRole).toString(),
+           "cc");
+
+  // The country whose cities changed is refreshed.
+  QStringList changed;
+  for (const QList<QVariant>& args : changeSpy) {
+    QModelIndex index = args.at(0).toModelIndex();
+    changed.append(m.data(index, ServerCountryModel::CodeRole).toString());
+    QCOMPARE(args.at(2).value<QList<int>>(),
+             QList<int>{ServerCountryModel::CitiesRole});
+  }
+  QCOMPARE(changed, QStringList{"bb"});
+
+  // Cities are updated in place, and unchanged cities and servers keep their
+  // state.
+  const ServerCity& city = m.findCity("aa", "Alpha");
+  QCOMPARE(&city, &alpha);
+  QCOMPARE(city.latency(), (qint64)42);
+  QCOMPARE(city.connectionScore(), 3);
+  QCOMPARE(&m.findCity("bb", "Brick"), brick);
+  QCOMPARE(brick->servers(), QList<QString>{"keyB3"});
+  QCOMPARE(m.city(alphaHandle), &alpha);
+  QVERIFY(!m.city(deltaHandle));
+  QCOMPARE(alphaSpy.count(), 0);
+  QVERIFY(deltaSpy.count() > 0);
+  QCOMPARE(m.cities().count(), 4);
+  QCOMPARE(m.serverId("keyA"), alphaId);
+  QCOMPARE(m.serverId("keyB1"), bravoId);
+  QCOMPARE(m.server(bravoId).hostname(), "keyB1");
+  QVERIFY(!m.server("keyB2").initialized());
+  QVERIFY(m.server("keyB3").initialized());
+  QVERIFY(!m.exists("dd", "Delta"));
+  QVERIFY(m.exists("cc", "Charlie"));
+
+  // An invalid list leaves the model as it was.
+  QVERIFY(!m.fromJson("{\"countries\": 42}"));
+  QCOMPARE(m.rowCount(QModelIndex()), 3);
+  QVERIFY(m.exists("cc", "Charlie"));
+  QCOMPARE(resetSpy.count(), 0);
+}
+
+void TestServerModels::serverSearchModel() {
+  ServerCountryModel m;
+  QVERIFY(m.fromJson(updateServerList({
+      {"br", {{"São Paulo", "keyBR"}}},
+      {"ch", {{"Zürich", "keyCH"}}},
+      {"de", {{"Berlin", "keyDE"}, {"Frankfurt", "keyDE2"}}},
+  })));
+
+  ServerSearchModel search;
+  search.setSourceModel(&m);
+  QCOMPARE(search.count(), 3);
+
+  auto codes = [&search]() {
+    QStringList list;
+    for (int row = 0; row < search.rowCount(); row++) {
+      list.append(search.index(row, 0)
+                      .data(ServerCountryModel::CodeRole)
+                      .toString());
+    }
+    return list;
+  };
+
+  // Names match without case or accents, including the names of the cities.
+  search.setQuery("zur");
+  QCOMPARE(codes(), QStringList{"ch"});
+  search.setQuery("SAO");
+  QCOMPARE(codes(), QStringList{"br"});
+  search.setQuery(" frank ");
+  QCOMPARE(codes(), QStringList{"de"});
+
+  // A country also matches by its code.
+  search.setQuery("de");
+  QCOMPARE(codes(), QStringList{"de"});
+
+  // Each keystroke narrows down the previous results.
+  search.setQuery("b");
+  QCOMPARE(codes(), (QStringList{"br", "de"}));
+  search.setQuery("be");
+  QCOMPARE(codes(), QStringList{"de"});
+  search.setQuery("bex");
+  QCOMPARE(search.count(), 0);
+  search.setQuery("");
+  QCOMPARE(search.count(), 3);
+
+  // The index follows the changes of the server list.
+  search.setQuery("fur");
+  QCOMPARE(codes(), QStringList{"de"});
+  QVERIFY(m.fromJson(updateServerList({
+      {"br", {{"São Paulo", "keyBR"}}},
+      {"ch", {{"Zürich", "keyCH"}}},
+      {"de", {{"Berlin", "keyDE"}}},
+  })));
+  QCOMPARE(search.count(), 0);
+  QVERIFY(m.fromJson(updateServerList({
+      {"br", {{"São Paulo", "keyBR"}}},
+      {"ch", {{"Zürich", "keyCH"}}},
+      {"de", {{"Berlin", "keyDE"}, {"Frankfurt", "keyDE2"}}},
+      {"fr", {{"Furiani", "keyFR"}}},
+  })));
+  QCOMPARE(codes(), (QStringList{"de", "fr"}));
+}
+
+namespace {
+// Translates the server names by prefixing them, and counts the lookups.
+class ServerNameTranslator final : public QTranslator {
+ public:
+  QString translate(const char* context, const char* sourceText,
+                    const char* disambiguation, int n) const override {
+    Q_UNUSED(disambiguation);
+    Q_UNUSED(n);
+    if (qstrcmp(context, "ServerCity") && qstrcmp(context, "ServerCountry")) {
+      return QString();
+    }
+    m_lookups++;
+    return QString("T-%1").arg(sourceText);
+  }
+
+  bool isEmpty() const override { return false; }
+
+  mutable int m_lookups = 0;
+};
+}  // namespace
+
+void TestServerModels::serverLocalizedNames() {
+  ServerCountryModel m;
+  QVERIFY(m.fromJson(updateServerList({
+      {"aa", {{"Alpha", "keyA1"}, {"Apex", "keyA2"}}},
+      {"bb", {{"Bravo", "keyB"}}},
+  })));
+
+  QCOMPARE(m.findCity("aa", "Alpha").localizedName(), "Alpha");
+
+  ServerNameTranslator translator;
+  QCoreApplication::installTranslator(&translator);
+  auto guard = qScopeGuard(
+      [&translator]() { QCoreApplication::removeTranslator(&translator); });
+
+  // The names are only translated again once the model is retranslated.
+  QCOMPARE(m.findCity("aa", "Alpha").localizedName(), "Alpha");
+  QCOMPARE(translator.m_lookups, 0);
+
+  m.retranslate();
+  QCOMPARE(m.data(m.index(0, 0), ServerCountryModel::LocalizedNameRole)
+               .toString(),
+           "T-aa");
+  QCOMPARE(m.findCity("aa", "Alpha").localizedName(), "T-Alpha");
+  int lookups = translator.m_lookups;
+  QVERIFY(lookups > 0);
+
+  // Reading the names again, or sorting, hits the memo.
+  m.findCity("aa", "Alpha").localizedName();
+  ServerCountry::localizedName("aa", "AA");
+  ServerCountry country = m.countries().at(0);
+  country.sortCities();
+  QCOMPARE(country.cities(), (QList<QString>{"Alpha", "Apex"}));
+  QCOMPARE(translator.m_lookups, lookups);
+
+  QCoreApplication::removeTranslator(&translator);
+  guard.dismiss();
+  m.retranslate();
+  QCOMPARE(m.findCity("aa", "Alpha").localizedName(), "Alpha");
+}
+
+namespace {
+// A servers API response with 10k servers, five per city.
+QByteArray benchmarkServerList() {
+  QRandomGenerator rng(1234);
+  QJsonArray countries;
+  int server = 0;
+  for (int c = 0; c < 100; c++) {
+    QJsonArray cities;
+    for (int i = 0; i < 20; i++) {
+      QJsonArray servers;
+      for (int s = 0; s < 5; s++, server++) {
+        QJsonObject obj;
+        obj.insert("hostname", QString("server-%1-wireguard").arg(server));
+        obj.insert("ipv4_addr_in", QString("10.%1.%2.%3")
+                                       .arg(server >> 16)
+                                       .arg((server >> 8) & 0xff)
+                                       .arg(server & 0xff));
+        obj.insert("ipv4_gateway", "10.64.0.1");
+        obj.insert("ipv6_addr_in", QString("fc00:bbbb:bbbb:bb01::%1")
+                                       .arg(server, 0, 16));
+        obj.insert("ipv6_gateway", "fc00:bbbb:bbbb:bb01::1");
+        obj.insert("public_key",
+                   QString(QByteArray::number(rng.generate64()).toBase64()));
+        obj.insert("weight", 100);
+        obj.insert("multihop_port", 19000 + server);
+        obj.insert("socks5_name", QString("socks-%1.relays").arg(server));
+        obj.insert("port_ranges", QJsonArray{QJsonArray{53, 53},
+                                             QJsonArray{4000, 33433},
+                                             QJsonArray{33565, 51820}});
+        obj.insert("features", QJsonObject{{"lwo", QJsonObject()}});
+        servers.append(obj);
+      }
+
+      QJsonObject city;
+      city.insert("name", QString("City %1-%2").arg(c).arg(i));
+      city.insert("code", QString("c%1").arg(i));
+      city.insert("latitude", rng.generateDouble() * 180.0 - 90.0);
+      city.insert("longitude", rng.generateDouble() * 360.0 - 180.0);
+      city.insert("servers", servers);
+      cities.append(city);
+    }
+
+    QJsonObject country;
+    country.insert("name", QString("Country %1").arg(c));
+    country.insert("code", QString("k%1").arg(c));
+    country.insert("cities", cities);
+    countries.append(country);
+  }
+
+  QJsonObject obj;
+  obj.insert("countries", countries);
+  return QJsonDocument(obj).toJson(QJsonDocument::Compact);
+}
+
+// Bytes currently allocated on the heap, or -1 if this is not known.
+qint64 heapInUse() {
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  return static_cast<qint64>(mallinfo2().uordblks);
+#else
+  return -1;
+#endif
+}
+
+// The way ServerCountryModel used to parse the list, through QJsonDocument.
+// If |heap| is given, it gets the heap in use at the end of the parsing,
+// while the document is still held.
+qsizetype parseServerListDocument(const QByteArray& json, qint64* heap) {
+  QList<ServerCountry> countries;
+  QHash<QString, ServerCity> cities;
+  QHash<QString, Server> servers;
+
+  QJsonArray countriesArray =
+      QJsonDocument::fromJson(json).object().value("countries").toArray();
+  for (const QJsonValue& countryValue : countriesArray) {
+    QJsonObject countryObj = countryValue.toObject();
+    ServerCountry country;
+    if (!country.fromJson(countryObj)) {
+      return -1;
+    }
+    countries.append(country);
+
+    for (const QJsonValue& cityValue : countryObj.value("cities").toArray()) {
+      QJsonObject cityObj = cityValue.toObject();
+      ServerCity city;
+      if (!city.fromJson(cityObj, country.code())) {
+        return -1;
+      }
+      cities[city.hashKey()] = city;
+
+      for (const QJsonValue& serverValue : cityObj.value("servers").toArray()) {
+        Server server(country.code(), city.name());
+        if (!server.fromJson(serverValue.toObject())) {
+          return -1;
+        }
+        servers[server.publicKey()] = server;
+      }
+    }
+  }
+  if (heap) {
+    *heap = heapInUse();
+  }
+  return servers.count();
+}
+
+qsizetype parseServerListReader(const QByteArray& json, qint64* heap) {
+  ServerCountryModel model;
+  if (!model.fromJson(json)) {
+    return -1;
+  }
+  if (heap) {
+    *heap = heapInUse();
+  }
+  qsizetype count = 0;
+  for (const ServerCity* city : model.cities()) {
+    count += city->servers().count();
+  }
+  return count;
+}
+}  // namespace
+
+void TestServerModels::serverCountryModelBenchmark_data() {
+  QTest::addColumn<bool>("streaming");
+
+  QTest::addRow("QJsonDocument") << false;
+  QTest::addRow("JsonReader") << true;
+}
+
+void TestServerModels::serverCountryModelBenchmark() {
+  QFETCH(bool, streaming);
+
+  QByteArray json = benchmarkServerList();
+  auto parse = streaming ? parseServerListReader : parseServerListDocument;
+
+  qsizetype count = 0;
+  QBENCHMARK { count = parse(json, nullptr); }
+  QCOMPARE(count, 10000);
+}
+
+void TestServerModels::serverCountryModelMemory_data() {
+  serverCountryModelBenchmark_data();
+}
+
+void TestServerModels::serverCountryModelMemory() {
+  QFETCH(bool, streaming);
+
+  if (heapInUse() < 0) {
+    QSKIP("Heap statistics are not available");
+  }
+
+  QByteArray json = benchmarkServerList();
+  auto parse = streaming ? parseServerListReader : parseServerListDocument;
+
+  // The heap held once everything is parsed, which is about the peak: the
+  // document is still held, and the reader holds the model it filled.
+  qint64 before = heapInUse();
+  qint64 parsed = 0;
+  QCOMPARE(parse(json, &parsed), 10000);
+  QTest::setBenchmarkResult(parsed - before, QTest::BytesAllocated);
+}
+
+void TestServerModels::serverMemoryUsage_data() {
+  QTest::addColumn<bool>("copy");
+
+  QTest::addRow("model") << false;
+  QTest::addRow("copy") << true;
+}
+
+void TestServerModels::serverMemoryUsage() {
+  QFETCH(bool, copy);
+
+  if (heapInUse() < 0) {
+    QSKIP("Heap statistics are not available");
+  }
+
+  QByteArray json = benchmarkServerList();
+
+  qint64 before = heapInUse();
+  ServerCountryModel model;
+  QVERIFY(model.fromJson(json));
+  qint64 parsed = heapInUse();
+
+  // Servers are also copied around, for example to pick one at random.
+  QList<Server> copies;
+  copies.reserve(10000);
+  for (const ServerCity* city : model.cities()) {
+    for (const QString& pubkey : city->servers()) {
+      copies.append(model.server(pubkey));
+    }
+  }
+  QCOMPARE(copies.count(), 10000);
+  qint64 copied = heapInUse();
+
+  // The model holds each server with its own strings, and its entries in the
+  // indexes of the model. A copy shares all of its strings and port ranges
+  // with the original.
+  qint64 perServer = copy ? (copied - parsed) / copies.count()
+                          : (parsed - before) / copies.count();
+  QTest::setBenchmarkResult(perServer, QTest::BytesAllocated);
+
+  // Only a sanity check, as the numbers depend on the allocator.
+  QVERIFY(perServer < 64 * 1024);
+}
+
+// DistanceQueue
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void TestServerModels::distanceQueueOrder() {
+  DistanceQueue<int> queue;
+  QVERIFY(queue.isEmpty());
+
+  // Enough values to need more than one chunk, with plenty of ties.
+  QRandomGenerator rng(42);
+  QList<std::pair<double, int>> expected;
+  for (int i = 0; i < 1000; i++) {
+    double distance = rng.bounded(100);
+    queue.append(i, distance);
+    expected.append({distance, i});
+  }
+  std::stable_sort(expected.begin(), expected.end(),
+                   [](const auto& a, const auto& b) {
+                     return a.first < b.first;
+                   });
+
+  QCOMPARE(queue.count(), 1000);
+  for (const auto& pair : expected) {
+    QCOMPARE(queue.takeFirst(), pair.second);
+  }
+  QVERIFY(queue.isEmpty());
+
+  // The queue can be reused once it is drained.
+  queue.append(2, 2.0);
+  queue.append(1, 1.0);
+  QCOMPARE(queue.takeFirst(), 1);
+  queue.clear();
+  QVERIFY(queue.isEmpty());
+}
+
+namespace {
+struct BenchmarkCity {
+  double latitude;
+  double longitude;
+  QStringList servers;
+};
+
+double benchmarkDistance(const BenchmarkCity& city) {
+  // Distance from somewhere in the middle of Europe.
+  constexpr double latitude = 48.0 * M_PI / 180.0;
+  constexpr double longitude = 11.0 * M_PI / 180.0;
+  double cityLatitude = city.latitude * M_PI / 180.0;
+  double diffLongitude = city.longitude * M_PI / 180.0 - longitude;
+  return qAcos(qSin(latitude) * qSin(cityLatitude) +
+               qCos(latitude) * qCos(cityLatitude) * qCos(diffLongitude));
+}
+}  // namespace
+
+void TestServerModels::distanceQueueBenchmark_data() {
+  QTest::addColumn<bool>("queue");
+  QTest::addColumn<int>("servers");
+
+  for (int servers : {500, 2000, 10000}) {
+    QTest::addRow("QList/%d", servers) << false << servers;
+    QTest::addRow("DistanceQueue/%d", servers) << true << servers;
+  }
+}
+
+void TestServerModels::distanceQueueBenchmark() {
+  QFETCH(bool, queue);
+  QFETCH(int, servers);
+
+  // A handful of servers per city, scattered around the globe.
+  QRandomGenerator rng(1234);
+  QList<BenchmarkCity> cities;
+  for (int i = 0; i < servers; i++) {
+    if ((i % 5) == 0) {
+      cities.append({rng.generateDouble() * 180.0 - 90.0,
+                     rng.generateDouble() * 360.0 - 180.0, QStringList()});
+    }
+    cities.last().servers.append(QString("server-%1").arg(i));
+  }
+
+  QString last;
+  if (!queue) {
+    // Sorted insertion into a list, as ServerLatency used to do.
+    struct Record {
+      QString pubkey;
+      double distance;
+    };
+    QBENCHMARK {
+      QList<Record> list;
+      for (const BenchmarkCity& city : cities) {
+        double distance = benchmarkDistance(city);
+        auto i = list.begin();
+        while (i != list.end()) {
+          if (i->distance >= distance) {
+            break;
+          }
+          i++;
+        }
+        for (const QString& pubkey : city.servers) {
+          i = list.insert(i, Record{pubkey, distance});
+        }
+      }
+      while (!list.isEmpty()) {
+        last = list.takeFirst().pubkey;
+      }
+    }
+  } else {
+    QBENCHMARK {
+      DistanceQueue<QString> list;
+      list.reserve(servers);
+      for (const BenchmarkCity& city : cities) {
+        double distance = benchmarkDistance(city);
+        for (const QString& pubkey : city.servers) {
+          list.append(pubkey, distance);
+        }
+      }
+      while (!list.isEmpty()) {
+        last = list.takeFirst();
+      }
+    }
+  }
+
+  // Both should agree on the furthest city.
+  const BenchmarkCity* furthest = &cities.first();
+  for (const BenchmarkCity& city : cities) {
+    if (benchmarkDistance(city) > benchmarkDistance(*furthest)) {
+      furthest = &city;
+    }
+  }
+  QVERIFY(furthest->servers.contains(last));
+}
+
+// CityRecommender
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void TestServerModels::cityRecommender() {
+  // Plenty of cities with the same score, and some with the same latency.
+  QRandomGenerator rng(42);
+  QList<ServerCity*> cities;
+  auto guard = qScopeGuard([&cities]() { qDeleteAll(cities); });
+  for (int i = 0; i < 300; i++) {
+    QJsonObject obj;
+    obj.insert("name", QString("City %1").arg(i));
+    obj.insert("code", QString("c%1").arg(i));
+    obj.insert("latitude", rng.bounded(180.0) - 90.0);
+    obj.insert("longitude", rng.bounded(360.0) - 180.0);
+    obj.insert("servers", QJsonArray());
+
+    ServerCity* city = new ServerCity();
+    QVERIFY(city->fromJson(obj, "xx"));
+    city->setLatency(rng.bounded(20) * 10);
+    city->setConnectionScore(rng.bounded(4));
+    cities.append(city);
+  }
+
+  Location location;
+  QVERIFY(location.fromJson(
+      "{\"city\": \"Paris\", \"country\": \"FR\", \"subdivision\": \"\", "
+      "\"ip\": \"1.2.3.4\", \"lat_long\": \"48.85,2.35\"}"));
+
+  // The ranking as RecommendedLocationModel used to compute it.
+  auto expected = [&](qsizetype count, double latencyScale,
+                      const Location& from) {
+    QList<std::pair<double, ServerCity*>> ranks;
+    for (ServerCity* city : cities) {
+      double distance = from.distance(city->latitude(), city->longitude());
+      ranks.append({CityRecommender::rank(city->connectionScore(),
+                                          city->latency(), latencyScale,
+                                          distance),
+                    city});
+    }
+    std::stable_sort(ranks.begin(), ranks.end(),
+                     [](const auto& a, const auto& b) {
+                       return a.first > b.first;
+                     });
+    QList<ServerCity*> list;
+    for (qsizetype i = 0; i < count; i++) {
+      list.append(ranks.at(i).second);
+    }
+    return list;
+  };
+
+  CityRecommender recommender;
+  QList<ServerCity*> best = recommender.recommend(
+      cities, location.latitude(), location.longitude(), 100.0, 5);
+  QCOMPARE(best, expected(5, 100.0, location));
+
+  // Fewer cities come from the same selection.
+  QCOMPARE(recommender.recommend(cities, location.latitude(),
+                                 location.longitude(), 100.0, 2),
+           best.mid(0, 2));
+  QCOMPARE(recommender.recommend(cities, location.latitude(),
+                                 location.longitude(), 250.0, 10),
+           expected(10, 250.0, location));
+
+  // The cities are ranked again when their score changes.
+  ServerCity* city = expected(300, 250.0, location).last();
+  city->setConnectionScore(10);
+  best = recommender.recommend(cities, location.latitude(),
+                               location.longitude(), 250.0, 5);
+  QCOMPARE(best.first(), city);
+  QCOMPARE(best, expected(5, 250.0, location));
+
+  // Without a location, only the score and the latency count.
+  Location unknown;
+  QCOMPARE(recommender.recommend(cities, qQNaN(), qQNaN(), 250.0, 5),
+           expected(5, 250.0, unknown));
+
+  QVERIFY(recommender.recommend({}, 0, 0, 100.0, 5).isEmpty());
+}
@@ -13,7 +13,10 @@ class TestServerModels final : public QObject, TestHelper<TestServerModels> {
   void serverBasic();
   void serverFromJson_data();
   void serverFromJson();
+  void serverAddresses();
   void serverWeightChooser();
+  void serverLatencyChooser();
+  void serverLatencyChooserCities();
 
   void serverCityBasic();
   void serverCityFromJson_data();
@@ -26,4 +29,20 @@ class TestServerModels final : public QObject, TestHelper<TestServerModels> {
   void serverCountryModelBasic();
   void serverCountryModelFromJson_data();
   void serverCountryModelFromJson();
+  void serverCountryModelSnapshot();
+  void serverCountryModelUpdate();
+  void serverSearchModel();
+  void serverLocalizedNames();
+  void serverCountryModelBenchmark_data();
+  void serverCountryModelBenchmark();
+  void serverCountryModelMemory_data();
+  void serverCountryModelMemory();
+  void serverMemoryUsage_data();
+  void serverMemoryUsage();
+
+  void distanceQueueOrder();
+  void distanceQueueBenchmark_data();
+  void distanceQueueBenchmark();
+
+  void cityRecommender();
 };
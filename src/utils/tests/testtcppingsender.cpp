@@ -0,0 +1,56 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testtcppingsender.h"
+
+#include <QSet>
+#include <QSignalSpy>
+#include <QTcpServer>
+#include <QtTest/QtTest>
+
+#include "tcppingsender.h"
+
+void TestTcpPingSender::loopback() {
+  QTcpServer server;
+  QVERIFY(server.listen(QHostAddress::LocalHost));
+
+  TcpPingSender sender(QHostAddress(), server.serverPort());
+  QSignalSpy spy(&sender, &PingSender::recvPing);
+
+  // Send a burst of pings, they should all be answered.
+  qint64 start = PingSender::monotonicTime();
+  QList<PingSender::PingRequest> requests;
+  for (quint16 sequence = 1; sequence <= 8; sequence++) {
+    requests.append({QHostAddress(QHostAddress::LocalHost), sequence});
+  }
+  sender.sendPings(requests);
+
+  QTRY_COMPARE(spy.count(), 8);
+  QSet<quint16> sequences;
+  for (const QList<QVariant>& args : spy) {
+    sequences.insert(args.at(0).value<quint16>());
+    qint64 timestamp = args.at(1).toLongLong();
+    QVERIFY(timestamp >= start);
+    QVERIFY(timestamp <= PingSender::monotonicTime());
+  }
+  QCOMPARE(sequences.count(), 8);
+}
+
+void TestTcpPingSender::refused() {
+  // Find a port that nobody is listening on.
+  quint16 port;
+  {
+    QTcpServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    port = server.serverPort();
+  }
+
+  TcpPingSender sender(QHostAddress(), port);
+  QSignalSpy spy(&sender, &PingSender::recvPing);
+  sender.sendPing(QHostAddress(QHostAddress::LocalHost), 1);
+
+  // A refused connection is not a reply.
+  QTest::qWait(200);
+  QCOMPARE(spy.count(), 0);
+}
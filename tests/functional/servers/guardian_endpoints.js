@@ -107,6 +107,8 @@ exports.endpoints = {
     '/api/v1/vpn/servers': {
       status: 200,
       requiredHeaders: ['Authorization'],
+      // Express answers conditional requests with a 304 on its own.
+      headers: {'Last-Modified': 'Mon, 01 Jan 2024 00:00:00 GMT'},
       body: {
         'countries': [
           {
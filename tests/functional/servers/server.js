@@ -131,6 +131,9 @@ class Server {
     }
 
     res.status(responseData.status);
+    if (responseData.headers) {
+      res.set(responseData.headers);
+    }
     if ('bodyRaw' in responseData) {
       res.send(responseData.bodyRaw);
       return;
@@ -247,3 +247,168 @@ describe('Key regeneration', function () {
     });
   });
 });
+
+describe('Handshake racing', function() {
+  this.ctx.authenticationNeeded = true;
+
+  const raceServer = (publicKey) => ({
+    'hostname': `host-${publicKey}`,
+    'ipv4_addr_in': '127.0.0.1',
+    'ipv6_addr_in': '::1',
+    'weight': 100,
+    'include_in_country': true,
+    'public_key': publicKey,
+    'port_ranges': [[53, 53], [4000, 33433], [33565, 51820], [52000, 60000]],
+    'ipv4_gateway': '127.0.0.1',
+    'ipv6_gateway': '::1'
+  });
+
+  this.ctx.guardianOverrideEndpoints = {
+    GETs: {
+      '/api/v1/vpn/servers': {
+        status: 200,
+        requiredHeaders: ['Authorization'],
+        body: {
+          'countries': [{
+            'name': 'Denmark',
+            'code': 'dk',
+            'cities': [{
+              'name': 'Copenhagen',
+              'code': 'cph',
+              'latitude': 55.676098,
+              'longitude': 12.568337,
+              'servers': [
+                raceServer('race-key1'),
+                raceServer('race-key2'),
+                raceServer('race-key3'),
+              ],
+            }]
+          }]
+        }
+      },
+    }
+  };
+
+  // Only one of the three servers of the city ever completes a handshake.
+  before(() => {
+    process.env['MZ_MOCK_UNRESPONSIVE_PEERS'] = 'race-key1,race-key2';
+  });
+
+  after(() => {
+    delete process.env['MZ_MOCK_UNRESPONSIVE_PEERS'];
+  });
+
+  it('Connects without waiting for unresponsive servers', async () => {
+    if (this.ctx.wasm) {
+      // This test cannot run in wasm
+      return;
+    }
+
+    await vpn.waitForCondition(async () => {
+      const servers = await vpn.servers();
+      return servers.some(country => country.code === 'dk');
+    });
+    await vpn.setSetting(
+        'serverData',
+        '{"enter_city_name":"","enter_country_code":"","exit_city_name":"Copenhagen","exit_country_code":"dk"}');
+
+    const start = Date.now();
+    await vpn.activateViaToggle();
+    await vpn.waitForCondition(async () => {
+      return await vpn.getQueryProperty(
+                 queries.screenHome.CONTROLLER_TITLE, 'text') == 'VPN is on';
+    });
+
+    // Without racing, a bad pick would wait for the whole handshake timeout.
+    assert(Date.now() - start < 10000);
+  });
+});
+
+describe('Transport probing', function() {
+  this.ctx.authenticationNeeded = true;
+  this.timeout(60000);
+
+  // Servers without port 53 in their ranges, so that only the port 53 probe
+  // can reach them.
+  const probeServer = (publicKey) => ({
+    'hostname': `host-${publicKey}`,
+    'ipv4_addr_in': '127.0.0.1',
+    'ipv6_addr_in': '::1',
+    'weight': 100,
+    'include_in_country': true,
+    'public_key': publicKey,
+    'port_ranges': [[4000, 33433], [33565, 51820], [52000, 60000]],
+    'ipv4_gateway': '127.0.0.1',
+    'ipv6_gateway': '::1'
+  });
+
+  this.ctx.guardianOverrideEndpoints = {
+    GETs: {
+      '/api/v1/vpn/servers': {
+        status: 200,
+        requiredHeaders: ['Authorization'],
+        body: {
+          'countries': [{
+            'name': 'Denmark',
+            'code': 'dk',
+            'cities': [{
+              'name': 'Copenhagen',
+              'code': 'cph',
+              'latitude': 55.676098,
+              'longitude': 12.568337,
+              'servers': [
+                probeServer('probe-key1'),
+                probeServer('probe-key2'),
+                probeServer('probe-key3'),
+              ],
+            }]
+          }]
+        }
+      },
+    }
+  };
+
+  // The network drops plain UDP, except to port 53.
+  before(() => {
+    process.env['MZ_MOCK_HANDSHAKE_PORTS'] = '53';
+  });
+
+  after(() => {
+    delete process.env['MZ_MOCK_HANDSHAKE_PORTS'];
+  });
+
+  it('Connects through another transport when UDP is blocked', async () => {
+    if (this.ctx.wasm) {
+      // This test cannot run in wasm
+      return;
+    }
+
+    await vpn.waitForCondition(async () => {
+      const servers = await vpn.servers();
+      return servers.some(country => country.code === 'dk');
+    });
+    await vpn.setSetting(
+        'serverData',
+        '{"enter_city_name":"","enter_country_code":"","exit_city_name":"Copenhagen","exit_country_code":"dk"}');
+
+    await vpn.activateViaToggle();
+
+    // None of the raced servers answers before the handshake timeout.
+    await vpn.wait(5000);
+    await vpn.waitForCondition(async () => {
+      return parseInt(await vpn.getMozillaProperty(
+                 'Mozilla.VPN', 'VPNController', 'connectionRetry')) > 0;
+    });
+    assert.notEqual(
+        await vpn.getQueryProperty(queries.screenHome.CONTROLLER_TITLE, 'text'),
+        'VPN is on');
+
+    // The port 53 probe then wins before the probe deadline.
+    const start = Date.now();
+    await vpn.waitForCondition(async () => {
+      return await vpn.getQueryProperty(
+                 queries.screenHome.CONTROLLER_TITLE, 'text') == 'VPN is on';
+    });
+    assert(Date.now() - start < 5000);
+  });
+});
@@ -5,6 +5,8 @@
 const assert = require('assert');
 const queries = require('./queries.js');
 const vpn = require('./helper.js');
+const setup = require('./setupVpn.js');
+const guardianEndpoints = require('./servers/guardian_endpoints.js');
 
 describe('Server', function() {
   this.timeout(240000);
@@ -278,5 +280,49 @@ describe('Server', function() {
     });
   });
 
+  describe('Server list cache validation', function() {
+    const serversEndpoint =
+        guardianEndpoints.endpoints.GETs['/api/v1/vpn/servers'];
+    const ifNoneMatch = [];
+    const override = {
+      status: 200,
+      requiredHeaders: ['Authorization'],
+      // Express answers with a 304 when If-None-Match has this ETag.
+      headers: {'ETag': '"servers-1"'},
+      callback: (req) => ifNoneMatch.push(req.headers['if-none-match']),
+      body: serversEndpoint.body,
+    };
+    this.ctx.guardianOverrideEndpoints = {
+      GETs: {'/api/v1/vpn/servers': override},
+    };
+
+    it('keeps the server list when it was not modified', async () => {
+      if (this.ctx.wasm) {
+        // This test cannot run in wasm
+        return;
+      }
+
+      // The list is downloaded at startup, and its ETag is stored.
+      await vpn.waitForCondition(async () => {
+        return await vpn.getSetting('serversETag') === '"servers-1"';
+      });
+      const servers = await vpn.servers();
+
+      // The list changes, but keeps its ETag: only a client that sends the
+      // stored ETag back gets a 304 instead of the new list.
+      override.body = {'countries': serversEndpoint.body.countries.slice(1)};
+      const requests = ifNoneMatch.length;
+      await vpn.quit();
+      await setup.startAndConnect();
+
+      await vpn.waitForCondition(() => ifNoneMatch.length > requests);
+      assert.strictEqual(ifNoneMatch[requests], '"servers-1"');
+
+      // Give the reply a moment to be processed: the list must not change.
+      await vpn.wait(2000);
+      assert.deepStrictEqual(await vpn.servers(), servers);
+    });
+  });
+
   // TODO: server list disabled when reached the device limit
 });
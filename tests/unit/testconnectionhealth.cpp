@@ -6,6 +6,7 @@
 
 #include "connectionhealth.h"
 #include "helper.h"
+#include "pingsender.h"
 
 void TestConnectionHealth::init() {}
 
@@ -17,11 +18,12 @@ void TestConnectionHealth::dnsPingReceived() {
   QVERIFY(!connectionHealth.m_dnsPingInitialized);
 
   // Ping for invalid sequence number should not be accepted
-  connectionHealth.dnsPingReceived(42);
+  connectionHealth.dnsPingReceived(42, PingSender::monotonicTime());
   QVERIFY(!connectionHealth.m_dnsPingInitialized);
 
   // Ping for matching sequence number should be accepted
-  connectionHealth.dnsPingReceived(connectionHealth.m_dnsPingSequence);
+  connectionHealth.dnsPingReceived(connectionHealth.m_dnsPingSequence,
+                                   PingSender::monotonicTime());
   QVERIFY(connectionHealth.m_dnsPingInitialized);
 }
 
@@ -53,7 +55,7 @@ void TestConnectionHealth::healthCheckup() {
   connectionHealth.m_noSignalTimer.start();
   for (int i = 0; i < connectionHealth.m_pingHelper.m_pingData.size(); i++) {
     connectionHealth.m_pingHelper.m_pingData[i].timestamp =
-        QDateTime::currentMSecsSinceEpoch() - (60 * 1000);
+        PingSender::monotonicTime() - (60 * 1000 * 1000);
   }
   connectionHealth.healthCheckup();
   QCOMPARE(connectionHealth.m_stability,
@@ -62,21 +64,23 @@ void TestConnectionHealth::healthCheckup() {
   // Signal timer is active, recent pings not lost -> Stable
   for (int i = 0; i < connectionHealth.m_pingHelper.m_pingData.size(); i++) {
     connectionHealth.m_pingHelper.m_pingData[i].timestamp =
-        QDateTime::currentMSecsSinceEpoch();
+        PingSender::monotonicTime();
   }
   connectionHealth.healthCheckup();
   QCOMPARE(connectionHealth.m_stability,
            ConnectionHealth::ConnectionStability::Stable);
 
   // Signal timer is active, recent ping(s) took too long -> Unstable
-  connectionHealth.dnsPingReceived(connectionHealth.m_dnsPingSequence);
+  connectionHealth.dnsPingReceived(connectionHealth.m_dnsPingSequence,
+                                   PingSender::monotonicTime());
   connectionHealth.m_pingHelper.m_pingData[0].latency = INT_MAX;
   connectionHealth.healthCheckup();
   QCOMPARE(connectionHealth.m_stability,
            ConnectionHealth::ConnectionStability::Unstable);
 
   // Signal timer is active, recent ping(s) arrived on time -> Back to Stable
-  connectionHealth.dnsPingReceived(connectionHealth.m_dnsPingSequence);
+  connectionHealth.dnsPingReceived(connectionHealth.m_dnsPingSequence,
+                                   PingSender::monotonicTime());
   connectionHealth.m_pingHelper.m_pingData[0].latency = 0;
   connectionHealth.healthCheckup();
   QCOMPARE(connectionHealth.m_stability,
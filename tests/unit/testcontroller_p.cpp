@@ -95,4 +95,93 @@ void TestControllerPrivate::getExtensionProxyAddressRanges() {
            true);
 }
 
+void TestControllerPrivate::networkTransportKey() {
+  const QByteArray secret("secret");
+
+  // Unknown networks are never remembered.
+  QCOMPARE(ControllerPrivate::networkTransportKey(secret, QString(), 0),
+           QString());
+  QCOMPARE(ControllerPrivate::networkTransportKey(QByteArray(), "WiFi/a", 0),
+           QString());
+
+  // The network is hashed, and the configured policy follows it.
+  QString key = ControllerPrivate::networkTransportKey(
+      secret, "WiFi/00:11:22:33:44:55", 2);
+  QVERIFY(!key.contains("00:11:22:33:44:55"));
+  QCOMPARE(key.length(), 16 + 3);
+  QVERIFY(key.endsWith(":2:"));
+
+  QCOMPARE(ControllerPrivate::networkTransportKey(
+               secret, "WiFi/00:11:22:33:44:55", 2),
+           key);
+  QVERIFY(ControllerPrivate::networkTransportKey(
+              secret, "WiFi/00:11:22:33:44:55", 1) != key);
+  QVERIFY(ControllerPrivate::networkTransportKey(
+              secret, "WiFi/66:77:88:99:aa:bb", 2) != key);
+
+  // Without the secret, the key can't be matched to a network.
+  QVERIFY(ControllerPrivate::networkTransportKey(
+              "other secret", "WiFi/00:11:22:33:44:55", 2) != key);
+}
+
+void TestControllerPrivate::rememberedTransport() {
+  QString key = ControllerPrivate::networkTransportKey("secret", "WiFi/a", 0);
+  QString other = ControllerPrivate::networkTransportKey("secret", "WiFi/b", 0);
+  QStringList entries = {other + "1", key + "3"};
+
+  QCOMPARE(ControllerPrivate::rememberedTransport(entries, key).value_or(-1),
+           3);
+  QCOMPARE(ControllerPrivate::rememberedTransport(entries, other).value_or(-1),
+           1);
+  QString unknown =
+      ControllerPrivate::networkTransportKey("secret", "WiFi/c", 0);
+  QVERIFY(
+      !ControllerPrivate::rememberedTransport(entries, unknown).has_value());
+  QVERIFY(!ControllerPrivate::rememberedTransport(entries, QString())
+               .has_value());
+
+  // A corrupted entry is ignored.
+  QVERIFY(
+      !ControllerPrivate::rememberedTransport({key + "x"}, key).has_value());
+}
+
+void TestControllerPrivate::rememberTransport() {
+  QString key = ControllerPrivate::networkTransportKey("secret", "WiFi/a", 0);
+  QString other = ControllerPrivate::networkTransportKey("secret", "WiFi/b", 0);
+
+  // A transport other than the configured one is remembered first.
+  QStringList entries =
+      ControllerPrivate::rememberTransport({other + "1"}, key, 0, 2);
+  QCOMPARE(entries, QStringList({key + "2", other + "1"}));
+
+  // A newer transport replaces it.
+  entries = ControllerPrivate::rememberTransport(entries, key, 0, 3);
+  QCOMPARE(entries, QStringList({key + "3", other + "1"}));
+
+  // Connecting with the configured transport, or timing out with the
+  // remembered one, forgets the network.
+  entries = ControllerPrivate::rememberTransport(entries, key, 0, 0);
+  QCOMPARE(entries, QStringList({other + "1"}));
+
+  // Nothing changes when there is nothing to forget, or no network.
+  QCOMPARE(ControllerPrivate::rememberTransport(entries, key, 0, 0), entries);
+  QCOMPARE(ControllerPrivate::rememberTransport(entries, QString(), 0, 2),
+           entries);
+
+  // Only the most recent networks are kept.
+  auto networkKey = [](int network) {
+    return ControllerPrivate::networkTransportKey(
+        "secret", QString("WiFi/%1").arg(network), 0);
+  };
+  entries.clear();
+  for (int i = 0; i < ControllerPrivate::NETWORK_TRANSPORTS_MAX + 5; ++i) {
+    entries =
+        ControllerPrivate::rememberTransport(entries, networkKey(i), 0, 1);
+  }
+  QCOMPARE(entries.count(), ControllerPrivate::NETWORK_TRANSPORTS_MAX);
+  QCOMPARE(entries.first(),
+           networkKey(ControllerPrivate::NETWORK_TRANSPORTS_MAX + 4) + "1");
+  QVERIFY(!entries.contains(networkKey(0) + "1"));
+}
+
 static TestControllerPrivate s_instance;
@@ -8,4 +8,7 @@ class TestControllerPrivate final : public TestHelper {
   Q_OBJECT
  private slots:
   void getExtensionProxyAddressRanges();
+  void networkTransportKey();
+  void rememberedTransport();
+  void rememberTransport();
 };
@@ -4,13 +4,18 @@
 
 #include "testserverlatency.h"
 
+#include <QBitArray>
 #include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
 #include <QJsonObject>
 
 #include "constants.h"
 #include "feature/features.h"
 #include "models/location.h"
 #include "models/servercity.h"
+#include "models/servercountrymodel.h"
+#include "mozillavpn.h"
 #include "serverlatency.h"
 #include "settingsholder.h"
 
@@ -42,6 +47,116 @@ void TestServerLatency::latency() {
   }
 }
 
+void TestServerLatency::statistics() {
+  ServerLatency serverLatency;
+
+  // Each measurement refines the statistics, rather than replacing them.
+  serverLatency.setLatency("Flaky Server", 100);
+  serverLatency.setTimeout("Flaky Server");
+  serverLatency.setLatency("Flaky Server", 200);
+  PingStatistics stats = serverLatency.getStatistics("Flaky Server");
+  QCOMPARE(stats.probes(), 3u);
+  QCOMPARE(stats.latency(), 113);
+  QVERIFY(stats.jitter() > 0);
+  QVERIFY(stats.packetLoss() > 0.3);
+  QCOMPARE(serverLatency.getLatency("Flaky Server"), 113);
+
+  // Timeouts alone don't count towards the average latency.
+  serverLatency.setTimeout("Dead Server");
+  QCOMPARE(serverLatency.getLatency("Dead Server"), 0);
+  QCOMPARE(serverLatency.getStatistics("Dead Server").packetLoss(), 1.0);
+  QCOMPARE(serverLatency.avgLatency(), 113);
+
+  // Samples keep their sub-millisecond precision until they are reported.
+  PingStatistics precise;
+  precise.addSample(1600);
+  QCOMPARE(precise.latency(), 2);
+  precise.addSample(400);
+  QCOMPARE(precise.latency(), 1);
+}
+
+void TestServerLatency::needsProbe() {
+  ServerLatency serverLatency;
+  qint64 now = QDateTime::currentSecsSinceEpoch();
+  auto needsProbe = [&](const QString& pubkey, qint64 staleBefore) {
+    return serverLatency.needsProbe(serverLatency.serverId(pubkey),
+                                    staleBefore);
+  };
+
+  // New servers have to be measured.
+  QVERIFY(needsProbe("New Server", now - 60));
+
+  // Servers with a recent measurement don't, until it becomes stale.
+  serverLatency.setLatency("Good Server", 50);
+  QVERIFY(!needsProbe("Good Server", now - 60));
+  QVERIFY(needsProbe("Good Server", now + 60));
+
+  // Servers that are failing are measured again.
+  serverLatency.setTimeout("Dead Server");
+  QVERIFY(needsProbe("Dead Server", now - 60));
+  serverLatency.setLatency("Lossy Server", 50);
+  serverLatency.setTimeout("Lossy Server");
+  QVERIFY(needsProbe("Lossy Server", now - 60));
+
+  // Servers that were removed are forgotten.
+  serverLatency.setLatency("Old Server", 150);
+  QCOMPARE(serverLatency.avgLatency(), 84);
+  QBitArray keep(serverLatency.m_statistics.count());
+  keep.setBit(serverLatency.serverId("Good Server"));
+  keep.setBit(serverLatency.serverId("Dead Server"));
+  serverLatency.removeStatistics(keep);
+  QCOMPARE(serverLatency.getLatency("Old Server"), 0);
+  QCOMPARE(serverLatency.getLatency("Good Server"), 50);
+  QCOMPARE(serverLatency.avgLatency(), 50);
+  QVERIFY(needsProbe("Old Server", now - 60));
+}
+
+void TestServerLatency::scoreUpdates() {
+  ServerLatency serverLatency;
+  QVERIFY(!serverLatency.m_scoresDirty);
+
+  // Measurements only mark the scores as dirty, to be updated in one pass.
+  serverLatency.setLatency("Server A", 100);
+  serverLatency.setLatency("Server B", 200);
+  serverLatency.setTimeout("Server C");
+  QVERIFY(serverLatency.m_scoresDirty);
+  QVERIFY(serverLatency.m_progressDelayTimer.isActive());
+
+  serverLatency.updateAllConnectionScores();
+  QVERIFY(!serverLatency.m_scoresDirty);
+
+  // The totals for a city are gathered from the statistics of its servers.
+  QJsonObject obj;
+  obj["code"] = "ct";
+  obj["name"] = "City";
+  obj["latitude"] = 0.0;
+  obj["longitude"] = 0.0;
+  QJsonArray servers;
+  for (const QString& pubkey : {"Server A", "Server B", "Server C"}) {
+    QJsonObject server;
+    server["public_key"] = pubkey;
+    servers.append(server);
+  }
+  obj["servers"] = servers;
+
+  ServerCity city;
+  QVERIFY(city.fromJson(obj, "cc"));
+  auto stats = serverLatency.cityStatistics(city);
+  QCOMPARE(stats.numLatencySamples, 2);
+  QCOMPARE(stats.sumLatencyMsec, 300);
+  QCOMPARE(stats.numLossSamples, 3);
+
+  // The totals follow the servers as they are updated and removed.
+  serverLatency.setLatency("Server A", 100);
+  QBitArray keep(serverLatency.m_statistics.count());
+  keep.setBit(serverLatency.serverId("Server A"));
+  serverLatency.removeStatistics(keep);
+  stats = serverLatency.cityStatistics(city);
+  QCOMPARE(stats.numLatencySamples, 1);
+  QCOMPARE(stats.sumLatencyMsec, 100);
+  QCOMPARE(stats.numLossSamples, 1);
+}
+
 void TestServerLatency::cooldown() {
   ServerLatency serverLatency;
 
@@ -56,6 +171,60 @@ void TestServerLatency::cooldown() {
   QCOMPARE(serverLatency.getCooldown("Some Server"), 0);
 }
 
+void TestServerLatency::cache() {
+  SettingsHolder::instance()->removeServerLatencyCache();
+
+  // Measurements and cooldowns should survive a restart.
+  {
+    ServerLatency serverLatency;
+    serverLatency.setLatency("Fast Server", 20);
+    serverLatency.setLatency("Slow Server", 300);
+    serverLatency.setCooldown("Broken Server", 1234);
+    serverLatency.writeSettings();
+  }
+  QVERIFY(SettingsHolder::instance()->hasServerLatencyCache());
+
+  {
+    ServerLatency serverLatency;
+    serverLatency.readSettings();
+    QCOMPARE(serverLatency.getLatency("Fast Server"), 20);
+    QCOMPARE(serverLatency.getLatency("Slow Server"), 300);
+    QCOMPARE(serverLatency.getLatency("Broken Server"), 0);
+    QCOMPARE(serverLatency.avgLatency(), 160);
+    QVERIFY(serverLatency.getCooldown("Broken Server") >
+            QDateTime::currentSecsSinceEpoch());
+    QVERIFY(serverLatency.lastUpdateTime().isValid());
+  }
+
+  // Unknown versions of the cache are ignored.
+  SettingsHolder::instance()->setServerLatencyCache(QByteArray("\xffgarbage"));
+  {
+    ServerLatency serverLatency;
+    serverLatency.readSettings();
+    QCOMPARE(serverLatency.getLatency("Fast Server"), 0);
+    QVERIFY(!serverLatency.lastUpdateTime().isValid());
+  }
+
+  SettingsHolder::instance()->removeServerLatencyCache();
+}
+
+void TestServerLatency::cacheWrites() {
+  SettingsHolder::instance()->removeServerLatencyCache();
+
+  // Cooldowns are saved together, at the latest when the sweep stops.
+  ServerLatency serverLatency;
+  serverLatency.setCooldown("Broken Server", 1234);
+  serverLatency.setCooldown("Other Broken Server", 1234);
+  QVERIFY(!SettingsHolder::instance()->hasServerLatencyCache());
+  QVERIFY(serverLatency.m_settingsTimer.isActive());
+
+  serverLatency.stop();
+  QVERIFY(SettingsHolder::instance()->hasServerLatencyCache());
+  QVERIFY(!serverLatency.m_settingsTimer.isActive());
+
+  SettingsHolder::instance()->removeServerLatencyCache();
+}
+
 constexpr const char* testServerCountryCode = "Middle Earth";
 
 void TestServerLatency::baseCityScore_data() {
@@ -147,4 +316,77 @@ void TestServerLatency::baseCityScore() {
   QCOMPARE(serverLatency.baseCityScore(&city, userCountry), score);
 }
 
+void TestServerLatency::multiHopScore() {
+  // One server per city: Berlin and Frankfurt are close to each other, and
+  // far from Sydney.
+  struct TestCity {
+    QString country;
+    QString name;
+    double latitude;
+    double longitude;
+  };
+  QList<TestCity> testCities = {
+      {"de", "Berlin", 52.52, 13.40},
+      {"de", "Frankfurt", 50.11, 8.68},
+      {"au", "Sydney", -33.87, 151.21},
+  };
+  QJsonArray countries;
+  for (const QString& code : {"de", "au"}) {
+    QJsonArray cities;
+    for (const TestCity& testCity : testCities) {
+      if (testCity.country != code) {
+        continue;
+      }
+      QJsonObject server;
+      server["hostname"] = testCity.name;
+      server["ipv4_addr_in"] = "169.254.0.1";
+      server["ipv4_gateway"] = "169.254.0.2";
+      server["ipv6_addr_in"] = "fc00::1";
+      server["ipv6_gateway"] = "fc00::2";
+      server["public_key"] = "key-" + testCity.name;
+      server["weight"] = 1;
+      server["multihop_port"] = 1234;
+      server["socks5_name"] = "socks5";
+      server["port_ranges"] = QJsonArray();
+
+      QJsonObject city;
+      city["name"] = testCity.name;
+      city["code"] = testCity.name.toLower();
+      city["latitude"] = testCity.latitude;
+      city["longitude"] = testCity.longitude;
+      city["servers"] = QJsonArray{server};
+      cities.append(city);
+    }
+    QJsonObject country;
+    country["name"] = code.toUpper();
+    country["code"] = code;
+    country["cities"] = cities;
+    countries.append(country);
+  }
+  QJsonObject obj;
+  obj["countries"] = countries;
+  QVERIFY(MozillaVPN::instance()->serverCountryModel()->fromJson(
+      QJsonDocument(obj).toJson()));
+
+  ServerLatency serverLatency;
+  auto score = [&](const QString& exitCountry, const QString& exitCity) {
+    return serverLatency.multiHopScore(exitCountry, exitCity, "de", "Berlin");
+  };
+
+  // A close exit in the same country gets two more points.
+  QCOMPARE(score("de", "Frankfurt"), ServerLatency::Good);
+  QCOMPARE(score("au", "Sydney"), ServerLatency::Poor);
+  QCOMPARE(score("xx", "Nowhere"), ServerLatency::NoData);
+  QCOMPARE(serverLatency.multiHopScore("de", "Frankfurt", "xx", "Nowhere"),
+           ServerLatency::NoData);
+
+  // The scores follow the cooldowns.
+  serverLatency.setCooldown("key-Frankfurt", 1234);
+  QCOMPARE(score("de", "Frankfurt"), ServerLatency::Unavailable);
+  QCOMPARE(serverLatency.multiHopScore("de", "Frankfurt", "xx", "Nowhere"),
+           ServerLatency::Unavailable);
+  serverLatency.clearAllCooldowns();
+  QCOMPARE(score("de", "Frankfurt"), ServerLatency::Good);
+}
+
 static TestServerLatency s_testServerLatency;
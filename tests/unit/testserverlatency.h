@@ -11,8 +11,14 @@ class TestServerLatency : public TestHelper {
   void init();
 
   void latency();
+  void statistics();
+  void needsProbe();
+  void scoreUpdates();
   void cooldown();
+  void cache();
+  void cacheWrites();
 
   void baseCityScore_data();
   void baseCityScore();
+  void multiHopScore();
 };
@@ -24,4 +24,19 @@ void TestNetworkRequest::testSetAuthHeader() {
   QCOMPARE(request.m_request.rawHeader("Authorization"), "ANOTHER TOKEN");
 }
 
+void TestNetworkRequest::testSetCacheValidators() {
+  TaskFunction task([&]() {});
+  NetworkRequest request(&task);
+
+  // Without validators, the request is not conditional.
+  request.setCacheValidators(QByteArray(), QByteArray());
+  QVERIFY(!request.m_request.hasRawHeader("If-None-Match"));
+  QVERIFY(!request.m_request.hasRawHeader("If-Modified-Since"));
+
+  request.setCacheValidators("W/\"1234\"", "Mon, 01 Jan 2024 00:00:00 GMT");
+  QCOMPARE(request.m_request.rawHeader("If-None-Match"), "W/\"1234\"");
+  QCOMPARE(request.m_request.rawHeader("If-Modified-Since"),
+           "Mon, 01 Jan 2024 00:00:00 GMT");
+}
+
 static TestNetworkRequest s_testNetworkRequest;
@@ -9,4 +9,5 @@ class TestNetworkRequest final : public TestHelper {
 
  private slots:
   void testSetAuthHeader();
+  void testSetCacheValidators();
 };